@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <memory_resource>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+#include "Orderbook.h"
+
+// Read-only order book rebuilt from a market-by-order (L3) feed: the
+// exchange has already matched, so every event names the order it changes
+// and nothing here ever crosses or trades. The level maps and everything
+// read off them (top of book, depth, level lists) are OrderBook's
+// BookLevels, on a node pool of their own; what is gone is the Order object
+// and its shared_ptr, the matching loop, stops, expiries and participants.
+// An order is an id and a quantity in its level's queue, and the index
+// entry points straight at its level, so executions and partial cancels
+// never search the level map.
+//
+// Each event returns false, leaving the book unchanged, when it names an
+// order the book does not hold (or, for Add, one it already holds), so a
+// caller can count feed inconsistencies instead of stopping on them.
+class BookBuilder {
+private:
+  struct BookOrder {
+    OrderId orderId_;
+    Quantity quantity_;
+  };
+  using BookOrders = std::pmr::list<BookOrder>;
+
+  using Level = BookLevels<BookOrders>::Level;
+  template <Side S> using Levels = BookLevels<BookOrders>::Levels<S>;
+
+  struct OrderEntry {
+    Level *level_;
+    BookOrders::iterator location_;
+    Price price_;
+    Side side_;
+  };
+  using OrderEntries = std::pmr::unordered_map<OrderId, OrderEntry>;
+
+  std::pmr::unsynchronized_pool_resource pool_;
+  BookLevels<BookOrders> levels_{&pool_};
+  OrderEntries orders_{&pool_};
+
+  std::optional<Price> lastExecutionPrice_;
+  std::uint64_t executedVolume_{0};
+
+  template <Side S> Levels<S> &GetLevels() { return levels_.Get<S>(); }
+
+  template <Side S>
+  bool Add(OrderId orderId, Price price, Quantity quantity) {
+    const auto [entry, inserted] = orders_.try_emplace(orderId);
+    if (!inserted)
+      return false;
+    auto &level = GetLevels<S>().try_emplace(price).first->second;
+    level.orders_.push_back(BookOrder{orderId, quantity});
+    level.quantity_ += quantity;
+    entry->second = OrderEntry{&level, std::prev(level.orders_.end()), price, S};
+    return true;
+  }
+
+  template <Side S> void Remove(OrderEntries::iterator it) {
+    const OrderEntry &entry = it->second;
+    entry.level_->quantity_ -= entry.location_->quantity_;
+    entry.level_->orders_.erase(entry.location_);
+    if (entry.level_->orders_.empty())
+      GetLevels<S>().erase(entry.price_);
+    orders_.erase(it);
+  }
+
+  void Remove(OrderEntries::iterator it) {
+    if (it->second.side_ == Side::Buy)
+      Remove<Side::Buy>(it);
+    else
+      Remove<Side::Sell>(it);
+  }
+
+  // Takes quantity off an order in place, keeping its queue position, and
+  // removes it once nothing is left.
+  void Reduce(OrderEntries::iterator it, Quantity quantity) {
+    BookOrder &order = *it->second.location_;
+    if (quantity >= order.quantity_)
+      return Remove(it);
+    order.quantity_ -= quantity;
+    it->second.level_->quantity_ -= quantity;
+  }
+
+public:
+  explicit BookBuilder(
+      std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+      : pool_{upstream} {}
+
+  BookBuilder(const BookBuilder &) = delete;
+  BookBuilder &operator=(const BookBuilder &) = delete;
+
+  // Same as OrderBook::Reserve: sizes the index and warms the pool with the
+  // nodes maxOrders orders over maxLevels levels will need.
+  void Reserve(std::size_t maxOrders, std::size_t maxLevels) {
+    orders_.reserve(maxOrders);
+    {
+      OrderEntries entries{&pool_};
+      entries.reserve(maxOrders);
+      for (std::size_t i = 0; i < maxOrders; ++i)
+        entries.emplace(i, OrderEntry{});
+    }
+    levels_.Reserve(maxOrders, maxLevels);
+  }
+
+  // A new order at the back of its level.
+  bool AddOrder(OrderId orderId, Side side, Price price, Quantity quantity) {
+    return side == Side::Buy ? Add<Side::Buy>(orderId, price, quantity)
+                             : Add<Side::Sell>(orderId, price, quantity);
+  }
+
+  // quantity of a resting order traded; it keeps its place if any is left.
+  bool ExecuteOrder(OrderId orderId, Quantity quantity) {
+    auto it = orders_.find(orderId);
+    if (it == orders_.end())
+      return false;
+    lastExecutionPrice_ = it->second.price_;
+    executedVolume_ += std::min(quantity, it->second.location_->quantity_);
+    Reduce(it, quantity);
+    return true;
+  }
+
+  // Partial cancel: quantity comes off without a trade.
+  bool ReduceOrder(OrderId orderId, Quantity quantity) {
+    auto it = orders_.find(orderId);
+    if (it == orders_.end())
+      return false;
+    Reduce(it, quantity);
+    return true;
+  }
+
+  bool DeleteOrder(OrderId orderId) {
+    auto it = orders_.find(orderId);
+    if (it == orders_.end())
+      return false;
+    Remove(it);
+    return true;
+  }
+
+  // The order is withdrawn and re-entered under newOrderId at the back of
+  // the queue at price, on the same side.
+  bool ReplaceOrder(OrderId orderId, OrderId newOrderId, Price price,
+                    Quantity quantity) {
+    auto it = orders_.find(orderId);
+    if (it == orders_.end() || (newOrderId != orderId && Contains(newOrderId)))
+      return false;
+    const Side side = it->second.side_;
+    Remove(it);
+    return AddOrder(newOrderId, side, price, quantity);
+  }
+
+  // Modify under the same id: a smaller quantity at the same price keeps
+  // the order's place, anything else sends it to the back of the queue.
+  bool ModifyOrder(OrderId orderId, Price price, Quantity quantity) {
+    auto it = orders_.find(orderId);
+    if (it == orders_.end())
+      return false;
+    const Quantity current = it->second.location_->quantity_;
+    if (price == it->second.price_ && quantity <= current) {
+      Reduce(it, current - quantity);
+      return true;
+    }
+    return ReplaceOrder(orderId, orderId, price, quantity);
+  }
+
+  std::size_t Size() const { return orders_.size(); }
+  bool Contains(OrderId orderId) const { return orders_.contains(orderId); }
+
+  // Quantity still resting for orderId, 0 if it is not in the book.
+  Quantity GetQuantity(OrderId orderId) const {
+    const auto it = orders_.find(orderId);
+    return it == orders_.end() ? 0 : it->second.location_->quantity_;
+  }
+
+  const std::optional<Price> &GetLastExecutionPrice() const {
+    return lastExecutionPrice_;
+  }
+  std::uint64_t GetExecutedVolume() const { return executedVolume_; }
+
+  // Computed on demand; the builder keeps nothing it does not need to apply
+  // the next event.
+  TopOfBook GetTopOfBook() const { return levels_.GetTopOfBook(); }
+
+  template <std::size_t Depth> DepthSnapshot<Depth> GetDepth() const {
+    return levels_.GetDepth<Depth>();
+  }
+
+  // Calls visit(price, quantity) for every level of side, best first.
+  template <typename Visit> void ForEachLevel(Side side, Visit &&visit) const {
+    levels_.ForEachLevel(side, std::forward<Visit>(visit));
+  }
+
+  OrderBookLevelInfos GetLevelInfos() const { return levels_.GetLevelInfos(); }
+};
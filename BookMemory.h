@@ -0,0 +1,228 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "Orderbook.h"
+
+// Pooled storage for Order objects (and their shared_ptr control blocks).
+// The pool must outlive every OrderPointer it hands out.
+class OrderPool {
+public:
+  explicit OrderPool(
+      std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+      : pool_{upstream} {}
+
+  OrderPool(const OrderPool &) = delete;
+  OrderPool &operator=(const OrderPool &) = delete;
+
+  // Takes the same arguments as Order's constructor.
+  template <typename... Args> OrderPointer Acquire(Args &&...args) {
+    return std::allocate_shared<Order>(
+        std::pmr::polymorphic_allocator<Order>{&pool_},
+        std::forward<Args>(args)...);
+  }
+
+  // Allocates and touches count orders, then hands them back to the pool.
+  void Reserve(std::size_t count) {
+    std::vector<OrderPointer> orders;
+    orders.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+      orders.push_back(Acquire(OrderType::GoodTillCancel, i, Side::Buy, 0, 0));
+  }
+
+private:
+  std::pmr::unsynchronized_pool_resource pool_;
+};
+
+enum class HugePageSize { TwoMegabytes, OneGigabyte };
+
+// Bump allocator over a single mapping backed by huge pages where the system
+// allows it, meant as the upstream of OrderBook and OrderPool so that order
+// objects, index buckets and level nodes share a handful of TLB entries.
+//
+// The mapping is tried as explicit hugetlbfs pages (MAP_HUGETLB) first, then
+// as a normal mapping with madvise(MADV_HUGEPAGE) for transparent huge pages,
+// and finally left as plain 4K pages. Blocks are carved off the front of the
+// mapping, their sizes rounded up by at most an eighth. A freed block goes
+// onto the free list of its size class (sizes in [2^i, 2^(i+1))) and is
+// handed out again to a request it is large enough for. The pools layered on
+// top hand most memory back only on release, but anything above their
+// largest pool block (index bucket arrays on every rehash, reserved vectors)
+// comes and goes straight through the arena. Requests beyond the arena's
+// capacity are forwarded to the overflow resource.
+class HugePageArena : public std::pmr::memory_resource {
+public:
+  enum class Backing { HugeTlb, TransparentHugePages, NormalPages };
+
+  HugePageArena(std::size_t capacity,
+                HugePageSize pageSize = HugePageSize::TwoMegabytes,
+                std::pmr::memory_resource *overflow =
+                    std::pmr::get_default_resource())
+      : overflow_{overflow} {
+    const std::size_t hugePage = pageSize == HugePageSize::OneGigabyte
+                                     ? std::size_t{1} << 30
+                                     : std::size_t{2} << 20;
+    capacity_ = (capacity + hugePage - 1) / hugePage * hugePage;
+
+    const int hugeFlags =
+        MAP_HUGETLB |
+        (pageSize == HugePageSize::OneGigabyte ? (30 << MAP_HUGE_SHIFT)
+                                               : (21 << MAP_HUGE_SHIFT));
+    base_ = Map(capacity_, hugeFlags);
+    if (base_) {
+      backing_ = Backing::HugeTlb;
+      return;
+    }
+
+    // Over-map so the usable range can start on a huge page boundary, which
+    // khugepaged needs in order to back it with huge pages.
+    auto *raw = static_cast<std::byte *>(Map(capacity_ + hugePage, 0));
+    if (!raw)
+      throw std::bad_alloc{};
+    const auto address = reinterpret_cast<std::uintptr_t>(raw);
+    const auto aligned = (address + hugePage - 1) / hugePage * hugePage;
+    mapping_ = raw;
+    mappingSize_ = capacity_ + hugePage;
+    base_ = reinterpret_cast<std::byte *>(aligned);
+    backing_ = madvise(base_, capacity_, MADV_HUGEPAGE) == 0
+                   ? Backing::TransparentHugePages
+                   : Backing::NormalPages;
+  }
+
+  HugePageArena(const HugePageArena &) = delete;
+  HugePageArena &operator=(const HugePageArena &) = delete;
+
+  ~HugePageArena() override {
+    if (mapping_)
+      munmap(mapping_, mappingSize_);
+    else if (base_)
+      munmap(base_, capacity_);
+  }
+
+  Backing GetBacking() const { return backing_; }
+  std::size_t GetCapacity() const { return capacity_; }
+  std::size_t GetUsed() const { return used_; }
+
+  // Touches every page of the arena so no page fault is left for the hot path.
+  void Prefault() {
+    const std::size_t step = 4096;
+    for (std::size_t offset = 0; offset < capacity_; offset += step)
+      static_cast<volatile std::byte *>(base_)[offset] = std::byte{0};
+  }
+
+private:
+  std::byte *base_{nullptr};
+  std::byte *mapping_{nullptr};
+  std::size_t mappingSize_{0};
+  std::size_t capacity_{0};
+  std::size_t used_{0};
+  Backing backing_{Backing::NormalPages};
+  std::pmr::memory_resource *overflow_;
+  // Written into a block once it is freed.
+  struct FreeBlock {
+    FreeBlock *next_;
+    std::size_t size_;
+  };
+  // Heads of the free lists; list i holds blocks of 2^i to 2^(i+1)-1 bytes.
+  std::array<FreeBlock *, 65> free_{};
+
+  // Rounded up to an eighth of the size's power of two, so requests that
+  // grow a little each time still fit a block freed by the one before.
+  static std::size_t BlockSize(std::size_t bytes) {
+    const std::size_t size = std::max(bytes, sizeof(FreeBlock));
+    const std::size_t step =
+        std::max(std::bit_floor(size) >> 3, alignof(FreeBlock));
+    return (size + step - 1) & ~(step - 1);
+  }
+
+  // Takes the first block on list sizeClass that is at least size bytes and
+  // aligned to alignment. Only blocks that came back through deallocate are
+  // on the lists, so they stay short.
+  void *Reuse(std::size_t sizeClass, std::size_t size, std::size_t alignment) {
+    for (FreeBlock **link = &free_[sizeClass]; *link; link = &(*link)->next_) {
+      FreeBlock *block = *link;
+      if (block->size_ >= size &&
+          reinterpret_cast<std::uintptr_t>(block) % alignment == 0) {
+        *link = block->next_;
+        return block;
+      }
+    }
+    return nullptr;
+  }
+
+  static std::byte *Map(std::size_t size, int extraFlags) {
+    void *address = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | extraFlags, -1, 0);
+    return address == MAP_FAILED ? nullptr : static_cast<std::byte *>(address);
+  }
+
+  bool Owns(void *p) const {
+    auto *byte = static_cast<std::byte *>(p);
+    return byte >= base_ && byte < base_ + capacity_;
+  }
+
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+    // The request's own class first, where the same size comes back after a
+    // free, then the next one up, whose blocks are all large enough.
+    const std::size_t size = BlockSize(bytes);
+    const std::size_t sizeClass = std::bit_width(size) - 1;
+    if (void *block = Reuse(sizeClass, size, alignment))
+      return block;
+    if (void *block = Reuse(sizeClass + 1, size, alignment))
+      return block;
+    // Every block has to be able to hold a FreeBlock later.
+    alignment = std::max(alignment, alignof(FreeBlock));
+    const std::size_t offset = (used_ + alignment - 1) & ~(alignment - 1);
+    if (offset + size > capacity_)
+      return overflow_->allocate(bytes, alignment);
+    used_ = offset + size;
+    return base_ + offset;
+  }
+
+  void do_deallocate(void *p, std::size_t bytes,
+                     std::size_t alignment) override {
+    if (!Owns(p)) {
+      overflow_->deallocate(p, bytes, alignment);
+      return;
+    }
+    // A reused block may be larger than bytes; the excess is not recovered.
+    const std::size_t size = BlockSize(bytes);
+    auto *block = static_cast<FreeBlock *>(p);
+    const std::size_t sizeClass = std::bit_width(size) - 1;
+    *block = FreeBlock{free_[sizeClass], size};
+    free_[sizeClass] = block;
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override {
+    return this == &other;
+  }
+};
+
+// Pins everything mapped so far, and everything mapped later, into RAM so the
+// warmed pools cannot be paged out. Needs CAP_IPC_LOCK or a large enough
+// RLIMIT_MEMLOCK; returns false if the kernel refused.
+inline bool LockProcessMemory() {
+  return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+}
+
+// Pre-sizes and pre-faults everything the first maxOrders orders will touch:
+// the order objects, the book's order index and its level storage. Returns
+// false if lockMemory was asked for and LockProcessMemory() failed; the
+// book is warmed either way.
+inline bool WarmUp(OrderBook &orderBook, OrderPool &orderPool,
+                   std::size_t maxOrders, std::size_t maxLevels,
+                   bool lockMemory = false) {
+  orderPool.Reserve(maxOrders);
+  orderBook.Reserve(maxOrders, maxLevels);
+  return !lockMemory || LockProcessMemory();
+}
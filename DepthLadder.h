@@ -0,0 +1,394 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__x86_64__)
+// GCC 12's AVX-512 intrinsics start from _mm512_undefined_*(), which
+// initializes a vector from itself; -Wall flags every inlined use of it.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#endif
+
+#include "Orderbook.h"
+
+// Scans over a run of level quantities, best level first: running totals,
+// the first level at which the running total reaches a quantity, and the
+// total. Each kernel exists as plain C++ and, on x86, as AVX2 and AVX-512
+// versions compiled with target attributes, so the header needs no -march
+// flag; GetKernels() picks the widest one the CPU supports, once. The
+// vector versions widen four (AVX2) or eight (AVX-512) quantities to 64 bits
+// per step and form their running totals in-register with lane shifts.
+namespace depth_scan {
+
+enum class Isa : std::uint8_t { Scalar, Avx2, Avx512 };
+
+struct Kernels {
+  // sums[i] = quantities[0] + ... + quantities[i].
+  void (*prefixSum_)(const Quantity *quantities, std::uint64_t *sums,
+                     std::size_t count);
+  // The first i at which the running total is at least target, count if it
+  // never is.
+  std::size_t (*findCumulative_)(const Quantity *quantities, std::size_t count,
+                                 std::uint64_t target);
+  std::uint64_t (*sum_)(const Quantity *quantities, std::size_t count);
+};
+
+inline void PrefixSumScalar(const Quantity *quantities, std::uint64_t *sums,
+                            std::size_t count) {
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < count; ++i)
+    sums[i] = total += quantities[i];
+}
+
+inline std::size_t FindCumulativeScalar(const Quantity *quantities,
+                                        std::size_t count,
+                                        std::uint64_t target) {
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < count; ++i)
+    if ((total += quantities[i]) >= target)
+      return i;
+  return count;
+}
+
+inline std::uint64_t SumScalar(const Quantity *quantities, std::size_t count) {
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < count; ++i)
+    total += quantities[i];
+  return total;
+}
+
+#if defined(__x86_64__)
+
+// Running totals of four quantities, plus carry, the total before them.
+__attribute__((target("avx2"))) inline __m256i
+ScanAvx2(const Quantity *quantities, __m256i carry) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i x = _mm256_cvtepu32_epi64(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(quantities)));
+  // Shift up one lane, then two, adding each time.
+  x = _mm256_add_epi64(
+      x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, 0x90), zero, 0x03));
+  x = _mm256_add_epi64(
+      x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, 0x40), zero, 0x0F));
+  return _mm256_add_epi64(x, carry);
+}
+
+__attribute__((target("avx2"))) inline void
+PrefixSumAvx2(const Quantity *quantities, std::uint64_t *sums,
+              std::size_t count) {
+  __m256i carry = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m256i x = ScanAvx2(quantities + i, carry);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(sums + i), x);
+    carry = _mm256_permute4x64_epi64(x, 0xFF);
+  }
+  std::uint64_t total = i ? sums[i - 1] : 0;
+  for (; i < count; ++i)
+    sums[i] = total += quantities[i];
+}
+
+__attribute__((target("avx2"))) inline std::size_t
+FindCumulativeAvx2(const Quantity *quantities, std::size_t count,
+                   std::uint64_t target) {
+  if (target == 0)
+    return 0;
+  // AVX2 only compares signed; totals of 32-bit quantities stay far below
+  // 2^63, so a larger target is simply never reached.
+  const auto limit = static_cast<std::int64_t>(std::min<std::uint64_t>(
+      target - 1, std::numeric_limits<std::int64_t>::max()));
+  const __m256i below = _mm256_set1_epi64x(limit);
+  __m256i carry = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m256i x = ScanAvx2(quantities + i, carry);
+    const int reached =
+        _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(x, below)));
+    if (reached)
+      return i + __builtin_ctz(static_cast<unsigned>(reached));
+    carry = _mm256_permute4x64_epi64(x, 0xFF);
+  }
+  std::uint64_t total =
+      static_cast<std::uint64_t>(_mm256_extract_epi64(carry, 0));
+  for (; i < count; ++i)
+    if ((total += quantities[i]) >= target)
+      return i;
+  return count;
+}
+
+__attribute__((target("avx2"))) inline std::uint64_t
+SumAvx2(const Quantity *quantities, std::size_t count) {
+  __m256i total = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    total = _mm256_add_epi64(
+        total, _mm256_cvtepu32_epi64(_mm_loadu_si128(
+                   reinterpret_cast<const __m128i *>(quantities + i))));
+    total = _mm256_add_epi64(
+        total, _mm256_cvtepu32_epi64(_mm_loadu_si128(
+                   reinterpret_cast<const __m128i *>(quantities + i + 4))));
+  }
+  const __m128i half = _mm_add_epi64(_mm256_castsi256_si128(total),
+                                     _mm256_extracti128_si256(total, 1));
+  std::uint64_t sum = static_cast<std::uint64_t>(_mm_cvtsi128_si64(half)) +
+                      static_cast<std::uint64_t>(_mm_extract_epi64(half, 1));
+  for (; i < count; ++i)
+    sum += quantities[i];
+  return sum;
+}
+
+// Eight lanes; valignq against zero shifts the lanes up by 1, 2 and 4.
+__attribute__((target("avx512f"))) inline __m512i
+ScanAvx512(const Quantity *quantities, __m512i carry) {
+  const __m512i zero = _mm512_setzero_si512();
+  __m512i x = _mm512_cvtepu32_epi64(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(quantities)));
+  x = _mm512_add_epi64(x, _mm512_alignr_epi64(x, zero, 7));
+  x = _mm512_add_epi64(x, _mm512_alignr_epi64(x, zero, 6));
+  x = _mm512_add_epi64(x, _mm512_alignr_epi64(x, zero, 4));
+  return _mm512_add_epi64(x, carry);
+}
+
+__attribute__((target("avx512f"))) inline void
+PrefixSumAvx512(const Quantity *quantities, std::uint64_t *sums,
+                std::size_t count) {
+  const __m512i last = _mm512_set1_epi64(7);
+  __m512i carry = _mm512_setzero_si512();
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m512i x = ScanAvx512(quantities + i, carry);
+    _mm512_storeu_si512(sums + i, x);
+    carry = _mm512_permutexvar_epi64(last, x);
+  }
+  std::uint64_t total = i ? sums[i - 1] : 0;
+  for (; i < count; ++i)
+    sums[i] = total += quantities[i];
+}
+
+__attribute__((target("avx512f"))) inline std::size_t
+FindCumulativeAvx512(const Quantity *quantities, std::size_t count,
+                     std::uint64_t target) {
+  const __m512i last = _mm512_set1_epi64(7);
+  const __m512i goal = _mm512_set1_epi64(static_cast<long long>(target));
+  __m512i carry = _mm512_setzero_si512();
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m512i x = ScanAvx512(quantities + i, carry);
+    const __mmask8 reached = _mm512_cmpge_epu64_mask(x, goal);
+    if (reached)
+      return i + __builtin_ctz(reached);
+    carry = _mm512_permutexvar_epi64(last, x);
+  }
+  std::uint64_t total = static_cast<std::uint64_t>(
+      _mm_cvtsi128_si64(_mm512_castsi512_si128(carry)));
+  for (; i < count; ++i)
+    if ((total += quantities[i]) >= target)
+      return i;
+  return count;
+}
+
+__attribute__((target("avx512f"))) inline std::uint64_t
+SumAvx512(const Quantity *quantities, std::size_t count) {
+  __m512i total = _mm512_setzero_si512();
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+    total = _mm512_add_epi64(
+        total, _mm512_cvtepu32_epi64(_mm256_loadu_si256(
+                   reinterpret_cast<const __m256i *>(quantities + i))));
+  auto sum = static_cast<std::uint64_t>(_mm512_reduce_add_epi64(total));
+  for (; i < count; ++i)
+    sum += quantities[i];
+  return sum;
+}
+
+#endif
+
+inline bool IsSupported(Isa isa) {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  switch (isa) {
+  case Isa::Avx512:
+    return __builtin_cpu_supports("avx512f");
+  case Isa::Avx2:
+    return __builtin_cpu_supports("avx2");
+  case Isa::Scalar:
+    return true;
+  }
+  return false;
+#else
+  return isa == Isa::Scalar;
+#endif
+}
+
+inline Isa GetBestIsa() {
+  if (IsSupported(Isa::Avx512))
+    return Isa::Avx512;
+  if (IsSupported(Isa::Avx2))
+    return Isa::Avx2;
+  return Isa::Scalar;
+}
+
+// The kernels for isa, which the caller must have checked IsSupported().
+inline const Kernels &GetKernels(Isa isa) {
+  static constexpr Kernels Scalar{PrefixSumScalar, FindCumulativeScalar,
+                                  SumScalar};
+#if defined(__x86_64__)
+  static constexpr Kernels Avx2{PrefixSumAvx2, FindCumulativeAvx2, SumAvx2};
+  static constexpr Kernels Avx512{PrefixSumAvx512, FindCumulativeAvx512,
+                                  SumAvx512};
+  switch (isa) {
+  case Isa::Avx512:
+    return Avx512;
+  case Isa::Avx2:
+    return Avx2;
+  case Isa::Scalar:
+    break;
+  }
+#endif
+  return Scalar;
+}
+
+inline const Kernels &GetKernels() {
+  static const Kernels &kernels = GetKernels(GetBestIsa());
+  return kernels;
+}
+
+} // namespace depth_scan
+
+// What sweeping a ladder for a quantity would fill and at what prices.
+struct SweepEstimate {
+  std::uint64_t filled_{0};
+  // Price times quantity over the fills, in price units.
+  std::int64_t notional_{0};
+  // The worst price reached, and how many levels were touched.
+  Price lastPrice_{0};
+  std::size_t levels_{0};
+
+  double GetAveragePrice() const {
+    return filled_ ? static_cast<double>(notional_) / filled_ : 0.0;
+  }
+};
+
+// One side of a book copied into contiguous price and quantity arrays, best
+// level first, for queries that would otherwise walk the level map: can an
+// order be filled completely within its limit (a fill-or-kill pre-check),
+// what a market order of a given size would pay, and how much rests within
+// a price. The ladder is a snapshot; Assign() it again after the book
+// changes. Quantities are the displayed ones, so hidden iceberg reserves
+// are not counted.
+class DepthLadder {
+public:
+  explicit DepthLadder(const depth_scan::Kernels &kernels =
+                           depth_scan::GetKernels())
+      : kernels_{&kernels} {}
+
+  // Side side of book, an OrderBook or a BookBuilder.
+  template <typename Book> void Assign(const Book &book, Side side) {
+    Clear(side);
+    book.ForEachLevel(side, [this](Price price, Quantity quantity) {
+      prices_.push_back(price);
+      quantities_.push_back(quantity);
+    });
+  }
+
+  void Assign(Side side, const LevelInfos &levels) {
+    Clear(side);
+    for (const auto &[price, quantity] : levels) {
+      prices_.push_back(price);
+      quantities_.push_back(quantity);
+    }
+  }
+
+  // The resting side; orders of the other side trade against it.
+  Side GetSide() const { return side_; }
+  std::size_t Size() const { return prices_.size(); }
+  bool Empty() const { return prices_.empty(); }
+  const std::vector<Price> &GetPrices() const { return prices_; }
+  const std::vector<Quantity> &GetQuantities() const { return quantities_; }
+
+  std::uint64_t GetTotalQuantity() const {
+    return kernels_->sum_(quantities_.data(), quantities_.size());
+  }
+
+  // Quantity resting at or better than each level, for depth charts.
+  std::vector<std::uint64_t> GetCumulativeQuantities() const {
+    std::vector<std::uint64_t> sums(quantities_.size());
+    kernels_->prefixSum_(quantities_.data(), sums.data(), sums.size());
+    return sums;
+  }
+
+  // Index of the level at which the quantity resting from the best level on
+  // reaches quantity; Size() if the whole ladder holds less.
+  std::size_t FindLevel(std::uint64_t quantity) const {
+    return kernels_->findCumulative_(quantities_.data(), quantities_.size(),
+                                     quantity);
+  }
+
+  // Number of levels an opposite order limited to limit could trade with.
+  std::size_t CountLevelsWithin(Price limit) const {
+    const auto end = std::partition_point(
+        prices_.begin(), prices_.end(), [&](Price price) {
+          return side_ == Side::Buy ? price >= limit : price <= limit;
+        });
+    return static_cast<std::size_t>(end - prices_.begin());
+  }
+
+  std::uint64_t GetQuantityWithin(Price limit) const {
+    return kernels_->sum_(quantities_.data(), CountLevelsWithin(limit));
+  }
+
+  // True if an opposite order for quantity, limited to limit, would be
+  // filled completely by the displayed depth.
+  bool CanFill(Price limit, std::uint64_t quantity) const {
+    const std::size_t levels = CountLevelsWithin(limit);
+    return kernels_->findCumulative_(quantities_.data(), levels, quantity) <
+           levels;
+  }
+
+  // A market order for quantity; fills less if the ladder holds less.
+  SweepEstimate Sweep(std::uint64_t quantity) const {
+    SweepEstimate estimate;
+    if (Empty() || quantity == 0)
+      return estimate;
+    const std::size_t last = std::min(FindLevel(quantity), Size() - 1);
+    for (std::size_t i = 0; i <= last; ++i) {
+      const std::uint64_t fill =
+          std::min<std::uint64_t>(quantities_[i], quantity - estimate.filled_);
+      estimate.filled_ += fill;
+      estimate.notional_ += prices_[i] * static_cast<std::int64_t>(fill);
+      estimate.lastPrice_ = prices_[i];
+      ++estimate.levels_;
+    }
+    return estimate;
+  }
+
+  // How much worse than the best price a market order for quantity would
+  // pay on average, in price units; 0 on an empty ladder.
+  double GetSlippage(std::uint64_t quantity) const {
+    const auto estimate = Sweep(quantity);
+    if (estimate.filled_ == 0)
+      return 0.0;
+    const double difference =
+        estimate.GetAveragePrice() - static_cast<double>(prices_.front());
+    return side_ == Side::Buy ? -difference : difference;
+  }
+
+private:
+  const depth_scan::Kernels *kernels_;
+  Side side_{Side::Buy};
+  std::vector<Price> prices_;
+  std::vector<Quantity> quantities_;
+
+  void Clear(Side side) {
+    side_ = side;
+    prices_.clear();
+    quantities_.clear();
+  }
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <variant>
+
+#include "Orderbook.h"
+
+// A change to one published price level. Quantity 0 means the level is gone
+// from the published depth, either emptied or pushed out by better levels.
+struct LevelUpdate {
+  Side side_;
+  Price price_;
+  Quantity quantity_;
+};
+
+// Everything the engine publishes about a book, as plain data that can be
+// copied into shared memory or onto the wire as is.
+using MarketDataMessage = std::variant<TopOfBook, LevelUpdate, Trade>;
+static_assert(std::is_trivially_copyable_v<MarketDataMessage>);
+
+// Turns the book's state after each command into market data: the trades it
+// produced, the changes to the best Depth levels on either side and, when it
+// moved, the new top of book. Deltas are found by diffing consecutive depth
+// images, so the book itself needs no hooks and the cost is bounded by Depth.
+template <std::size_t Depth> class MarketDataBuilder {
+public:
+  // Calls sink(const MarketDataMessage &) for every message, trades first.
+  template <typename Sink>
+  void Publish(const OrderBook &orderBook, const Trades &trades, Sink &&sink) {
+    for (const auto &trade : trades)
+      sink(MarketDataMessage{trade});
+
+    const auto depth = orderBook.GetDepth<Depth>();
+    Diff<Side::Buy>(depth_.bids_, depth_.bidCount_, depth.bids_,
+                    depth.bidCount_, sink);
+    Diff<Side::Sell>(depth_.asks_, depth_.askCount_, depth.asks_,
+                     depth.askCount_, sink);
+    depth_ = depth;
+
+    const auto &topOfBook = orderBook.GetTopOfBook();
+    if (topOfBook != topOfBook_) {
+      topOfBook_ = topOfBook;
+      sink(MarketDataMessage{topOfBook});
+    }
+  }
+
+private:
+  DepthSnapshot<Depth> depth_;
+  TopOfBook topOfBook_;
+
+  // Both images are sorted best first, so one merge pass finds every level
+  // that appeared, changed or disappeared.
+  template <Side S, typename Sink>
+  static void Diff(const std::array<LevelInfo, Depth> &before,
+                   std::uint32_t beforeCount,
+                   const std::array<LevelInfo, Depth> &after,
+                   std::uint32_t afterCount, Sink &sink) {
+    typename SideTraits<S>::Compare better;
+    std::uint32_t i = 0, j = 0;
+    while (i < beforeCount || j < afterCount) {
+      if (j == afterCount ||
+          (i < beforeCount && better(before[i].price_, after[j].price_))) {
+        sink(MarketDataMessage{LevelUpdate{S, before[i].price_, 0}});
+        ++i;
+      } else if (i == beforeCount ||
+                 better(after[j].price_, before[i].price_)) {
+        sink(MarketDataMessage{
+            LevelUpdate{S, after[j].price_, after[j].quantity_}});
+        ++j;
+      } else {
+        if (before[i].quantity_ != after[j].quantity_)
+          sink(MarketDataMessage{
+              LevelUpdate{S, after[j].price_, after[j].quantity_}});
+        ++i;
+        ++j;
+      }
+    }
+  }
+};
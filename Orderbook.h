@@ -0,0 +1,1261 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Seqlock.h"
+#include "TimerWheel.h"
+
+// A Market order is priced at entry at the worst opposite level, so it sweeps
+// whatever is there; like a FillOrkill it never rests. GoodTillDate orders
+// rest until their expiry, Day orders until the book's session end.
+enum class OrderType { GoodTillCancel, FillOrkill, Market, GoodTillDate, Day };
+
+enum class Side { Buy, Sell };
+
+// Post-only orders must add liquidity. If one would cross on entry, Reject
+// drops it and Slide reprices it to one tick behind the best opposite price.
+// Market and FillOrkill orders cannot be post-only; the book refuses them.
+enum class PostOnly { None, Reject, Slide };
+
+// What happens when an aggressor would trade against a resting order of the
+// same participant. Decrement shrinks both orders by the overlapping quantity
+// without a trade, removing whichever drops to zero.
+enum class SelfTradePrevention {
+  None,
+  CancelNewest,
+  CancelOldest,
+  CancelBoth,
+  Decrement
+};
+
+// Fixed-point price: an integer count of 10^-scale currency units, where the
+// scale belongs to the instrument (see Instrument below).
+using Price = std::int64_t;
+using Quantity = std::uint32_t;
+using OrderId = std::uint64_t;
+using ParticipantId = std::uint64_t;
+using OrderIds = std::vector<OrderId>;
+// Engine time in nanoseconds. The book never reads a clock; time only moves
+// through OrderBook::AdvanceTime.
+using Timestamp = std::uint64_t;
+
+// Per-instrument price scaling. With scale 4 and tick size 50, a Price of
+// 1234550 is 123.4550 and valid prices step by 0.0050.
+class Instrument {
+public:
+  explicit Instrument(std::uint8_t scale = 0, Price tickSize = 1)
+      : scale_{scale}, tickSize_{tickSize} {
+    if (scale > MaxScale) {
+      throw std::invalid_argument(
+          std::format("Instrument scale ({}) exceeds {}",
+                      static_cast<int>(scale), static_cast<int>(MaxScale)));
+    }
+    if (tickSize <= 0) {
+      throw std::invalid_argument(
+          std::format("Instrument tick size ({}) must be positive", tickSize));
+    }
+    tickMultiplier_ = ~__uint128_t{0} / static_cast<std::uint64_t>(tickSize) + 1;
+  }
+
+  std::uint8_t GetScale() const { return scale_; }
+  Price GetTickSize() const { return tickSize_; }
+
+  // Divisibility by the tick size without a division: n is a multiple of d
+  // iff n * c <= c - 1 modulo 2^128 with c = floor((2^128 - 1) / d) + 1
+  // (Lemire, Kaser & Kurz, "Faster Remainder by Direct Computation"). For
+  // d == 1, c wraps to 0 and every price passes.
+  bool IsTickAligned(Price price) const {
+    // Negated as unsigned: -price overflows for the most negative Price.
+    const std::uint64_t magnitude =
+        price < 0 ? 0 - static_cast<std::uint64_t>(price)
+                  : static_cast<std::uint64_t>(price);
+    return magnitude * tickMultiplier_ <= tickMultiplier_ - 1;
+  }
+
+  // Ladder index of a tick-aligned price and back.
+  std::int64_t ToTicks(Price price) const { return price / tickSize_; }
+  Price FromTicks(std::int64_t ticks) const { return ticks * tickSize_; }
+
+  // Conversions for feeds that carry prices with their own fixed number of
+  // decimals (e.g. 4 for ITCH). Converting to a coarser scale truncates.
+  Price FromScaled(std::int64_t value, std::uint8_t scale) const {
+    if (scale <= scale_)
+      return value * PowersOfTen[scale_ - scale];
+    return value / PowersOfTen[scale - scale_];
+  }
+  std::int64_t ToScaled(Price price, std::uint8_t scale) const {
+    if (scale >= scale_)
+      return price * PowersOfTen[scale - scale_];
+    return price / PowersOfTen[scale_ - scale];
+  }
+
+  Price FromDouble(double value) const {
+    return static_cast<Price>(std::llround(value * PowersOfTen[scale_]));
+  }
+  double ToDouble(Price price) const {
+    return static_cast<double>(price) / PowersOfTen[scale_];
+  }
+
+private:
+  static constexpr std::uint8_t MaxScale = 18;
+  static constexpr std::array<std::int64_t, MaxScale + 1> PowersOfTen = [] {
+    std::array<std::int64_t, MaxScale + 1> powers{1};
+    for (std::size_t i = 1; i < powers.size(); ++i)
+      powers[i] = powers[i - 1] * 10;
+    return powers;
+  }();
+
+  std::uint8_t scale_;
+  Price tickSize_;
+  __uint128_t tickMultiplier_;
+};
+
+struct LevelInfo {
+  Price price_;
+  Quantity quantity_;
+
+  bool operator==(const LevelInfo &) const = default;
+};
+
+using LevelInfos = std::vector<LevelInfo>;
+
+class OrderBookLevelInfos {
+public:
+  OrderBookLevelInfos(const LevelInfos &bids, const LevelInfos &asks)
+      : bids_{bids}, asks_{asks} {}
+
+  const LevelInfos &GetBids() const { return bids_; }
+  const LevelInfos &GetAsks() const { return asks_; }
+
+private:
+  LevelInfos bids_;
+  LevelInfos asks_;
+};
+
+// Best bid and ask with the displayed quantity resting at each. A side with
+// nothing resting has quantity 0 and an unspecified price.
+struct TopOfBook {
+  Price bidPrice_{0};
+  Quantity bidQuantity_{0};
+  Price askPrice_{0};
+  Quantity askQuantity_{0};
+
+  bool operator==(const TopOfBook &) const = default;
+};
+
+// The best Depth levels of each side, best first; entries past the counts
+// are zero. Plain data, so it can be published through a Seqlock.
+template <std::size_t Depth> struct DepthSnapshot {
+  std::uint32_t bidCount_{0};
+  std::uint32_t askCount_{0};
+  std::array<LevelInfo, Depth> bids_{};
+  std::array<LevelInfo, Depth> asks_{};
+
+  bool operator==(const DepthSnapshot &) const = default;
+};
+
+// Shared depth image for reader threads. The thread driving a book publishes
+// it after each batch of commands, and only when it changed; any number of
+// threads Load() consistent copies without locking or ever delaying the
+// writer.
+template <std::size_t Depth> class DepthFeed {
+public:
+  // Writer side, one thread only. Each returns whether the depth changed,
+  // i.e. whether readers will see a new version.
+  template <typename Book> bool Publish(const Book &book) {
+    return Publish(book.template GetDepth<Depth>());
+  }
+
+  bool Publish(const DepthSnapshot<Depth> &depth) {
+    if (depth == last_)
+      return false;
+    last_ = depth;
+    feed_.Store(depth);
+    return true;
+  }
+
+  // Reader side, any thread.
+  DepthSnapshot<Depth> Load() const { return feed_.Load(); }
+  bool TryLoad(DepthSnapshot<Depth> &depth) const {
+    return feed_.TryLoad(depth);
+  }
+  std::uint64_t GetVersion() const { return feed_.GetVersion(); }
+
+private:
+  Seqlock<DepthSnapshot<Depth>> feed_;
+  // The writer's copy of what it last stored, so unchanged depth costs
+  // readers nothing.
+  DepthSnapshot<Depth> last_;
+};
+
+// Hook for the intrusive per-participant order lists kept by OrderBook. A
+// default-constructed link points at itself, which makes it both an unlinked
+// order and an empty list head.
+class OrderLink {
+public:
+  OrderLink() = default;
+  OrderLink(const OrderLink &) = delete;
+  OrderLink &operator=(const OrderLink &) = delete;
+
+  OrderLink *GetNext() const { return next_; }
+
+  void PushBack(OrderLink &link) {
+    link.previous_ = previous_;
+    link.next_ = this;
+    previous_->next_ = &link;
+    previous_ = &link;
+  }
+
+  void Unlink() {
+    previous_->next_ = next_;
+    next_->previous_ = previous_;
+    previous_ = next_ = this;
+  }
+
+private:
+  OrderLink *previous_{this};
+  OrderLink *next_{this};
+};
+
+class Order : public OrderLink {
+public:
+  Order(OrderType orderType, OrderId orderId, Side side, Price price,
+        Quantity quantity, ParticipantId participantId = 0,
+        SelfTradePrevention selfTradePrevention = SelfTradePrevention::None)
+      : orderId_{orderId}, orderType_{orderType}, price_{price}, side_{side},
+        initialQuantity_{quantity}, remainingQuantity_{quantity},
+        participantId_{participantId},
+        selfTradePrevention_{selfTradePrevention} {}
+
+  OrderId GetOrderId() const { return orderId_; }
+  Side GetSide() const { return side_; }
+  Price GetPrice() const { return price_; }
+  OrderType GetOrderType() const { return orderType_; }
+  Quantity GetInitialQuantity() const { return initialQuantity_; }
+  // For an iceberg this is only the displayed slice; the reserve behind it is
+  // GetHiddenQuantity().
+  Quantity GetRemainingQuantity() const { return remainingQuantity_; }
+  Quantity GetHiddenQuantity() const { return hiddenQuantity_; }
+  Quantity GetOpenQuantity() const {
+    return GetRemainingQuantity() + GetHiddenQuantity();
+  }
+  Quantity GetPeakQuantity() const { return peakQuantity_; }
+  bool IsIceberg() const { return peakQuantity_ != 0; }
+  bool isFilled() const { return GetOpenQuantity() == 0; }
+  Quantity GetFilledQuantitiy() const {
+    return GetInitialQuantity() - GetOpenQuantity();
+  }
+  ParticipantId GetParticipantId() const { return participantId_; }
+  SelfTradePrevention GetSelfTradePrevention() const {
+    return selfTradePrevention_;
+  }
+
+  void Fill(Quantity quantity) {
+    if (quantity > GetRemainingQuantity()) {
+      throw std::logic_error(std::format(
+          "Order ({}) cannot be filled for more than its remaining quantity",
+          GetOrderId()));
+    }
+    remainingQuantity_ -= quantity;
+  }
+
+  // Shrinks the order without a trade, as if it had been entered smaller. The
+  // displayed quantity goes first, then the hidden reserve.
+  void Reduce(Quantity quantity) {
+    if (quantity > GetOpenQuantity()) {
+      throw std::logic_error(std::format(
+          "Order ({}) cannot be reduced by more than its remaining quantity",
+          GetOrderId()));
+    }
+    const Quantity displayed = std::min(quantity, GetRemainingQuantity());
+    initialQuantity_ -= quantity;
+    remainingQuantity_ -= displayed;
+    hiddenQuantity_ -= quantity - displayed;
+  }
+
+  // Turns the order into an iceberg that displays at most peakQuantity at a
+  // time. Only valid before the order has been added to a book.
+  void SetPeakQuantity(Quantity peakQuantity) {
+    if (peakQuantity == 0 || GetFilledQuantitiy() != 0) {
+      throw std::logic_error(std::format(
+          "Order ({}) cannot be made an iceberg with peak {}", GetOrderId(),
+          peakQuantity));
+    }
+    const Quantity total = GetOpenQuantity();
+    peakQuantity_ = peakQuantity;
+    remainingQuantity_ = std::min(peakQuantity, total);
+    hiddenQuantity_ = total - remainingQuantity_;
+  }
+
+  Price GetStopPrice() const { return stopPrice_; }
+  bool IsStopPending() const { return stopPending_; }
+
+  // Parks the order until the last trade price reaches stopPrice; it then
+  // enters the book as an ordinary order, i.e. a stop-limit, or a stop if its
+  // type is Market. Only valid before the order has been added to a book.
+  void SetStopPrice(Price stopPrice) {
+    if (GetFilledQuantitiy() != 0) {
+      throw std::logic_error(std::format(
+          "Order ({}) cannot be made a stop once it has traded", GetOrderId()));
+    }
+    stopPrice_ = stopPrice;
+    stopPending_ = true;
+  }
+  void TriggerStop() { stopPending_ = false; }
+
+  void Reprice(Price price) { price_ = price; }
+
+  PostOnly GetPostOnly() const { return postOnly_; }
+  void SetPostOnly(PostOnly postOnly) { postOnly_ = postOnly; }
+
+  Timestamp GetExpiry() const { return expiry_; }
+  // Required for GoodTillDate orders; the book sets it for Day orders.
+  void SetExpiry(Timestamp expiry) { expiry_ = expiry; }
+
+  // Shows the next slice of an iceberg whose displayed quantity is used up.
+  void Replenish() {
+    const Quantity slice = std::min(peakQuantity_, hiddenQuantity_);
+    hiddenQuantity_ -= slice;
+    remainingQuantity_ += slice;
+  }
+
+private:
+  OrderId orderId_;
+  OrderType orderType_;
+  Price price_;
+  Side side_;
+  Quantity initialQuantity_;
+  Quantity remainingQuantity_;
+  ParticipantId participantId_;
+  SelfTradePrevention selfTradePrevention_;
+  Quantity peakQuantity_{0};
+  Quantity hiddenQuantity_{0};
+  Price stopPrice_{0};
+  bool stopPending_{false};
+  Timestamp expiry_{0};
+  PostOnly postOnly_{PostOnly::None};
+};
+
+using OrderPointer = std::shared_ptr<Order>;
+using OrderPointers = std::pmr::list<OrderPointer>;
+
+class OrderModify {
+public:
+  OrderModify(OrderId orderId, Side side, Price price, Quantity quantity)
+      : orderId_{orderId}, price_{price}, side_{side}, quantity_{quantity} {}
+  OrderId GetOrderId() const { return orderId_; }
+  Price GetPrice() const { return price_; }
+  Side GetSide() const { return side_; }
+  Quantity GetQuantity() const { return quantity_; }
+
+  OrderPointer ToOrderPointer(
+      OrderType type, ParticipantId participantId = 0,
+      SelfTradePrevention selfTradePrevention = SelfTradePrevention::None) const {
+    return std::make_shared<Order>(type, GetOrderId(), GetSide(), GetPrice(),
+                                   GetQuantity(), participantId,
+                                   selfTradePrevention);
+  }
+
+private:
+  OrderId orderId_;
+  Price price_;
+  Side side_;
+  Quantity quantity_;
+};
+
+struct TradeInfo {
+  OrderId orderId_;
+  Price price_;
+  Quantity quantity_;
+};
+
+// Each side's TradeInfo carries that order's own limit price. The trade
+// happened at the resting order's, i.e. the price of the side that did not
+// aggress.
+class Trade {
+public:
+  Trade(const TradeInfo &bidTrade, const TradeInfo &askTrade, Side aggressor)
+      : bidTrade_{bidTrade}, askTrade_{askTrade}, aggressor_{aggressor} {}
+
+  const TradeInfo &GetBidTrade() const { return bidTrade_; }
+  const TradeInfo &GetAskTrade() const { return askTrade_; }
+  Side GetAggressorSide() const { return aggressor_; }
+  Price GetPrice() const {
+    return aggressor_ == Side::Buy ? askTrade_.price_ : bidTrade_.price_;
+  }
+  Quantity GetQuantity() const { return bidTrade_.quantity_; }
+
+private:
+  TradeInfo bidTrade_;
+  TradeInfo askTrade_;
+  Side aggressor_;
+};
+
+using Trades = std::vector<Trade>;
+
+// Everything that differs between the bid and the ask book. The matching code
+// is written once against these traits and instantiated per side, so the
+// Side of an order is only inspected once, when it enters the book.
+template <Side S> struct SideTraits;
+
+template <> struct SideTraits<Side::Buy> {
+  using Compare = std::greater<Price>;
+  using StopCompare = std::less<Price>;
+  static constexpr Side Opposite = Side::Sell;
+
+  static bool Crosses(Price price, Price bestOpposite) {
+    return price >= bestOpposite;
+  }
+  static bool Triggers(Price stopPrice, Price lastTradePrice) {
+    return lastTradePrice >= stopPrice;
+  }
+  // The nearest price that does not cross bestOpposite.
+  static Price Behind(Price bestOpposite, Price tickSize) {
+    return bestOpposite - tickSize;
+  }
+  static Trade MakeTrade(const TradeInfo &own, const TradeInfo &opposite) {
+    return Trade{own, opposite, Side::Buy};
+  }
+};
+
+template <> struct SideTraits<Side::Sell> {
+  using Compare = std::less<Price>;
+  using StopCompare = std::greater<Price>;
+  static constexpr Side Opposite = Side::Buy;
+
+  static bool Crosses(Price price, Price bestOpposite) {
+    return price <= bestOpposite;
+  }
+  static bool Triggers(Price stopPrice, Price lastTradePrice) {
+    return lastTradePrice <= stopPrice;
+  }
+  static Price Behind(Price bestOpposite, Price tickSize) {
+    return bestOpposite + tickSize;
+  }
+  static Trade MakeTrade(const TradeInfo &own, const TradeInfo &opposite) {
+    return Trade{opposite, own, Side::Sell};
+  }
+};
+
+// The price levels of both sides of a book, best first, and everything read
+// off them alone: top of book, fixed-depth snapshots and level lists.
+// OrderBook queues Orders on its levels; BookBuilder, which only rebuilds a
+// feed, queues ids and quantities. Orders is the queue type, a std::pmr
+// container so that its nodes come from the owner's pool.
+template <typename Orders> class BookLevels {
+public:
+  // A price level's queue together with the displayed quantity resting in
+  // it, which every insert, fill, replenish and removal keeps up to date.
+  struct Level {
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+
+    explicit Level(const allocator_type &allocator) : orders_{allocator} {}
+
+    Orders orders_;
+    Quantity quantity_{0};
+  };
+
+  template <Side S>
+  using Levels = std::pmr::map<Price, Level, typename SideTraits<S>::Compare>;
+
+  explicit BookLevels(std::pmr::memory_resource *resource)
+      : bids_{resource}, asks_{resource} {}
+
+  template <Side S> Levels<S> &Get() {
+    if constexpr (S == Side::Buy)
+      return bids_;
+    else
+      return asks_;
+  }
+
+  template <Side S> const Levels<S> &Get() const {
+    if constexpr (S == Side::Buy)
+      return bids_;
+    else
+      return asks_;
+  }
+
+  // Allocates and frees the map and queue nodes of maxOrders orders over
+  // maxLevels levels, so the owner's pool holds them warm.
+  void Reserve(std::size_t maxOrders, std::size_t maxLevels) {
+    std::pmr::memory_resource *resource = bids_.get_allocator().resource();
+    Levels<Side::Buy> levels{resource};
+    for (std::size_t i = 0; i < maxLevels; ++i)
+      levels.try_emplace(static_cast<Price>(i));
+    Orders orders{resource};
+    orders.resize(maxOrders);
+  }
+
+  TopOfBook GetTopOfBook() const {
+    TopOfBook top;
+    if (!bids_.empty()) {
+      top.bidPrice_ = bids_.begin()->first;
+      top.bidQuantity_ = bids_.begin()->second.quantity_;
+    }
+    if (!asks_.empty()) {
+      top.askPrice_ = asks_.begin()->first;
+      top.askQuantity_ = asks_.begin()->second.quantity_;
+    }
+    return top;
+  }
+
+  template <std::size_t Depth> DepthSnapshot<Depth> GetDepth() const {
+    DepthSnapshot<Depth> snapshot;
+    snapshot.bidCount_ = CopyLevels(bids_, snapshot.bids_);
+    snapshot.askCount_ = CopyLevels(asks_, snapshot.asks_);
+    return snapshot;
+  }
+
+  // Calls visit(price, quantity) for every level of side, best first.
+  template <typename Visit> void ForEachLevel(Side side, Visit &&visit) const {
+    if (side == Side::Buy)
+      for (const auto &[price, level] : bids_)
+        visit(price, level.quantity_);
+    else
+      for (const auto &[price, level] : asks_)
+        visit(price, level.quantity_);
+  }
+
+  OrderBookLevelInfos GetLevelInfos() const {
+    LevelInfos bidInfos, askInfos;
+    bidInfos.reserve(bids_.size());
+    askInfos.reserve(asks_.size());
+    for (const auto &[price, level] : bids_)
+      bidInfos.push_back(LevelInfo{price, level.quantity_});
+    for (const auto &[price, level] : asks_)
+      askInfos.push_back(LevelInfo{price, level.quantity_});
+    return OrderBookLevelInfos{bidInfos, askInfos};
+  }
+
+private:
+  Levels<Side::Buy> bids_;
+  Levels<Side::Sell> asks_;
+
+  template <typename Map, std::size_t Depth>
+  static std::uint32_t CopyLevels(const Map &levels,
+                                  std::array<LevelInfo, Depth> &infos) {
+    std::uint32_t count = 0;
+    for (auto level = levels.begin(); level != levels.end() && count < Depth;
+         ++level)
+      infos[count++] = LevelInfo{level->first, level->second.quantity_};
+    return count;
+  }
+};
+
+class OrderBook {
+private:
+  struct OrderEntry {
+    OrderPointer order_{nullptr};
+    OrderPointers::iterator location_;
+  };
+
+  using Level = BookLevels<OrderPointers>::Level;
+  template <Side S> using Levels = BookLevels<OrderPointers>::Levels<S>;
+  // Pending stops per side, ordered so that the ones the next trade price
+  // reaches first are at begin(): ascending for buys, descending for sells.
+  template <Side S>
+  using Stops =
+      std::pmr::map<Price, OrderPointers, typename SideTraits<S>::StopCompare>;
+  using OrderEntries = std::pmr::unordered_map<OrderId, OrderEntry>;
+
+  Instrument instrument_;
+
+  // Map nodes, list nodes and hash nodes all come from this pool so that
+  // Reserve() can allocate them up front and cancels/fills recycle them.
+  std::pmr::unsynchronized_pool_resource pool_;
+
+  BookLevels<OrderPointers> levels_{&pool_};
+
+  // Every resting order and pending stop, chained per participant, so mass
+  // cancels by participant never have to look at anyone else's orders.
+  std::pmr::unordered_map<ParticipantId, OrderLink> owners_{&pool_};
+
+  Stops<Side::Buy> buyStops_{&pool_};
+  Stops<Side::Sell> sellStops_{&pool_};
+  OrderPointers triggeredStops_{&pool_};
+  std::optional<Price> lastTradePrice_;
+
+  // Orders the current AddOrder or MatchOrders call took out with quantity
+  // that never traded; see GetCancelledOrders().
+  OrderIds cancelled_;
+
+  // Expiring orders are scheduled once, when they enter the book, and left in
+  // the wheel if they trade or are cancelled first; AdvanceTime skips any
+  // whose orders_ entry no longer holds the same Order. Expiries are rounded
+  // up to ExpiryResolution, so an order may outlive its expiry by up to one
+  // resolution step but never expires early.
+  static constexpr Timestamp ExpiryResolution = 1'000'000;
+  TimerWheel<OrderPointer> expiries_;
+  Timestamp now_{0};
+  std::optional<Timestamp> sessionEnd_;
+
+  // Holds resting orders and pending stops alike; a stop's location_ points
+  // into its Stops list instead of a price level.
+  OrderEntries orders_{&pool_};
+
+  // Refreshed once at the end of every public operation that changes the
+  // book. topOfBook_ is the matching thread's copy; topOfBookFeed_ is only
+  // written when it actually changed and may be read from any thread.
+  TopOfBook topOfBook_;
+  Seqlock<TopOfBook> topOfBookFeed_;
+
+  template <Side S> Stops<S> &GetStops() {
+    if constexpr (S == Side::Buy)
+      return buyStops_;
+    else
+      return sellStops_;
+  }
+
+  template <Side S> Levels<S> &GetLevels() { return levels_.Get<S>(); }
+  template <Side S> const Levels<S> &GetLevels() const {
+    return levels_.Get<S>();
+  }
+
+  // True if the opposite side holds at least quantity at prices crossing
+  // price, hidden iceberg reserves included. Stops at the first level that
+  // covers it, so the cost is bounded by the depth the order would consume.
+  //
+  // With self-trade prevention the participant's own orders never trade.
+  // CancelOldest removes them as they are reached, so they are skipped. Every
+  // other mode shrinks or cancels the aggressor at the first one, so only
+  // what trades ahead of it counts; within its level that is the displayed
+  // quantity alone, since icebergs ahead requeue behind it.
+  template <Side S>
+  bool CanFullyFill(Price price, Quantity quantity, ParticipantId participantId,
+                    SelfTradePrevention selfTradePrevention) const {
+    const bool prevent = selfTradePrevention != SelfTradePrevention::None;
+    const bool skipOwn = selfTradePrevention == SelfTradePrevention::CancelOldest;
+    auto isOwn = [participantId](const OrderPointer &order) {
+      return order->GetParticipantId() == participantId;
+    };
+    Quantity available = 0;
+    for (const auto &[levelPrice, level] :
+         GetLevels<SideTraits<S>::Opposite>()) {
+      if (!SideTraits<S>::Crosses(price, levelPrice))
+        break;
+      const auto &orders = level.orders_;
+      const auto own = prevent && !skipOwn
+                           ? std::find_if(orders.begin(), orders.end(), isOwn)
+                           : orders.end();
+      for (auto it = orders.begin(); it != own; ++it) {
+        if (skipOwn && isOwn(*it))
+          continue;
+        available += own == orders.end() ? (*it)->GetOpenQuantity()
+                                         : (*it)->GetRemainingQuantity();
+        if (available >= quantity)
+          return true;
+      }
+      if (own != orders.end())
+        return false;
+    }
+    return false;
+  }
+
+  template <Side S> bool CanMatch(Price price) const {
+    const auto &opposite = GetLevels<SideTraits<S>::Opposite>();
+    if (opposite.empty())
+      return false;
+
+    const auto &[bestOpposite, _] = *opposite.begin();
+    return SideTraits<S>::Crosses(price, bestOpposite);
+  }
+
+  // Walks the aggressor's best level against the opposite best level. The book
+  // is uncrossed before every insert, so only side S can have become crossed.
+  template <Side S> Trades MatchOrders() {
+    using Traits = SideTraits<S>;
+    auto &levels = GetLevels<S>();
+    auto &opposite = GetLevels<Traits::Opposite>();
+
+    Trades trades;
+    while (!levels.empty() && !opposite.empty()) {
+      auto levelIt = levels.begin();
+      auto oppositeIt = opposite.begin();
+      if (!Traits::Crosses(levelIt->first, oppositeIt->first))
+        break;
+
+      auto &level = levelIt->second;
+      auto &restingLevel = oppositeIt->second;
+      auto &orders = level.orders_;
+      auto &resting = restingLevel.orders_;
+      while (!orders.empty() && !resting.empty()) {
+        auto order = orders.front();
+        auto match = resting.front();
+
+        Quantity quantity = std::min(order->GetRemainingQuantity(),
+                                     match->GetRemainingQuantity());
+        if (order->GetParticipantId() == match->GetParticipantId() &&
+            order->GetSelfTradePrevention() != SelfTradePrevention::None)
+            [[unlikely]] {
+          const Quantity shown = order->GetRemainingQuantity();
+          const Quantity matchShown = match->GetRemainingQuantity();
+          PreventSelfTrade(*order, *match, quantity);
+          level.quantity_ -= shown - order->GetRemainingQuantity();
+          restingLevel.quantity_ -= matchShown - match->GetRemainingQuantity();
+          // The aggressor goes last: nothing of it is matched after this.
+          if (match->isFilled())
+            cancelled_.push_back(match->GetOrderId());
+          if (order->isFilled())
+            cancelled_.push_back(order->GetOrderId());
+        } else {
+          order->Fill(quantity);
+          match->Fill(quantity);
+          level.quantity_ -= quantity;
+          restingLevel.quantity_ -= quantity;
+          lastTradePrice_ = match->GetPrice();
+          trades.push_back(Traits::MakeTrade(
+              TradeInfo{order->GetOrderId(), order->GetPrice(), quantity},
+              TradeInfo{match->GetOrderId(), match->GetPrice(), quantity}));
+        }
+
+        if (order->isFilled()) {
+          orders.pop_front();
+          Untrack(*order);
+        } else if (order->GetRemainingQuantity() == 0) {
+          Replenish(level);
+        }
+        if (match->isFilled()) {
+          resting.pop_front();
+          Untrack(*match);
+        } else if (match->GetRemainingQuantity() == 0) {
+          Replenish(restingLevel);
+        }
+      }
+
+      if (orders.empty())
+        levels.erase(levelIt);
+      if (resting.empty())
+        opposite.erase(oppositeIt);
+    }
+    CancelNonResting<S>();
+    return trades;
+  }
+
+  // Refills the iceberg at the front of level and requeues it at the back.
+  // splice relinks the existing node, so the order keeps its allocation and
+  // the iterator stored in orders_ stays valid.
+  static void Replenish(Level &level) {
+    auto &orders = level.orders_;
+    orders.front()->Replenish();
+    level.quantity_ += orders.front()->GetRemainingQuantity();
+    orders.splice(orders.end(), orders, orders.begin());
+  }
+
+  // Resolves a would-be self trade by shrinking the aggressor and/or the
+  // resting order; whichever reaches zero is then unlinked by the matching
+  // loop exactly like a filled order, so no extra lookups are needed.
+  static void PreventSelfTrade(Order &aggressor, Order &resting,
+                               Quantity quantity) {
+    switch (aggressor.GetSelfTradePrevention()) {
+    case SelfTradePrevention::CancelNewest:
+      aggressor.Reduce(aggressor.GetOpenQuantity());
+      break;
+    case SelfTradePrevention::CancelOldest:
+      resting.Reduce(resting.GetOpenQuantity());
+      break;
+    case SelfTradePrevention::CancelBoth:
+      aggressor.Reduce(aggressor.GetOpenQuantity());
+      resting.Reduce(resting.GetOpenQuantity());
+      break;
+    case SelfTradePrevention::Decrement:
+      aggressor.Reduce(quantity);
+      resting.Reduce(quantity);
+      break;
+    case SelfTradePrevention::None:
+      break;
+    }
+  }
+
+  // Fill-or-kill and market orders never rest, so after matching the only
+  // place one can be left over is the front of the aggressor's best level.
+  template <Side S> void CancelNonResting() {
+    auto &levels = GetLevels<S>();
+    if (levels.empty())
+      return;
+
+    const auto &[_, level] = *levels.begin();
+    const auto &order = level.orders_.front();
+    if (order->GetOrderType() == OrderType::FillOrkill ||
+        order->GetOrderType() == OrderType::Market) {
+      cancelled_.push_back(order->GetOrderId());
+      auto it = orders_.find(order->GetOrderId());
+      RemoveOrder<S>(it);
+    }
+  }
+
+  void Track(const OrderPointer &order, OrderPointers::iterator location) {
+    orders_.insert({order->GetOrderId(), OrderEntry{order, location}});
+    owners_[order->GetParticipantId()].PushBack(*order);
+  }
+
+  void Untrack(OrderEntries::iterator it) {
+    it->second.order_->Unlink();
+    orders_.erase(it);
+  }
+
+  void Untrack(Order &order) {
+    order.Unlink();
+    orders_.erase(order.GetOrderId());
+  }
+
+  template <Side S>
+  void RemoveOrder(OrderEntries::iterator it) {
+    const auto [order, iterator] = it->second;
+    Untrack(it);
+
+    auto &levels = GetLevels<S>();
+    auto level = levels.find(order->GetPrice());
+    level->second.quantity_ -= order->GetRemainingQuantity();
+    level->second.orders_.erase(iterator);
+    if (level->second.orders_.empty()) {
+      levels.erase(level);
+    }
+  }
+
+  template <Side S> void RemoveStop(OrderEntries::iterator it) {
+    const auto [order, iterator] = it->second;
+    Untrack(it);
+
+    auto &stops = GetStops<S>();
+    auto level = stops.find(order->GetStopPrice());
+    level->second.erase(iterator);
+    if (level->second.empty()) {
+      stops.erase(level);
+    }
+  }
+
+  void RemoveEntry(OrderEntries::iterator it) {
+    const auto &order = *it->second.order_;
+    if (order.IsStopPending()) {
+      if (order.GetSide() == Side::Buy)
+        RemoveStop<Side::Buy>(it);
+      else
+        RemoveStop<Side::Sell>(it);
+    } else if (order.GetSide() == Side::Buy) {
+      RemoveOrder<Side::Buy>(it);
+    } else {
+      RemoveOrder<Side::Sell>(it);
+    }
+  }
+
+  static const OrderPointers &OrdersOf(const Level &level) {
+    return level.orders_;
+  }
+  static const OrderPointers &OrdersOf(const OrderPointers &stops) {
+    return stops;
+  }
+
+  // Cancels every order on the levels [first, last) and then drops the
+  // levels themselves with a single range erase.
+  template <typename Levels>
+  void CancelLevels(Levels &levels, typename Levels::iterator first,
+                    typename Levels::iterator last, OrderIds &cancelled) {
+    for (auto level = first; level != last; ++level) {
+      for (const auto &order : OrdersOf(level->second)) {
+        cancelled.push_back(order->GetOrderId());
+        Untrack(*order);
+      }
+    }
+    levels.erase(first, last);
+  }
+
+  template <Side S> void CancelSide(OrderIds &cancelled) {
+    auto &levels = GetLevels<S>();
+    CancelLevels(levels, levels.begin(), levels.end(), cancelled);
+    auto &stops = GetStops<S>();
+    CancelLevels(stops, stops.begin(), stops.end(), cancelled);
+  }
+
+  // Removes the given resting orders of side S grouped by level: one map
+  // lookup per touched level, which is erased as soon as it is empty.
+  template <Side S>
+  void CancelFromLevels(
+      std::vector<std::pair<Price, OrderPointers::iterator>> &locations) {
+    std::stable_sort(locations.begin(), locations.end(),
+                     [](const auto &lhs, const auto &rhs) {
+                       return typename SideTraits<S>::Compare{}(lhs.first,
+                                                                rhs.first);
+                     });
+    auto &levels = GetLevels<S>();
+    for (auto location = locations.begin(); location != locations.end();) {
+      auto level = levels.find(location->first);
+      auto &[orders, quantity] = level->second;
+      for (; location != locations.end() && location->first == level->first;
+           ++location) {
+        quantity -= (*location->second)->GetRemainingQuantity();
+        orders.erase(location->second);
+      }
+      if (orders.empty())
+        levels.erase(level);
+    }
+  }
+
+  static bool Expires(OrderType orderType) {
+    return orderType == OrderType::GoodTillDate || orderType == OrderType::Day;
+  }
+
+  template <Side S> void ParkStop(OrderPointer order) {
+    auto &orders = GetStops<S>()[order->GetStopPrice()];
+    orders.push_back(order);
+    Track(order, std::prev(orders.end()));
+  }
+
+  // Moves every stop of side S reached by lastTradePrice, in stop price then
+  // arrival order, onto triggeredStops_. Only the triggered range is visited.
+  template <Side S> void CollectTriggeredStops(Price lastTradePrice) {
+    auto &stops = GetStops<S>();
+    while (!stops.empty() &&
+           SideTraits<S>::Triggers(stops.begin()->first, lastTradePrice)) {
+      triggeredStops_.splice(triggeredStops_.end(), stops.begin()->second);
+      stops.erase(stops.begin());
+    }
+  }
+
+  // Releases triggered stops into the book one at a time, buys before sells
+  // within a round. Trades they cause may trigger further stops, which are
+  // released in the next round, so a cascade is processed deterministically.
+  void ReleaseTriggeredStops(Trades &trades) {
+    while (lastTradePrice_) {
+      CollectTriggeredStops<Side::Buy>(*lastTradePrice_);
+      CollectTriggeredStops<Side::Sell>(*lastTradePrice_);
+      if (triggeredStops_.empty())
+        return;
+
+      while (!triggeredStops_.empty()) {
+        auto order = triggeredStops_.front();
+        triggeredStops_.pop_front();
+        Untrack(*order);
+        order->TriggerStop();
+
+        // A stop the book refuses once triggered is cancelled, unless
+        // matching already listed it.
+        const OrderId orderId = order->GetOrderId();
+        auto released = order->GetSide() == Side::Buy
+                            ? AddOrder<Side::Buy>(std::move(order))
+                            : AddOrder<Side::Sell>(std::move(order));
+        if (released.empty() && !orders_.contains(orderId) &&
+            (cancelled_.empty() || cancelled_.back() != orderId))
+          cancelled_.push_back(orderId);
+        trades.insert(trades.end(), released.begin(), released.end());
+      }
+    }
+  }
+
+  template <Side S> bool IsTriggered(const Order &order) const {
+    return lastTradePrice_ &&
+           SideTraits<S>::Triggers(order.GetStopPrice(), *lastTradePrice_);
+  }
+
+  template <Side S> Trades AddOrder(OrderPointer order) {
+    if (order->IsStopPending()) {
+      if (!instrument_.IsTickAligned(order->GetStopPrice())) {
+        return {};
+      }
+      if (!IsTriggered<S>(*order)) {
+        ParkStop<S>(std::move(order));
+        return {};
+      }
+      order->TriggerStop();
+    }
+    if (order->GetOrderType() == OrderType::Market) {
+      const auto &opposite = GetLevels<SideTraits<S>::Opposite>();
+      if (opposite.empty()) {
+        return {};
+      }
+      order->Reprice(std::prev(opposite.end())->first);
+    }
+    if (!instrument_.IsTickAligned(order->GetPrice())) {
+      return {};
+    }
+    // Decided on the best opposite price alone, before anything is inserted.
+    if (order->GetPostOnly() != PostOnly::None &&
+        CanMatch<S>(order->GetPrice())) {
+      if (order->GetPostOnly() == PostOnly::Reject) {
+        return {};
+      }
+      const auto &opposite = GetLevels<SideTraits<S>::Opposite>();
+      order->Reprice(SideTraits<S>::Behind(opposite.begin()->first,
+                                           instrument_.GetTickSize()));
+    }
+    if (order->GetOrderType() == OrderType::FillOrkill &&
+        !CanFullyFill<S>(order->GetPrice(), order->GetOpenQuantity(),
+                         order->GetParticipantId(),
+                         order->GetSelfTradePrevention())) {
+      return {};
+    }
+
+    auto &level = GetLevels<S>()[order->GetPrice()];
+    level.orders_.push_back(order);
+    level.quantity_ += order->GetRemainingQuantity();
+    Track(order, std::prev(level.orders_.end()));
+    return MatchOrders<S>();
+  }
+
+  Trades Submit(OrderPointer order) {
+    if (orders_.contains(order->GetOrderId())) {
+      return {};
+    }
+    // Market and fill-or-kill orders never rest, so post-only cannot apply.
+    if (order->GetPostOnly() != PostOnly::None &&
+        (order->GetOrderType() == OrderType::Market ||
+         order->GetOrderType() == OrderType::FillOrkill)) {
+      return {};
+    }
+    if (order->GetOrderType() == OrderType::Day) {
+      if (!sessionEnd_) {
+        return {};
+      }
+      order->SetExpiry(*sessionEnd_);
+    }
+    if (Expires(order->GetOrderType()) && order->GetExpiry() <= now_) {
+      return {};
+    }
+
+    auto trades = order->GetSide() == Side::Buy
+                      ? AddOrder<Side::Buy>(order)
+                      : AddOrder<Side::Sell>(order);
+    if (Expires(order->GetOrderType()) && !order->isFilled() &&
+        orders_.contains(order->GetOrderId())) {
+      expiries_.Schedule(
+          (order->GetExpiry() + ExpiryResolution - 1) / ExpiryResolution,
+          order);
+    }
+    if (!trades.empty())
+      ReleaseTriggeredStops(trades);
+    return trades;
+  }
+
+  void PublishTopOfBook() {
+    const TopOfBook top = levels_.GetTopOfBook();
+    if (top != topOfBook_) {
+      topOfBook_ = top;
+      topOfBookFeed_.Store(top);
+    }
+  }
+
+public:
+  explicit OrderBook(
+      std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+      : OrderBook{Instrument{}, upstream} {}
+
+  explicit OrderBook(
+      const Instrument &instrument,
+      std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+      : instrument_{instrument}, pool_{upstream} {}
+
+  const Instrument &GetInstrument() const { return instrument_; }
+
+  OrderBook(const OrderBook &) = delete;
+  OrderBook &operator=(const OrderBook &) = delete;
+
+  // Sizes the order index for maxOrders without rehashing and allocates (and
+  // thereby page-faults) the level, list and index nodes for maxOrders orders
+  // spread over maxLevels price levels. The nodes go straight back into the
+  // pool, so the first orders after open are served from warm memory.
+  void Reserve(std::size_t maxOrders, std::size_t maxLevels) {
+    orders_.reserve(maxOrders);
+    {
+      OrderEntries entries{&pool_};
+      entries.reserve(maxOrders);
+      for (std::size_t i = 0; i < maxOrders; ++i)
+        entries.emplace(i, OrderEntry{});
+    }
+    levels_.Reserve(maxOrders, maxLevels);
+  }
+
+  void CancelOrder(OrderId orderId) {
+    auto it = orders_.find(orderId);
+    if (it == orders_.end()) {
+      return;
+    }
+    RemoveEntry(it);
+    PublishTopOfBook();
+  }
+
+  Trades AddOrder(OrderPointer order) {
+    cancelled_.clear();
+    auto trades = Submit(std::move(order));
+    PublishTopOfBook();
+    return trades;
+  }
+
+  // Mass cancels. Each returns the ids of every order it removed, so callers
+  // can publish the result as one update.
+
+  // All resting orders and pending stops of one participant.
+  OrderIds CancelOrders(ParticipantId participantId) {
+    OrderIds cancelled;
+    auto owner = owners_.find(participantId);
+    if (owner == owners_.end()) {
+      return cancelled;
+    }
+
+    std::vector<std::pair<Price, OrderPointers::iterator>> bids, asks;
+    OrderLink &head = owner->second;
+    for (OrderLink *link = head.GetNext(); link != &head;) {
+      auto &order = static_cast<Order &>(*link);
+      link = link->GetNext();
+
+      auto it = orders_.find(order.GetOrderId());
+      cancelled.push_back(order.GetOrderId());
+      if (order.IsStopPending()) {
+        RemoveEntry(it);
+        continue;
+      }
+      auto &locations = order.GetSide() == Side::Buy ? bids : asks;
+      locations.emplace_back(order.GetPrice(), it->second.location_);
+      Untrack(it);
+    }
+    CancelFromLevels<Side::Buy>(bids);
+    CancelFromLevels<Side::Sell>(asks);
+    PublishTopOfBook();
+    return cancelled;
+  }
+
+  // All resting orders and pending stops on one side.
+  OrderIds CancelOrders(Side side) {
+    OrderIds cancelled;
+    if (side == Side::Buy)
+      CancelSide<Side::Buy>(cancelled);
+    else
+      CancelSide<Side::Sell>(cancelled);
+    PublishTopOfBook();
+    return cancelled;
+  }
+
+  // Resting orders on one side with minPrice <= price <= maxPrice. Pending
+  // stops are not on a price level and are left alone.
+  OrderIds CancelOrders(Side side, Price minPrice, Price maxPrice) {
+    OrderIds cancelled;
+    if (minPrice > maxPrice) {
+      return cancelled;
+    }
+    if (side == Side::Buy) {
+      auto &bids = GetLevels<Side::Buy>();
+      CancelLevels(bids, bids.lower_bound(maxPrice), bids.upper_bound(minPrice),
+                   cancelled);
+    } else {
+      auto &asks = GetLevels<Side::Sell>();
+      CancelLevels(asks, asks.lower_bound(minPrice), asks.upper_bound(maxPrice),
+                   cancelled);
+    }
+    PublishTopOfBook();
+    return cancelled;
+  }
+
+  // Everything in the book, pending stops included.
+  OrderIds CancelAllOrders() {
+    OrderIds cancelled;
+    CancelSide<Side::Buy>(cancelled);
+    CancelSide<Side::Sell>(cancelled);
+    PublishTopOfBook();
+    return cancelled;
+  }
+
+  // Day orders are only accepted once the session end is known.
+  void SetSessionEnd(Timestamp sessionEnd) { sessionEnd_ = sessionEnd; }
+
+  // Moves the book's clock forward and removes every GoodTillDate and Day
+  // order (resting or pending stop) whose expiry is at or before now. The
+  // timer wheel hands over due orders a whole tick at a time, so a session
+  // end with thousands of Day orders costs one removal per order.
+  OrderIds AdvanceTime(Timestamp now) {
+    OrderIds expired;
+    if (now <= now_) {
+      return expired;
+    }
+    now_ = now;
+    auto expire = [this, &expired](const OrderPointer &order) {
+      auto it = orders_.find(order->GetOrderId());
+      if (it == orders_.end() || it->second.order_ != order) {
+        return;
+      }
+      expired.push_back(order->GetOrderId());
+      RemoveEntry(it);
+    };
+    expiries_.Advance(now_ / ExpiryResolution, expire);
+    PublishTopOfBook();
+    return expired;
+  }
+
+  Trades MatchOrders(OrderModify order) {
+    cancelled_.clear();
+    auto it = orders_.find(order.GetOrderId());
+    if (it == orders_.end()) {
+      return {};
+    }
+    const auto &existing = *it->second.order_;
+    auto replacement =
+        order.ToOrderPointer(existing.GetOrderType(), existing.GetParticipantId(),
+                             existing.GetSelfTradePrevention());
+    if (existing.IsIceberg())
+      replacement->SetPeakQuantity(existing.GetPeakQuantity());
+    if (existing.IsStopPending())
+      replacement->SetStopPrice(existing.GetStopPrice());
+    replacement->SetExpiry(existing.GetExpiry());
+    replacement->SetPostOnly(existing.GetPostOnly());
+    RemoveEntry(it);
+    auto trades = Submit(std::move(replacement));
+    PublishTopOfBook();
+    return trades;
+  }
+
+  std::size_t Size() const { return orders_.size(); }
+
+  // Orders the last AddOrder or MatchOrders took out of the book with
+  // quantity left that never traded: resting orders and aggressors that
+  // self-trade prevention cancelled, the unfilled rest of a Market or
+  // FillOrkill order, and triggered stops that could neither trade nor
+  // rest. An order refused outright is not listed.
+  const OrderIds &GetCancelledOrders() const { return cancelled_; }
+
+  // True while the order rests in the book or waits as a stop.
+  bool Contains(OrderId orderId) const { return orders_.contains(orderId); }
+
+  // The resting order or pending stop with this id, or nullptr. Only valid
+  // until the next operation on the book.
+  const Order *FindOrder(OrderId orderId) const {
+    const auto it = orders_.find(orderId);
+    return it == orders_.end() ? nullptr : it->second.order_.get();
+  }
+
+  // Price of the most recent trade, the one stop orders are triggered by.
+  const std::optional<Price> &GetLastTradePrice() const {
+    return lastTradePrice_;
+  }
+
+  // Best bid and ask as of the last completed operation. Only for the thread
+  // driving the book.
+  const TopOfBook &GetTopOfBook() const { return topOfBook_; }
+
+  // The same, readable from any thread without synchronizing with the one
+  // driving the book.
+  TopOfBook ReadTopOfBook() const { return topOfBookFeed_.Load(); }
+
+  // Fixed-depth counterpart of GetLevelInfos() that does not allocate, for
+  // publishing through a DepthFeed.
+  template <std::size_t Depth> DepthSnapshot<Depth> GetDepth() const {
+    return levels_.GetDepth<Depth>();
+  }
+
+  // Calls visit(price, quantity) for every level of side, best first.
+  template <typename Visit> void ForEachLevel(Side side, Visit &&visit) const {
+    levels_.ForEachLevel(side, std::forward<Visit>(visit));
+  }
+
+  OrderBookLevelInfos GetLevelInfos() const { return levels_.GetLevelInfos(); }
+};
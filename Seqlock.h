@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Single-writer sequence lock. The writer never waits; readers retry while a
+// write is in progress or if one overlapped their copy. The value is stored
+// as relaxed atomic words so that racing reads are well defined, and the
+// whole lock sits on its own cache lines so readers spinning on it do not
+// disturb the writer's neighbouring data.
+template <typename T> class alignas(64) Seqlock {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Seqlock values are copied word by word");
+
+public:
+  Seqlock() = default;
+  explicit Seqlock(const T &value) { Store(value); }
+
+  Seqlock(const Seqlock &) = delete;
+  Seqlock &operator=(const Seqlock &) = delete;
+
+  // Writer side. Must only ever be called from one thread at a time.
+  void Store(const T &value) {
+    std::array<std::uint64_t, Words> words{};
+    std::memcpy(words.data(), &value, sizeof(T));
+
+    const auto sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (std::size_t i = 0; i < Words; ++i)
+      words_[i].store(words[i], std::memory_order_relaxed);
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  // Reader side; safe from any number of threads.
+  T Load() const {
+    T value;
+    while (!TryLoad(value)) {
+    }
+    return value;
+  }
+
+  // A single attempt: false if a write was in progress or overlapped.
+  bool TryLoad(T &value) const {
+    const auto before = sequence_.load(std::memory_order_acquire);
+    if (before & 1)
+      return false;
+
+    std::array<std::uint64_t, Words> words;
+    for (std::size_t i = 0; i < Words; ++i)
+      words[i] = words_[i].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sequence_.load(std::memory_order_relaxed) != before)
+      return false;
+
+    // Through void * because T may have default member initializers, which
+    // makes it non-trivial (but still trivially copyable, as asserted).
+    std::memcpy(static_cast<void *>(&value), words.data(), sizeof(T));
+    return true;
+  }
+
+  // Number of completed stores; lets readers skip values they have seen.
+  std::uint64_t GetVersion() const {
+    return sequence_.load(std::memory_order_acquire) / 2;
+  }
+
+private:
+  static constexpr std::size_t Words =
+      (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+  std::atomic<std::uint64_t> sequence_{0};
+  std::array<std::atomic<std::uint64_t>, Words> words_{};
+};
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include "Seqlock.h"
+
+// Single-producer broadcast ring in POSIX shared memory (/dev/shm/<name>).
+// The writer never waits for readers: each slot is a Seqlock, and a reader
+// that falls more than a ring's length behind finds a slot already holding
+// a later message, counts what it missed as overrun and skips ahead. Neither
+// side makes a system call after the mapping is set up.
+//
+// Message n lives in slot n % capacity and is that slot's (n / capacity + 1)th
+// store, so a reader can tell from the slot's version alone whether its next
+// message is not written yet, readable, or already overwritten.
+namespace shared_memory_ring {
+
+inline constexpr std::uint64_t Magic = 0x4F42524E47303031ull; // "OBRNG001"
+
+struct Header {
+  std::atomic<std::uint64_t> magic_;
+  std::uint64_t capacity_;
+  std::uint64_t messageSize_;
+  alignas(64) std::atomic<std::uint64_t> next_;
+};
+
+inline std::system_error Error(const std::string &what,
+                               const std::string &name) {
+  return std::system_error(errno, std::generic_category(),
+                           std::format("{} {}", what, name));
+}
+
+} // namespace shared_memory_ring
+
+template <typename T> class SharedMemoryPublisher {
+public:
+  using Slot = Seqlock<T>;
+
+  // Creates (or replaces) the ring; capacity is rounded up to a power of two.
+  SharedMemoryPublisher(std::string name, std::size_t capacity)
+      : name_{std::move(name)} {
+    std::size_t slots = 1;
+    while (slots < capacity)
+      slots <<= 1;
+    mask_ = slots - 1;
+    size_ = sizeof(shared_memory_ring::Header) + slots * sizeof(Slot);
+
+    const int fd = shm_open(name_.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0600);
+    if (fd < 0)
+      throw shared_memory_ring::Error("shm_open", name_);
+    if (ftruncate(fd, static_cast<off_t>(size_)) != 0) {
+      const auto error = shared_memory_ring::Error("ftruncate", name_);
+      close(fd);
+      throw error;
+    }
+    void *mapping =
+        mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+      throw shared_memory_ring::Error("mmap", name_);
+
+    header_ = new (mapping) shared_memory_ring::Header{};
+    header_->capacity_ = slots;
+    header_->messageSize_ = sizeof(T);
+    slots_ = reinterpret_cast<Slot *>(header_ + 1);
+    for (std::size_t i = 0; i < slots; ++i)
+      new (slots_ + i) Slot{};
+    header_->magic_.store(shared_memory_ring::Magic, std::memory_order_release);
+  }
+
+  SharedMemoryPublisher(const SharedMemoryPublisher &) = delete;
+  SharedMemoryPublisher &operator=(const SharedMemoryPublisher &) = delete;
+
+  ~SharedMemoryPublisher() {
+    munmap(header_, size_);
+    shm_unlink(name_.c_str());
+  }
+
+  void Publish(const T &message) {
+    slots_[next_ & mask_].Store(message);
+    header_->next_.store(++next_, std::memory_order_release);
+  }
+
+  std::uint64_t GetPublished() const { return next_; }
+
+private:
+  std::string name_;
+  std::size_t size_;
+  std::uint64_t mask_;
+  std::uint64_t next_{0};
+  shared_memory_ring::Header *header_;
+  Slot *slots_;
+};
+
+template <typename T> class SharedMemorySubscriber {
+public:
+  using Slot = Seqlock<T>;
+
+  // Attaches read-only to an existing ring and starts with the next message
+  // published after this point.
+  explicit SharedMemorySubscriber(const std::string &name) {
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+      throw shared_memory_ring::Error("shm_open", name);
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+      const auto error = shared_memory_ring::Error("fstat", name);
+      close(fd);
+      throw error;
+    }
+    size_ = static_cast<std::size_t>(status.st_size);
+    void *mapping = size_ < sizeof(shared_memory_ring::Header)
+                        ? MAP_FAILED
+                        : mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+      throw shared_memory_ring::Error("mmap", name);
+
+    header_ = static_cast<const shared_memory_ring::Header *>(mapping);
+    if (header_->magic_.load(std::memory_order_acquire) !=
+            shared_memory_ring::Magic ||
+        header_->messageSize_ != sizeof(T) ||
+        size_ < sizeof(*header_) + header_->capacity_ * sizeof(Slot)) {
+      munmap(mapping, size_);
+      throw std::runtime_error(
+          std::format("{} is not a ring of this message type", name));
+    }
+    capacity_ = header_->capacity_;
+    slots_ = reinterpret_cast<const Slot *>(header_ + 1);
+    next_ = header_->next_.load(std::memory_order_acquire);
+  }
+
+  SharedMemorySubscriber(const SharedMemorySubscriber &) = delete;
+  SharedMemorySubscriber &operator=(const SharedMemorySubscriber &) = delete;
+
+  ~SharedMemorySubscriber() {
+    munmap(const_cast<shared_memory_ring::Header *>(header_), size_);
+  }
+
+  // Hands up to limit new messages to callback(const T &) in publication
+  // order and returns how many there were. Never blocks.
+  template <typename Callback>
+  std::size_t Poll(Callback &&callback,
+                   std::size_t limit = std::numeric_limits<std::size_t>::max()) {
+    std::size_t count = 0;
+    T message;
+    while (count < limit) {
+      const Slot &slot = slots_[next_ & (capacity_ - 1)];
+      const std::uint64_t expected = next_ / capacity_ + 1;
+      const std::uint64_t version = slot.GetVersion();
+      if (version < expected)
+        break;
+      if (version == expected && slot.TryLoad(message) &&
+          slot.GetVersion() == expected) {
+        ++next_;
+        ++count;
+        callback(message);
+        continue;
+      }
+      if (slot.GetVersion() > expected)
+        SkipOverrun();
+    }
+    return count;
+  }
+
+  // Sequence number of the next message this subscriber will see.
+  std::uint64_t GetPosition() const { return next_; }
+  // Messages lost because the writer lapped this subscriber.
+  std::uint64_t GetOverruns() const { return overruns_; }
+
+private:
+  std::size_t size_;
+  std::uint64_t capacity_;
+  std::uint64_t next_;
+  std::uint64_t overruns_{0};
+  const shared_memory_ring::Header *header_;
+  const Slot *slots_;
+
+  // Resumes at the oldest message still in the ring.
+  void SkipOverrun() {
+    const auto head = header_->next_.load(std::memory_order_acquire);
+    const auto oldest = head > capacity_ ? head - capacity_ : 0;
+    if (oldest > next_) {
+      overruns_ += oldest - next_;
+      next_ = oldest;
+    }
+  }
+};
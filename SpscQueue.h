@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+// Bounded single-producer single-consumer ring. Each side keeps a private
+// copy of the other side's index and only reloads the shared one when the
+// copy says the ring is full (producer) or empty (consumer), so in steady
+// state a push or pop touches no cache line the other thread is writing.
+template <typename T, std::size_t Capacity> class SpscQueue {
+  static_assert((Capacity & (Capacity - 1)) == 0,
+                "SpscQueue capacity must be a power of two");
+  static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+  // Producer side.
+  bool TryPush(const T &value) {
+    if (head_ - cachedTail_ == Capacity) {
+      cachedTail_ = publishedTail_.load(std::memory_order_acquire);
+      if (head_ - cachedTail_ == Capacity)
+        return false;
+    }
+    slots_[head_ & (Capacity - 1)] = value;
+    publishedHead_.store(++head_, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side.
+  std::optional<T> TryPop() {
+    if (tail_ == cachedHead_) {
+      cachedHead_ = publishedHead_.load(std::memory_order_acquire);
+      if (tail_ == cachedHead_)
+        return std::nullopt;
+    }
+    T value = slots_[tail_ & (Capacity - 1)];
+    publishedTail_.store(++tail_, std::memory_order_release);
+    return value;
+  }
+
+  // Either side; a snapshot that may be stale by the time it is used.
+  bool IsEmpty() const {
+    return publishedHead_.load(std::memory_order_acquire) ==
+           publishedTail_.load(std::memory_order_acquire);
+  }
+
+private:
+  // Producer's line: its own index and its copy of the consumer's.
+  alignas(64) std::uint64_t head_{0};
+  std::uint64_t cachedTail_{0};
+  std::atomic<std::uint64_t> publishedHead_{0};
+  // Consumer's line.
+  alignas(64) std::uint64_t tail_{0};
+  std::uint64_t cachedHead_{0};
+  std::atomic<std::uint64_t> publishedTail_{0};
+
+  alignas(64) std::array<T, Capacity> slots_;
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Hierarchical timing wheel over 64-bit ticks: one level of 256 slots per
+// byte of the tick. A timer lives on the level of the highest byte in which
+// its tick differs from the current tick, so every occupied slot on a level
+// is still ahead of the wheel and the next due slot can be found from the
+// occupancy bitmaps without stepping through empty ticks. When the wheel
+// reaches a higher-level slot its timers are cascaded down; level-0 slots
+// hold timers for exactly one tick and are fired as a whole.
+template <typename T> class TimerWheel {
+public:
+  using Tick = std::uint64_t;
+
+  explicit TimerWheel(Tick now = 0)
+      : current_{now}, slots_(Levels * Slots), occupied_{} {}
+
+  Tick GetCurrentTick() const { return current_; }
+  std::size_t Size() const { return size_; }
+  bool Empty() const { return size_ == 0; }
+
+  // Timers due at or before the current tick fire on the next Advance().
+  void Schedule(Tick tick, T value) {
+    Place(Entry{std::max(tick, current_), std::move(value)});
+    ++size_;
+  }
+
+  // Moves the wheel to now, invoking callback(T &) for every timer due by
+  // then, earliest tick first and in scheduling order within a tick.
+  template <typename Callback> void Advance(Tick now, Callback &&callback) {
+    while (size_ != 0) {
+      const Tick next = NextDueTick();
+      if (next > now)
+        break;
+
+      current_ = next;
+      for (std::size_t level = Levels - 1; level > 0; --level) {
+        const Tick below = (Tick{1} << (level * SlotBits)) - 1;
+        if ((current_ & below) == 0)
+          Cascade(level, SlotIndex(current_, level));
+      }
+      Fire(SlotIndex(current_, 0), callback);
+    }
+    current_ = std::max(current_, now);
+  }
+
+private:
+  static constexpr std::size_t SlotBits = 8;
+  static constexpr std::size_t Slots = std::size_t{1} << SlotBits;
+  static constexpr std::size_t Levels = 64 / SlotBits;
+  static constexpr std::size_t Words = Slots / 64;
+
+  struct Entry {
+    Tick tick_;
+    T value_;
+  };
+
+  Tick current_;
+  std::size_t size_{0};
+  std::vector<std::vector<Entry>> slots_;
+  std::array<std::array<std::uint64_t, Words>, Levels> occupied_;
+  std::vector<Entry> scratch_;
+
+  static std::size_t SlotIndex(Tick tick, std::size_t level) {
+    return (tick >> (level * SlotBits)) & (Slots - 1);
+  }
+
+  std::vector<Entry> &Slot(std::size_t level, std::size_t index) {
+    return slots_[level * Slots + index];
+  }
+
+  void Place(Entry entry) {
+    const Tick differing = entry.tick_ ^ current_;
+    const std::size_t level =
+        differing == 0 ? 0 : (std::bit_width(differing) - 1) / SlotBits;
+    const std::size_t index = SlotIndex(entry.tick_, level);
+    Slot(level, index).push_back(std::move(entry));
+    occupied_[level][index / 64] |= std::uint64_t{1} << (index % 64);
+  }
+
+  // First occupied slot at or after from on level, or Slots if none.
+  std::size_t FindOccupied(std::size_t level, std::size_t from) const {
+    for (std::size_t word = from / 64; word < Words; ++word) {
+      std::uint64_t bits = occupied_[level][word];
+      if (word == from / 64)
+        bits &= ~std::uint64_t{0} << (from % 64);
+      if (bits)
+        return word * 64 + std::countr_zero(bits);
+    }
+    return Slots;
+  }
+
+  // The earliest tick at which a slot has to be fired or cascaded. Level 0
+  // slots are due at their own tick, higher slots when the wheel enters them.
+  Tick NextDueTick() const {
+    Tick next = std::numeric_limits<Tick>::max();
+    for (std::size_t level = 0; level < Levels; ++level) {
+      const std::size_t shift = level * SlotBits;
+      const std::size_t from = SlotIndex(current_, level) + (level ? 1 : 0);
+      if (from >= Slots)
+        continue;
+      const std::size_t index = FindOccupied(level, from);
+      if (index == Slots)
+        continue;
+
+      const Tick base = level + 1 < Levels
+                            ? current_ >> (shift + SlotBits) << (shift + SlotBits)
+                            : 0;
+      next = std::min(next, base | (Tick{index} << shift));
+    }
+    return next;
+  }
+
+  void Take(std::size_t level, std::size_t index) {
+    scratch_.clear();
+    scratch_.swap(Slot(level, index));
+    occupied_[level][index / 64] &= ~(std::uint64_t{1} << (index % 64));
+  }
+
+  void Cascade(std::size_t level, std::size_t index) {
+    if (!(occupied_[level][index / 64] & (std::uint64_t{1} << (index % 64))))
+      return;
+    Take(level, index);
+    for (auto &entry : scratch_)
+      Place(std::move(entry));
+  }
+
+  template <typename Callback> void Fire(std::size_t index, Callback &callback) {
+    if (!(occupied_[0][index / 64] & (std::uint64_t{1} << (index % 64))))
+      return;
+    Take(0, index);
+    size_ -= scratch_.size();
+    // Callbacks may schedule new timers, which can land in the slot just
+    // emptied; firing from a local keeps those for the next pass.
+    auto firing = std::move(scratch_);
+    for (auto &entry : firing)
+      callback(entry.value_);
+    firing.clear();
+    scratch_ = std::move(firing);
+  }
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "Orderbook.h"
+
+// Open, high, low and close of a run of trades, with their volume and
+// notional (price times quantity, in price units).
+struct Bar {
+  // Start of the interval for time bars, time of the first trade for
+  // volume bars.
+  Timestamp start_{0};
+  Timestamp end_{0};
+  Price open_{0};
+  Price high_{0};
+  Price low_{0};
+  Price close_{0};
+  std::uint64_t volume_{0};
+  std::int64_t notional_{0};
+  std::uint64_t trades_{0};
+
+  double GetVwap() const {
+    return volume_ ? static_cast<double>(notional_) / volume_ : 0.0;
+  }
+
+  void Add(Price price, Quantity quantity, Timestamp now) {
+    if (trades_++ == 0) {
+      open_ = high_ = low_ = price;
+    } else {
+      high_ = std::max(high_, price);
+      low_ = std::min(low_, price);
+    }
+    close_ = price;
+    end_ = now;
+    volume_ += quantity;
+    notional_ += price * static_cast<std::int64_t>(quantity);
+  }
+};
+
+// The last Capacity() completed bars in a ring; a new bar overwrites the
+// oldest once it is full.
+class BarHistory {
+public:
+  explicit BarHistory(std::size_t capacity) : bars_(capacity ? capacity : 1) {}
+
+  std::size_t Capacity() const { return bars_.size(); }
+  std::size_t Size() const { return size_; }
+  bool Empty() const { return size_ == 0; }
+
+  // 0 is the most recent bar.
+  const Bar &operator[](std::size_t age) const {
+    return bars_[(next_ + bars_.size() - 1 - age) % bars_.size()];
+  }
+
+  void Push(const Bar &bar) {
+    bars_[next_] = bar;
+    next_ = (next_ + 1) % bars_.size();
+    size_ = std::min(size_ + 1, bars_.size());
+  }
+
+  void Clear() { next_ = size_ = 0; }
+
+private:
+  std::vector<Bar> bars_;
+  std::size_t next_{0};
+  std::size_t size_{0};
+};
+
+// Session statistics of one book's trades, kept up to date as trades come
+// out of the matcher (AddOrder's and MatchOrders' return values, or a
+// MatchingEngine batch) so that none of them needs the trade history: VWAP,
+// open/last/high/low, volume, volume by price, and bars closed every
+// barInterval nanoseconds and every barVolume shares. Each trade costs a
+// constant amount of work, plus one ring write for every bar it completes;
+// a trade larger than what is left of the current volume bar is split
+// across as many bars as it fills. Intervals without trades produce no time
+// bar.
+class TradeStatistics {
+public:
+  TradeStatistics(Timestamp barInterval, std::uint64_t barVolume,
+                  std::size_t history = 1024)
+      : barInterval_{barInterval ? barInterval : 1},
+        barVolume_{barVolume ? barVolume : 1}, timeBars_{history},
+        volumeBars_{history} {}
+
+  void Add(const Trades &trades, Timestamp now) {
+    for (const auto &trade : trades)
+      Add(trade, now);
+  }
+
+  void Add(const Trade &trade, Timestamp now) {
+    const Price price = trade.GetPrice();
+    const Quantity quantity = trade.GetQuantity();
+    if (session_.trades_ == 0)
+      session_.start_ = now;
+    session_.Add(price, quantity, now);
+    volumeByPrice_[price] += quantity;
+
+    Roll(now);
+    if (timeBar_.trades_ == 0)
+      timeBar_.start_ = now - now % barInterval_;
+    timeBar_.Add(price, quantity, now);
+
+    for (Quantity left = quantity; left != 0;) {
+      const auto part = static_cast<Quantity>(
+          std::min<std::uint64_t>(left, barVolume_ - volumeBar_.volume_));
+      if (volumeBar_.trades_ == 0)
+        volumeBar_.start_ = now;
+      volumeBar_.Add(price, part, now);
+      left -= part;
+      if (volumeBar_.volume_ == barVolume_) {
+        volumeBars_.Push(volumeBar_);
+        volumeBar_ = Bar{};
+      }
+    }
+  }
+
+  // Closes the time bar in progress if now is past its interval, so the
+  // bars are current even when no trade has come along to close them.
+  void Roll(Timestamp now) {
+    if (timeBar_.trades_ != 0 && now >= timeBar_.start_ + barInterval_) {
+      timeBars_.Push(timeBar_);
+      timeBar_ = Bar{};
+    }
+  }
+
+  // A new session: everything but the bar settings starts over.
+  void Reset() {
+    session_ = timeBar_ = volumeBar_ = Bar{};
+    timeBars_.Clear();
+    volumeBars_.Clear();
+    volumeByPrice_.clear();
+  }
+
+  std::uint64_t GetTradeCount() const { return session_.trades_; }
+  std::uint64_t GetVolume() const { return session_.volume_; }
+  std::int64_t GetNotional() const { return session_.notional_; }
+  double GetVwap() const { return session_.GetVwap(); }
+
+  // Open, high, low and last of the session, from its first trade to its
+  // last; empty before the first.
+  std::optional<Bar> GetSession() const {
+    if (session_.trades_ == 0)
+      return std::nullopt;
+    return session_;
+  }
+  std::optional<Price> GetLastPrice() const {
+    if (session_.trades_ == 0)
+      return std::nullopt;
+    return session_.close_;
+  }
+
+  std::uint64_t GetVolumeAt(Price price) const {
+    const auto it = volumeByPrice_.find(price);
+    return it == volumeByPrice_.end() ? 0 : it->second;
+  }
+
+  // Bars in progress (trades_ == 0 if nothing has traded in them yet) and
+  // the completed ones.
+  const Bar &GetTimeBar() const { return timeBar_; }
+  const Bar &GetVolumeBar() const { return volumeBar_; }
+  const BarHistory &GetTimeBars() const { return timeBars_; }
+  const BarHistory &GetVolumeBars() const { return volumeBars_; }
+
+  Timestamp GetBarInterval() const { return barInterval_; }
+  std::uint64_t GetBarVolume() const { return barVolume_; }
+
+private:
+  Timestamp barInterval_;
+  std::uint64_t barVolume_;
+  Bar session_;
+  Bar timeBar_;
+  Bar volumeBar_;
+  BarHistory timeBars_;
+  BarHistory volumeBars_;
+  std::unordered_map<Price, std::uint64_t> volumeByPrice_;
+};
@@ -0,0 +1,403 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "Orderbook.h"
+
+// Append-only trade history on disk, one column per field. Trades go into
+// segment files of a fixed number of rows (segment-000000.trades, ...), each
+// mapped whole: a header, then every column as a contiguous array. A scan
+// therefore only reads the columns it needs, as dense arrays the compiler
+// can vectorize, instead of striding over whole Trade objects, and the page
+// cache (not the process) holds the history.
+//
+// Rows become visible to readers when the segment's count is published,
+// after the row is written. Appends are expected in time order, which lets
+// time-bounded queries binary search for their first row.
+namespace trade_store {
+
+inline constexpr std::uint64_t Magic = 0x4F42545244303031ull; // "OBTRD001"
+
+struct Header {
+  std::atomic<std::uint64_t> magic_;
+  std::uint64_t capacity_;
+  // Index of the segment's first row in the whole store.
+  std::uint64_t first_;
+  alignas(64) std::atomic<std::uint64_t> count_;
+};
+
+inline std::system_error Error(const std::string &what,
+                               const std::string &name) {
+  return std::system_error(errno, std::generic_category(),
+                           std::format("{} {}", what, name));
+}
+
+// Byte offsets of the columns in a segment of capacity rows, each column
+// starting on its own cache line.
+struct Layout {
+  explicit Layout(std::size_t capacity) {
+    std::size_t at = 4096;
+    auto column = [&](std::size_t width) {
+      const std::size_t offset = at;
+      at = (at + width * capacity + 63) / 64 * 64;
+      return offset;
+    };
+    times_ = column(sizeof(Timestamp));
+    prices_ = column(sizeof(Price));
+    aggressorPrices_ = column(sizeof(Price));
+    quantities_ = column(sizeof(Quantity));
+    bidOrderIds_ = column(sizeof(OrderId));
+    askOrderIds_ = column(sizeof(OrderId));
+    aggressors_ = column(sizeof(std::uint8_t));
+    size_ = at;
+  }
+
+  std::size_t times_, prices_, aggressorPrices_, quantities_, bidOrderIds_,
+      askOrderIds_, aggressors_, size_;
+};
+
+// The scan kernels work on blocks of Block rows with a fixed trip count and
+// no branches, which GCC vectorizes even at -O2, given a target with 64-bit
+// vector compares (-march=x86-64-v3 or native; baseline x86-64 has none).
+// The remainder of a column is done row by row.
+inline constexpr std::size_t Block = 16;
+
+// Quantity traded at prices in [minPrice, maxPrice].
+inline std::uint64_t SumQuantity(const Price *prices,
+                                 const Quantity *quantities, std::size_t count,
+                                 Price minPrice, Price maxPrice) {
+  // An empty range would otherwise wrap width round to nearly every price.
+  if (minPrice > maxPrice)
+    return 0;
+  // One unsigned compare tests both bounds.
+  const auto low = static_cast<std::uint64_t>(minPrice);
+  const auto width = static_cast<std::uint64_t>(maxPrice) - low;
+  std::uint64_t total = 0;
+  std::size_t i = 0;
+  for (; i + Block <= count; i += Block) {
+    std::uint64_t block = 0;
+    for (std::size_t j = 0; j < Block; ++j)
+      block += static_cast<std::uint64_t>(prices[i + j]) - low <= width
+                   ? quantities[i + j]
+                   : 0;
+    total += block;
+  }
+  for (; i < count; ++i)
+    total += static_cast<std::uint64_t>(prices[i]) - low <= width
+                 ? quantities[i]
+                 : 0;
+  return total;
+}
+
+// Calls match(row) for every row where either side is orderId. Blocks with
+// no match, nearly all of them, cost two vector compares per few rows.
+template <typename Match>
+void FindOrder(const OrderId *bids, const OrderId *asks, std::size_t count,
+               OrderId orderId, Match &&match) {
+  std::size_t i = 0;
+  for (; i + Block <= count; i += Block) {
+    std::uint64_t hits = 0;
+    for (std::size_t j = 0; j < Block; ++j)
+      hits |= (bids[i + j] == orderId) | (asks[i + j] == orderId);
+    if (hits == 0)
+      continue;
+    for (std::size_t j = i; j < i + Block; ++j)
+      if (bids[j] == orderId || asks[j] == orderId)
+        match(j);
+  }
+  for (; i < count; ++i)
+    if (bids[i] == orderId || asks[i] == orderId)
+      match(i);
+}
+
+} // namespace trade_store
+
+// One segment file, mapped read-write.
+class TradeSegment {
+public:
+  // Creates the file, replacing any file of that name.
+  TradeSegment(const std::string &path, std::size_t capacity,
+               std::uint64_t first)
+      : path_{path}, layout_{capacity} {
+    const int fd = open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd < 0)
+      throw trade_store::Error("open", path);
+    if (ftruncate(fd, static_cast<off_t>(layout_.size_)) != 0) {
+      const auto error = trade_store::Error("ftruncate", path);
+      close(fd);
+      throw error;
+    }
+    Map(fd);
+    header_ = new (base_) trade_store::Header{};
+    header_->capacity_ = capacity;
+    header_->first_ = first;
+    header_->magic_.store(trade_store::Magic, std::memory_order_release);
+    capacity_ = capacity;
+  }
+
+  // Opens a segment written earlier.
+  explicit TradeSegment(const std::string &path)
+      : path_{path}, layout_{ReadCapacity(path)} {
+    const int fd = open(path.c_str(), O_RDWR);
+    if (fd < 0)
+      throw trade_store::Error("open", path);
+    Map(fd);
+    header_ = reinterpret_cast<trade_store::Header *>(base_);
+    capacity_ = header_->capacity_;
+  }
+
+  TradeSegment(const TradeSegment &) = delete;
+  TradeSegment &operator=(const TradeSegment &) = delete;
+
+  ~TradeSegment() { munmap(base_, layout_.size_); }
+
+  std::size_t Size() const {
+    return header_->count_.load(std::memory_order_acquire);
+  }
+  std::size_t Capacity() const { return capacity_; }
+  bool Full() const { return Size() == capacity_; }
+  std::uint64_t GetFirst() const { return header_->first_; }
+
+  void Append(const Trade &trade, Timestamp time) {
+    const std::size_t row = header_->count_.load(std::memory_order_relaxed);
+    const bool buy = trade.GetAggressorSide() == Side::Buy;
+    Column<Timestamp>(layout_.times_)[row] = time;
+    Column<Price>(layout_.prices_)[row] = trade.GetPrice();
+    Column<Price>(layout_.aggressorPrices_)[row] =
+        buy ? trade.GetBidTrade().price_ : trade.GetAskTrade().price_;
+    Column<Quantity>(layout_.quantities_)[row] = trade.GetQuantity();
+    Column<OrderId>(layout_.bidOrderIds_)[row] = trade.GetBidTrade().orderId_;
+    Column<OrderId>(layout_.askOrderIds_)[row] = trade.GetAskTrade().orderId_;
+    Column<std::uint8_t>(layout_.aggressors_)[row] =
+        static_cast<std::uint8_t>(trade.GetAggressorSide());
+    header_->count_.store(row + 1, std::memory_order_release);
+  }
+
+  Trade GetTrade(std::size_t row) const {
+    const auto aggressor =
+        static_cast<Side>(GetColumn<std::uint8_t>(layout_.aggressors_)[row]);
+    const Price price = GetPrices()[row];
+    const Price aggressorPrice =
+        GetColumn<Price>(layout_.aggressorPrices_)[row];
+    const Quantity quantity = GetQuantities()[row];
+    return Trade{TradeInfo{GetBidOrderIds()[row],
+                           aggressor == Side::Buy ? aggressorPrice : price,
+                           quantity},
+                 TradeInfo{GetAskOrderIds()[row],
+                           aggressor == Side::Buy ? price : aggressorPrice,
+                           quantity},
+                 aggressor};
+  }
+
+  const Timestamp *GetTimes() const {
+    return GetColumn<Timestamp>(layout_.times_);
+  }
+  const Price *GetPrices() const { return GetColumn<Price>(layout_.prices_); }
+  const Quantity *GetQuantities() const {
+    return GetColumn<Quantity>(layout_.quantities_);
+  }
+  const OrderId *GetBidOrderIds() const {
+    return GetColumn<OrderId>(layout_.bidOrderIds_);
+  }
+  const OrderId *GetAskOrderIds() const {
+    return GetColumn<OrderId>(layout_.askOrderIds_);
+  }
+
+  // Rows [begin, end) of the first count whose time is in [from, to].
+  std::pair<std::size_t, std::size_t> FindTimes(std::size_t count,
+                                                Timestamp from,
+                                                Timestamp to) const {
+    const Timestamp *times = GetTimes();
+    return {std::lower_bound(times, times + count, from) - times,
+            std::upper_bound(times, times + count, to) - times};
+  }
+
+  // Starts writing the dirty pages back without waiting for them.
+  void Flush() {
+    if (msync(base_, layout_.size_, MS_ASYNC) != 0)
+      throw trade_store::Error("msync", path_);
+  }
+
+private:
+  std::string path_;
+  trade_store::Layout layout_;
+  std::size_t capacity_{0};
+  std::byte *base_{nullptr};
+  trade_store::Header *header_{nullptr};
+
+  template <typename T> T *Column(std::size_t offset) {
+    return reinterpret_cast<T *>(base_ + offset);
+  }
+  template <typename T> const T *GetColumn(std::size_t offset) const {
+    return reinterpret_cast<const T *>(base_ + offset);
+  }
+
+  void Map(int fd) {
+    void *mapping = mmap(nullptr, layout_.size_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+      throw trade_store::Error("mmap", path_);
+    base_ = static_cast<std::byte *>(mapping);
+  }
+
+  // Checks the magic and the file size before anything is mapped.
+  static std::size_t ReadCapacity(const std::string &path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw trade_store::Error("open", path);
+    // magic_ and capacity_, the first two words of the header.
+    std::uint64_t words[2]{};
+    struct stat status;
+    const bool valid =
+        fstat(fd, &status) == 0 &&
+        pread(fd, words, sizeof(words), 0) ==
+            static_cast<ssize_t>(sizeof(words)) &&
+        words[0] == trade_store::Magic && words[1] != 0 &&
+        static_cast<std::size_t>(status.st_size) >=
+            trade_store::Layout{words[1]}.size_;
+    close(fd);
+    if (!valid)
+      throw std::runtime_error(std::format("{} is not a trade segment", path));
+    return words[1];
+  }
+};
+
+// The whole store: every segment in a directory, appended to at the end.
+class TradeStore {
+public:
+  // Opens the store in directory, creating it if needed. New segments get
+  // segmentCapacity rows; segments already there keep theirs.
+  explicit TradeStore(std::filesystem::path directory,
+                      std::size_t segmentCapacity = std::size_t{1} << 20)
+      : directory_{std::move(directory)},
+        segmentCapacity_{std::max<std::size_t>(segmentCapacity, 1)} {
+    std::filesystem::create_directories(directory_);
+    for (std::size_t index = 0;; ++index) {
+      const auto path = SegmentPath(index);
+      if (!std::filesystem::exists(path))
+        break;
+      segments_.push_back(std::make_unique<TradeSegment>(path.string()));
+    }
+    for (const auto &segment : segments_)
+      size_ += segment->Size();
+  }
+
+  TradeStore(const TradeStore &) = delete;
+  TradeStore &operator=(const TradeStore &) = delete;
+
+  void Append(const Trades &trades, Timestamp time) {
+    for (const auto &trade : trades)
+      Append(trade, time);
+  }
+
+  void Append(const Trade &trade, Timestamp time) {
+    if (segments_.empty() || segments_.back()->Full())
+      segments_.push_back(std::make_unique<TradeSegment>(
+          SegmentPath(segments_.size()).string(), segmentCapacity_, size_));
+    segments_.back()->Append(trade, time);
+    ++size_;
+  }
+
+  void Flush() {
+    for (const auto &segment : segments_)
+      segment->Flush();
+  }
+
+  std::uint64_t Size() const { return size_; }
+  std::size_t GetSegmentCount() const { return segments_.size(); }
+
+  Trade GetTrade(std::uint64_t index) const {
+    const auto &[segment, row] = Locate(index);
+    return segment.GetTrade(row);
+  }
+  Timestamp GetTime(std::uint64_t index) const {
+    const auto &[segment, row] = Locate(index);
+    return segment.GetTimes()[row];
+  }
+
+  // Quantity traded at prices in [minPrice, maxPrice], at times in
+  // [from, to].
+  std::uint64_t
+  GetVolume(Price minPrice, Price maxPrice, Timestamp from = 0,
+            Timestamp to = std::numeric_limits<Timestamp>::max()) const {
+    std::uint64_t volume = 0;
+    ForEachRange(from, to, [&](const TradeSegment &segment, std::size_t begin,
+                               std::size_t end) {
+      volume += trade_store::SumQuantity(segment.GetPrices() + begin,
+                                         segment.GetQuantities() + begin,
+                                         end - begin, minPrice, maxPrice);
+    });
+    return volume;
+  }
+
+  // Indexes of every trade orderId took part in, oldest first.
+  std::vector<std::uint64_t> FindTrades(OrderId orderId) const {
+    std::vector<std::uint64_t> found;
+    for (const auto &segment : segments_)
+      trade_store::FindOrder(segment->GetBidOrderIds(),
+                             segment->GetAskOrderIds(), segment->Size(),
+                             orderId, [&](std::size_t row) {
+                               found.push_back(segment->GetFirst() + row);
+                             });
+    return found;
+  }
+
+private:
+  std::filesystem::path directory_;
+  std::size_t segmentCapacity_;
+  std::vector<std::unique_ptr<TradeSegment>> segments_;
+  std::uint64_t size_{0};
+
+  std::filesystem::path SegmentPath(std::size_t index) const {
+    return directory_ / std::format("segment-{:06}.trades", index);
+  }
+
+  std::pair<const TradeSegment &, std::size_t>
+  Locate(std::uint64_t index) const {
+    if (index >= size_)
+      throw std::out_of_range(std::format("trade {} of {}", index, size_));
+    const auto it = std::upper_bound(
+        segments_.begin(), segments_.end(), index,
+        [](std::uint64_t index, const auto &segment) {
+          return index < segment->GetFirst();
+        });
+    const auto &segment = **std::prev(it);
+    return {segment, static_cast<std::size_t>(index - segment.GetFirst())};
+  }
+
+  // Calls range(segment, begin, end) with the rows of every segment whose
+  // times fall in [from, to].
+  template <typename Range>
+  void ForEachRange(Timestamp from, Timestamp to, Range &&range) const {
+    for (const auto &segment : segments_) {
+      const std::size_t count = segment->Size();
+      if (count == 0)
+        continue;
+      const Timestamp *times = segment->GetTimes();
+      if (times[count - 1] < from || times[0] > to)
+        continue;
+      const auto [begin, end] = segment->FindTimes(count, from, to);
+      if (begin < end)
+        range(*segment, begin, end);
+    }
+  }
+};
@@ -0,0 +1,584 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include "BookMemory.h"
+#include "MarketData.h"
+
+// Binary order-entry and market data protocol in the style of Simple Binary
+// Encoding: every message is an 8-byte header followed by a fixed-layout
+// little-endian block. Decoders and encoders are flyweights over a caller's
+// buffer, so nothing is copied or allocated, and a field is a single load or
+// store at a constant offset.
+//
+// Receivers skip a block by the header's blockLength, not by their own idea
+// of its size, so fields can be appended to a message without breaking older
+// readers. Optional fields use SBE's null values (the type's minimum for
+// signed integers, zero where zero has no other meaning).
+namespace wire {
+
+inline constexpr std::uint16_t SchemaId = 1;
+inline constexpr std::uint16_t SchemaVersion = 1;
+inline constexpr std::int64_t NullPrice = std::numeric_limits<std::int64_t>::min();
+
+enum class TemplateId : std::uint16_t {
+  NewOrder = 1,
+  Cancel = 2,
+  Modify = 3,
+  Ack = 4,
+  Reject = 5,
+  Trade = 6,
+  LevelUpdate = 7,
+  TopOfBook = 8,
+  Snapshot = 9,
+};
+
+enum class RejectReason : std::uint8_t {
+  Malformed = 1,
+  UnknownOrder = 2,
+  DuplicateOrder = 3,
+  InvalidQuantity = 4,
+  InvalidPrice = 5,
+  NotAccepted = 6,
+};
+
+template <typename T> T ToLittleEndian(T value) {
+  if constexpr (std::endian::native == std::endian::big && sizeof(T) > 1) {
+    using Unsigned = std::make_unsigned_t<T>;
+    auto bits = static_cast<Unsigned>(value);
+    if constexpr (sizeof(T) == 2)
+      bits = __builtin_bswap16(bits);
+    else if constexpr (sizeof(T) == 4)
+      bits = __builtin_bswap32(bits);
+    else
+      bits = __builtin_bswap64(bits);
+    return static_cast<T>(bits);
+  } else {
+    return value;
+  }
+}
+
+// memcpy compiles to a plain (possibly unaligned) move; fields are not
+// naturally aligned once messages are packed back to back in a stream.
+template <typename T> T Load(const std::byte *at) {
+  T value;
+  std::memcpy(&value, at, sizeof(T));
+  return ToLittleEndian(value);
+}
+
+template <typename T> void Store(std::byte *at, T value) {
+  value = ToLittleEndian(value);
+  std::memcpy(at, &value, sizeof(T));
+}
+
+class MessageHeader {
+public:
+  static constexpr std::size_t Size = 8;
+
+  explicit MessageHeader(const std::byte *buffer) : buffer_{buffer} {}
+
+  std::uint16_t GetBlockLength() const { return Load<std::uint16_t>(buffer_); }
+  TemplateId GetTemplateId() const {
+    return static_cast<TemplateId>(Load<std::uint16_t>(buffer_ + 2));
+  }
+  std::uint16_t GetSchemaId() const { return Load<std::uint16_t>(buffer_ + 4); }
+  std::uint16_t GetVersion() const { return Load<std::uint16_t>(buffer_ + 6); }
+
+  static void Write(std::byte *buffer, TemplateId templateId,
+                    std::uint16_t blockLength) {
+    Store<std::uint16_t>(buffer, blockLength);
+    Store<std::uint16_t>(buffer + 2, static_cast<std::uint16_t>(templateId));
+    Store<std::uint16_t>(buffer + 4, SchemaId);
+    Store<std::uint16_t>(buffer + 6, SchemaVersion);
+  }
+
+private:
+  const std::byte *buffer_;
+};
+
+// Shared by all decoders: a pointer to the block right after the header.
+class Decoder {
+public:
+  explicit Decoder(const std::byte *block) : block_{block} {}
+
+protected:
+  template <typename T> T Get(std::size_t offset) const {
+    return Load<T>(block_ + offset);
+  }
+
+private:
+  const std::byte *block_;
+};
+
+// Shared by all encoders; writes the header on construction.
+template <TemplateId Id, std::uint16_t Length> class Encoder {
+public:
+  static constexpr std::uint16_t BlockLength = Length;
+  static constexpr std::size_t Size = MessageHeader::Size + BlockLength;
+
+  explicit Encoder(std::byte *buffer) : block_{buffer + MessageHeader::Size} {
+    MessageHeader::Write(buffer, Id, BlockLength);
+  }
+
+protected:
+  template <typename T> void Set(std::size_t offset, T value) {
+    Store<T>(block_ + offset, value);
+  }
+
+private:
+  std::byte *block_;
+};
+
+// NewOrder block:
+//   0 orderId u64        24 expiry u64          44 peakQuantity u32
+//   8 price i64          32 stopPrice i64       48 side u8
+//  16 participantId u64  40 quantity u32        49 orderType u8
+//                                               50 postOnly u8
+//                                               51 selfTradePrevention u8
+class NewOrderDecoder : public Decoder {
+public:
+  static constexpr std::uint16_t BlockLength = 56;
+  using Decoder::Decoder;
+
+  OrderId GetOrderId() const { return Get<std::uint64_t>(0); }
+  Price GetPrice() const { return Get<std::int64_t>(8); }
+  ParticipantId GetParticipantId() const { return Get<std::uint64_t>(16); }
+  Timestamp GetExpiry() const { return Get<std::uint64_t>(24); }
+  // NullPrice unless the order is a stop.
+  Price GetStopPrice() const { return Get<std::int64_t>(32); }
+  Quantity GetQuantity() const { return Get<std::uint32_t>(40); }
+  // Zero unless the order is an iceberg.
+  Quantity GetPeakQuantity() const { return Get<std::uint32_t>(44); }
+  Side GetSide() const { return static_cast<Side>(Get<std::uint8_t>(48)); }
+  OrderType GetOrderType() const {
+    return static_cast<OrderType>(Get<std::uint8_t>(49));
+  }
+  PostOnly GetPostOnly() const {
+    return static_cast<PostOnly>(Get<std::uint8_t>(50));
+  }
+  SelfTradePrevention GetSelfTradePrevention() const {
+    return static_cast<SelfTradePrevention>(Get<std::uint8_t>(51));
+  }
+
+  // Enumerations in range, no post-only on an order type that never rests
+  // and a non-zero quantity; the book checks prices.
+  bool IsValid() const {
+    const auto type = Get<std::uint8_t>(49);
+    const auto postOnly = Get<std::uint8_t>(50);
+    const bool takesOnly =
+        type == static_cast<std::uint8_t>(OrderType::Market) ||
+        type == static_cast<std::uint8_t>(OrderType::FillOrkill);
+    return Get<std::uint8_t>(48) <= static_cast<std::uint8_t>(Side::Sell) &&
+           type <= static_cast<std::uint8_t>(OrderType::Day) &&
+           postOnly <= static_cast<std::uint8_t>(PostOnly::Slide) &&
+           (postOnly == static_cast<std::uint8_t>(PostOnly::None) ||
+            !takesOnly) &&
+           Get<std::uint8_t>(51) <=
+               static_cast<std::uint8_t>(SelfTradePrevention::Decrement) &&
+           GetQuantity() != 0;
+  }
+
+  // Builds the order with every attribute the message carries. Only call
+  // on a message that IsValid().
+  OrderPointer ToOrderPointer(OrderPool &orderPool) const {
+    auto order = orderPool.Acquire(GetOrderType(), GetOrderId(), GetSide(),
+                                   GetPrice(), GetQuantity(),
+                                   GetParticipantId(),
+                                   GetSelfTradePrevention());
+    if (GetPeakQuantity() != 0)
+      order->SetPeakQuantity(GetPeakQuantity());
+    if (GetStopPrice() != NullPrice)
+      order->SetStopPrice(GetStopPrice());
+    if (GetOrderType() == OrderType::GoodTillDate)
+      order->SetExpiry(GetExpiry());
+    order->SetPostOnly(GetPostOnly());
+    return order;
+  }
+};
+
+class NewOrderEncoder
+    : public Encoder<TemplateId::NewOrder, NewOrderDecoder::BlockLength> {
+public:
+  explicit NewOrderEncoder(std::byte *buffer) : Encoder{buffer} {
+    SetStopPrice(NullPrice);
+    SetPeakQuantity(0);
+    SetExpiry(0);
+    SetParticipantId(0);
+    SetPostOnly(PostOnly::None);
+    SetSelfTradePrevention(SelfTradePrevention::None);
+    Set<std::uint32_t>(52, 0);
+  }
+
+  NewOrderEncoder &SetOrderId(OrderId orderId) {
+    Set<std::uint64_t>(0, orderId);
+    return *this;
+  }
+  NewOrderEncoder &SetPrice(Price price) {
+    Set<std::int64_t>(8, price);
+    return *this;
+  }
+  NewOrderEncoder &SetParticipantId(ParticipantId participantId) {
+    Set<std::uint64_t>(16, participantId);
+    return *this;
+  }
+  NewOrderEncoder &SetExpiry(Timestamp expiry) {
+    Set<std::uint64_t>(24, expiry);
+    return *this;
+  }
+  NewOrderEncoder &SetStopPrice(Price stopPrice) {
+    Set<std::int64_t>(32, stopPrice);
+    return *this;
+  }
+  NewOrderEncoder &SetQuantity(Quantity quantity) {
+    Set<std::uint32_t>(40, quantity);
+    return *this;
+  }
+  NewOrderEncoder &SetPeakQuantity(Quantity peakQuantity) {
+    Set<std::uint32_t>(44, peakQuantity);
+    return *this;
+  }
+  NewOrderEncoder &SetSide(Side side) {
+    Set<std::uint8_t>(48, static_cast<std::uint8_t>(side));
+    return *this;
+  }
+  NewOrderEncoder &SetOrderType(OrderType orderType) {
+    Set<std::uint8_t>(49, static_cast<std::uint8_t>(orderType));
+    return *this;
+  }
+  NewOrderEncoder &SetPostOnly(PostOnly postOnly) {
+    Set<std::uint8_t>(50, static_cast<std::uint8_t>(postOnly));
+    return *this;
+  }
+  NewOrderEncoder &
+  SetSelfTradePrevention(SelfTradePrevention selfTradePrevention) {
+    Set<std::uint8_t>(51, static_cast<std::uint8_t>(selfTradePrevention));
+    return *this;
+  }
+
+  // Every field of an order that has not entered a book yet.
+  NewOrderEncoder &From(const Order &order) {
+    SetOrderId(order.GetOrderId())
+        .SetPrice(order.GetPrice())
+        .SetParticipantId(order.GetParticipantId())
+        .SetExpiry(order.GetExpiry())
+        .SetStopPrice(order.IsStopPending() ? order.GetStopPrice() : NullPrice)
+        .SetQuantity(order.GetOpenQuantity())
+        .SetPeakQuantity(order.GetPeakQuantity())
+        .SetSide(order.GetSide())
+        .SetOrderType(order.GetOrderType())
+        .SetPostOnly(order.GetPostOnly())
+        .SetSelfTradePrevention(order.GetSelfTradePrevention());
+    return *this;
+  }
+};
+
+// Cancel block: 0 orderId u64
+// From the engine it is unsolicited and tells the owner that the book removed
+// what was left of an order on its own: expiry, self-trade prevention, or the
+// unfilled rest of a Market or FillOrkill order.
+class CancelDecoder : public Decoder {
+public:
+  static constexpr std::uint16_t BlockLength = 8;
+  using Decoder::Decoder;
+
+  OrderId GetOrderId() const { return Get<std::uint64_t>(0); }
+};
+
+class CancelEncoder
+    : public Encoder<TemplateId::Cancel, CancelDecoder::BlockLength> {
+public:
+  using Encoder::Encoder;
+
+  CancelEncoder &SetOrderId(OrderId orderId) {
+    Set<std::uint64_t>(0, orderId);
+    return *this;
+  }
+};
+
+// Modify block: 0 orderId u64, 8 price i64, 16 quantity u32, 20 side u8
+class ModifyDecoder : public Decoder {
+public:
+  static constexpr std::uint16_t BlockLength = 24;
+  using Decoder::Decoder;
+
+  OrderId GetOrderId() const { return Get<std::uint64_t>(0); }
+  Price GetPrice() const { return Get<std::int64_t>(8); }
+  Quantity GetQuantity() const { return Get<std::uint32_t>(16); }
+  Side GetSide() const { return static_cast<Side>(Get<std::uint8_t>(20)); }
+
+  bool IsValid() const {
+    return Get<std::uint8_t>(20) <= static_cast<std::uint8_t>(Side::Sell) &&
+           GetQuantity() != 0;
+  }
+
+  OrderModify ToOrderModify() const {
+    return OrderModify{GetOrderId(), GetSide(), GetPrice(), GetQuantity()};
+  }
+};
+
+class ModifyEncoder
+    : public Encoder<TemplateId::Modify, ModifyDecoder::BlockLength> {
+public:
+  explicit ModifyEncoder(std::byte *buffer) : Encoder{buffer} {
+    Set<std::uint8_t>(21, 0);
+    Set<std::uint16_t>(22, 0);
+  }
+
+  ModifyEncoder &From(const OrderModify &modify) {
+    Set<std::uint64_t>(0, modify.GetOrderId());
+    Set<std::int64_t>(8, modify.GetPrice());
+    Set<std::uint32_t>(16, modify.GetQuantity());
+    Set<std::uint8_t>(20, static_cast<std::uint8_t>(modify.GetSide()));
+    return *this;
+  }
+};
+
+// Ack block: 0 orderId u64, 8 timestamp u64 (engine time of acceptance)
+class AckDecoder : public Decoder {
+public:
+  static constexpr std::uint16_t BlockLength = 16;
+  using Decoder::Decoder;
+
+  OrderId GetOrderId() const { return Get<std::uint64_t>(0); }
+  Timestamp GetTimestamp() const { return Get<std::uint64_t>(8); }
+};
+
+class AckEncoder : public Encoder<TemplateId::Ack, AckDecoder::BlockLength> {
+public:
+  using Encoder::Encoder;
+
+  AckEncoder &SetOrderId(OrderId orderId) {
+    Set<std::uint64_t>(0, orderId);
+    return *this;
+  }
+  AckEncoder &SetTimestamp(Timestamp timestamp) {
+    Set<std::uint64_t>(8, timestamp);
+    return *this;
+  }
+};
+
+// Reject block: 0 orderId u64, 8 reason u8
+class RejectDecoder : public Decoder {
+public:
+  static constexpr std::uint16_t BlockLength = 16;
+  using Decoder::Decoder;
+
+  OrderId GetOrderId() const { return Get<std::uint64_t>(0); }
+  RejectReason GetReason() const {
+    return static_cast<RejectReason>(Get<std::uint8_t>(8));
+  }
+};
+
+class RejectEncoder
+    : public Encoder<TemplateId::Reject, RejectDecoder::BlockLength> {
+public:
+  explicit RejectEncoder(std::byte *buffer) : Encoder{buffer} {
+    Set<std::uint64_t>(8, 0);
+  }
+
+  RejectEncoder &SetOrderId(OrderId orderId) {
+    Set<std::uint64_t>(0, orderId);
+    return *this;
+  }
+  RejectEncoder &SetReason(RejectReason reason) {
+    Set<std::uint8_t>(8, static_cast<std::uint8_t>(reason));
+    return *this;
+  }
+};
+
+// Trade block, one TradeInfo per side:
+//   0 bidOrderId u64, 8 bidPrice i64, 16 bidQuantity u32, 20 aggressor u8,
+//  24 askOrderId u64, 32 askPrice i64, 40 askQuantity u32
+class TradeDecoder : public Decoder {
+public:
+  static constexpr std::uint16_t BlockLength = 48;
+  using Decoder::Decoder;
+
+  TradeInfo GetBidTrade() const { return GetTradeInfo(0); }
+  TradeInfo GetAskTrade() const { return GetTradeInfo(24); }
+  Side GetAggressorSide() const {
+    return static_cast<Side>(Get<std::uint8_t>(20));
+  }
+  ::Trade ToTrade() const {
+    return ::Trade{GetBidTrade(), GetAskTrade(), GetAggressorSide()};
+  }
+
+private:
+  TradeInfo GetTradeInfo(std::size_t offset) const {
+    return TradeInfo{Get<std::uint64_t>(offset), Get<std::int64_t>(offset + 8),
+                     Get<std::uint32_t>(offset + 16)};
+  }
+};
+
+class TradeEncoder
+    : public Encoder<TemplateId::Trade, TradeDecoder::BlockLength> {
+public:
+  using Encoder::Encoder;
+
+  TradeEncoder &From(const ::Trade &trade) {
+    SetTradeInfo(0, trade.GetBidTrade());
+    SetTradeInfo(24, trade.GetAskTrade());
+    Set<std::uint8_t>(20, static_cast<std::uint8_t>(trade.GetAggressorSide()));
+    return *this;
+  }
+
+private:
+  void SetTradeInfo(std::size_t offset, const TradeInfo &info) {
+    Set<std::uint64_t>(offset, info.orderId_);
+    Set<std::int64_t>(offset + 8, info.price_);
+    Set<std::uint32_t>(offset + 16, info.quantity_);
+    Set<std::uint32_t>(offset + 20, 0);
+  }
+};
+
+// LevelUpdate block: 0 price i64, 8 quantity u32, 12 side u8
+class LevelUpdateDecoder : public Decoder {
+public:
+  static constexpr std::uint16_t BlockLength = 16;
+  using Decoder::Decoder;
+
+  Price GetPrice() const { return Get<std::int64_t>(0); }
+  Quantity GetQuantity() const { return Get<std::uint32_t>(8); }
+  Side GetSide() const { return static_cast<Side>(Get<std::uint8_t>(12)); }
+  ::LevelUpdate ToLevelUpdate() const {
+    return ::LevelUpdate{GetSide(), GetPrice(), GetQuantity()};
+  }
+};
+
+class LevelUpdateEncoder
+    : public Encoder<TemplateId::LevelUpdate, LevelUpdateDecoder::BlockLength> {
+public:
+  explicit LevelUpdateEncoder(std::byte *buffer) : Encoder{buffer} {
+    Set<std::uint32_t>(12, 0);
+  }
+
+  LevelUpdateEncoder &From(const ::LevelUpdate &update) {
+    Set<std::int64_t>(0, update.price_);
+    Set<std::uint32_t>(8, update.quantity_);
+    Set<std::uint8_t>(12, static_cast<std::uint8_t>(update.side_));
+    return *this;
+  }
+};
+
+// TopOfBook block:
+//   0 bidPrice i64, 8 askPrice i64, 16 bidQuantity u32, 20 askQuantity u32
+class TopOfBookDecoder : public Decoder {
+public:
+  static constexpr std::uint16_t BlockLength = 24;
+  using Decoder::Decoder;
+
+  ::TopOfBook ToTopOfBook() const {
+    return ::TopOfBook{Get<std::int64_t>(0), Get<std::uint32_t>(16),
+                       Get<std::int64_t>(8), Get<std::uint32_t>(20)};
+  }
+};
+
+class TopOfBookEncoder
+    : public Encoder<TemplateId::TopOfBook, TopOfBookDecoder::BlockLength> {
+public:
+  using Encoder::Encoder;
+
+  TopOfBookEncoder &From(const ::TopOfBook &topOfBook) {
+    Set<std::int64_t>(0, topOfBook.bidPrice_);
+    Set<std::int64_t>(8, topOfBook.askPrice_);
+    Set<std::uint32_t>(16, topOfBook.bidQuantity_);
+    Set<std::uint32_t>(20, topOfBook.askQuantity_);
+    return *this;
+  }
+};
+
+// Snapshot block, first message of every packet of a book snapshot; the
+// LevelUpdates that follow it are the fragment's share of the levels:
+//   0 lastSequence u64 (last incremental message the snapshot reflects),
+//   8 fragment u16, 10 fragmentCount u16
+class SnapshotDecoder : public Decoder {
+public:
+  static constexpr std::uint16_t BlockLength = 16;
+  using Decoder::Decoder;
+
+  std::uint64_t GetLastSequence() const { return Get<std::uint64_t>(0); }
+  std::uint16_t GetFragment() const { return Get<std::uint16_t>(8); }
+  std::uint16_t GetFragmentCount() const { return Get<std::uint16_t>(10); }
+};
+
+class SnapshotEncoder
+    : public Encoder<TemplateId::Snapshot, SnapshotDecoder::BlockLength> {
+public:
+  explicit SnapshotEncoder(std::byte *buffer) : Encoder{buffer} {
+    Set<std::uint32_t>(12, 0);
+  }
+
+  SnapshotEncoder &SetLastSequence(std::uint64_t sequence) {
+    Set<std::uint64_t>(0, sequence);
+    return *this;
+  }
+  SnapshotEncoder &SetFragment(std::uint16_t fragment,
+                               std::uint16_t fragmentCount) {
+    Set<std::uint16_t>(8, fragment);
+    Set<std::uint16_t>(10, fragmentCount);
+    return *this;
+  }
+};
+
+// Decodes the message at the front of [buffer, buffer + size) and calls
+// handler with its decoder: NewOrderDecoder, CancelDecoder, ModifyDecoder,
+// AckDecoder, RejectDecoder, TradeDecoder, LevelUpdateDecoder,
+// TopOfBookDecoder or SnapshotDecoder. Returns the bytes the message
+// occupies, or 0 if the buffer does not hold all of it yet. Messages of
+// another schema, unknown templates and blocks shorter than the decoder
+// needs are skipped without calling handler.
+template <typename Handler>
+std::size_t Decode(const std::byte *buffer, std::size_t size,
+                   Handler &&handler) {
+  if (size < MessageHeader::Size)
+    return 0;
+  const MessageHeader header{buffer};
+  const std::size_t length = MessageHeader::Size + header.GetBlockLength();
+  if (size < length)
+    return 0;
+  if (header.GetSchemaId() != SchemaId)
+    return length;
+
+  const std::byte *block = buffer + MessageHeader::Size;
+  auto dispatch = [&]<typename Decoder>() {
+    if (header.GetBlockLength() >= Decoder::BlockLength)
+      handler(Decoder{block});
+  };
+  switch (header.GetTemplateId()) {
+  case TemplateId::NewOrder:
+    dispatch.template operator()<NewOrderDecoder>();
+    break;
+  case TemplateId::Cancel:
+    dispatch.template operator()<CancelDecoder>();
+    break;
+  case TemplateId::Modify:
+    dispatch.template operator()<ModifyDecoder>();
+    break;
+  case TemplateId::Ack:
+    dispatch.template operator()<AckDecoder>();
+    break;
+  case TemplateId::Reject:
+    dispatch.template operator()<RejectDecoder>();
+    break;
+  case TemplateId::Trade:
+    dispatch.template operator()<TradeDecoder>();
+    break;
+  case TemplateId::LevelUpdate:
+    dispatch.template operator()<LevelUpdateDecoder>();
+    break;
+  case TemplateId::TopOfBook:
+    dispatch.template operator()<TopOfBookDecoder>();
+    break;
+  case TemplateId::Snapshot:
+    dispatch.template operator()<SnapshotDecoder>();
+    break;
+  }
+  return length;
+}
+
+} // namespace wire
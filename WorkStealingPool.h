@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task deque. Submit() deals
+// tasks out round robin; a worker runs its own tasks oldest first and, once
+// its deque is empty, steals the oldest task of another worker, so a few
+// long tasks at the end never leave the other threads idle. Tasks therefore
+// start in roughly the order they were submitted: submitting the longest
+// first makes them start first. The tasks are too coarse for the cache
+// locality of running the newest first to matter.
+//
+// Tasks are told which worker runs them, so callers can keep per-worker
+// state (pools, scratch buffers) indexed by it without any locking. They are
+// meant to be coarse, like replaying a whole file: each deque is guarded by
+// its own mutex, which costs nothing next to such a task.
+class WorkStealingPool {
+public:
+  using Task = std::function<void(std::size_t worker)>;
+
+  explicit WorkStealingPool(std::size_t threads)
+      : queues_(std::max<std::size_t>(threads, 1)) {
+    workers_.reserve(queues_.size());
+    for (std::size_t worker = 0; worker < queues_.size(); ++worker)
+      workers_.emplace_back([this, worker] { Run(worker); });
+  }
+
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  // Runs every task already submitted, then stops the workers.
+  ~WorkStealingPool() {
+    {
+      std::lock_guard lock{mutex_};
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto &worker : workers_)
+      worker.join();
+  }
+
+  void Submit(Task task) {
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    auto &queue = queues_[next_++ % queues_.size()];
+    {
+      std::lock_guard lock{queue.mutex_};
+      queue.tasks_.push_back(std::move(task));
+    }
+    // Counted under mutex_ so a worker about to sleep cannot miss it.
+    {
+      std::lock_guard lock{mutex_};
+      ++queued_;
+    }
+    wake_.notify_one();
+  }
+
+  // Blocks until every task submitted so far has finished.
+  void Wait() {
+    std::unique_lock lock{mutex_};
+    idle_.wait(lock, [this] {
+      return pending_.load(std::memory_order_acquire) == 0;
+    });
+  }
+
+  std::size_t GetThreadCount() const { return workers_.size(); }
+  std::uint64_t GetSteals() const {
+    return steals_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct alignas(64) Queue {
+    std::mutex mutex_;
+    std::deque<Task> tasks_;
+  };
+
+  std::vector<Queue> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<std::size_t> next_{0};
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  // Tasks sitting in some deque, and tasks submitted but not yet finished.
+  std::atomic<std::size_t> queued_{0};
+  std::atomic<std::size_t> pending_{0};
+  std::atomic<std::uint64_t> steals_{0};
+  bool stopping_{false};
+
+  bool TryPop(std::size_t worker, Task &task) {
+    auto &queue = queues_[worker];
+    std::lock_guard lock{queue.mutex_};
+    if (queue.tasks_.empty())
+      return false;
+    task = std::move(queue.tasks_.front());
+    queue.tasks_.pop_front();
+    return true;
+  }
+
+  bool TrySteal(std::size_t worker, Task &task) {
+    for (std::size_t i = 1; i < queues_.size(); ++i) {
+      auto &queue = queues_[(worker + i) % queues_.size()];
+      std::lock_guard lock{queue.mutex_};
+      if (queue.tasks_.empty())
+        continue;
+      task = std::move(queue.tasks_.front());
+      queue.tasks_.pop_front();
+      steals_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
+
+  void Run(std::size_t worker) {
+    for (;;) {
+      Task task;
+      if (TryPop(worker, task) || TrySteal(worker, task)) {
+        queued_.fetch_sub(1, std::memory_order_relaxed);
+        task(worker);
+        if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+          { std::lock_guard lock{mutex_}; }
+          idle_.notify_all();
+        }
+        continue;
+      }
+      std::unique_lock lock{mutex_};
+      wake_.wait(lock, [this] { return stopping_ || queued_ != 0; });
+      if (stopping_ && queued_ == 0)
+        return;
+    }
+  }
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// xorshift64: cheap and reproducible, which is all the benchmarks and load
+// generators need to make up order flow. The same seed gives the same flow
+// on every run, so runs of different builds can be compared.
+class XorShift {
+public:
+  explicit XorShift(std::uint64_t seed = 0x853C49E6748FEA9Bull)
+      : state_{seed} {}
+
+  std::uint64_t operator()() {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 7;
+    state_ ^= state_ << 17;
+    return state_;
+  }
+
+private:
+  std::uint64_t state_;
+};
+
+// Wall-clock seconds function() took.
+template <typename Function> double Time(Function &&function) {
+  const auto start = std::chrono::steady_clock::now();
+  function();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
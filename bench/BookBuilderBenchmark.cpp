@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "../BookBuilder.h"
+#include "../BookMemory.h"
+#include "../replay/Itch.h"
+#include "BenchUtil.h"
+
+// Applies one market-by-order event stream to a BookBuilder and, for
+// comparison, maps the same events onto a matching OrderBook the way a
+// consumer without a builder would: executions and partial cancels become
+// quantity-reducing modifies, replaces a cancel and a new order. Both books
+// must end with the same levels.
+//
+// The stream is either the order messages of one symbol of a NASDAQ ITCH 5.0
+// file, or generated with the shape of an ITCH day for a liquid name:
+// roughly half adds, most of the rest deletes, a few executions, partial
+// cancels and replaces, with prices around a slowly drifting mid and never
+// crossing.
+struct Event {
+  enum class Type : std::uint8_t { Add, Execute, Reduce, Delete, Replace };
+  Type type_;
+  Side side_;
+  OrderId orderId_;
+  OrderId newOrderId_;
+  Price price_;
+  Quantity quantity_;
+  // What a matching book needs but an L3 feed does not carry.
+  Quantity remaining_;
+};
+
+static std::vector<Event> Generate(std::size_t count, std::size_t resting) {
+  XorShift next;
+
+  // The stream is generated against a builder, which knows where the book
+  // is, and a list of live ids to pick from.
+  BookBuilder model;
+  std::vector<OrderId> live;
+  std::vector<std::pair<Side, Price>> placed(1);
+  std::vector<Event> events;
+  events.reserve(count);
+  Price mid = 10'000;
+  OrderId nextOrderId = 1;
+
+  auto place = [&](Side side) {
+    // Ticks away from mid, geometric with mean 4.
+    const auto top = model.GetTopOfBook();
+    Price offset = 1;
+    for (auto bits = next(); offset < 32 && bits % 4 != 0; bits >>= 2)
+      ++offset;
+    if (side == Side::Buy)
+      return top.askQuantity_ ? std::min(mid - offset, top.askPrice_ - 1)
+                              : mid - offset;
+    return top.bidQuantity_ ? std::max(mid + offset, top.bidPrice_ + 1)
+                            : mid + offset;
+  };
+
+  while (events.size() < count) {
+    const auto r = next();
+    if (r % 1000 == 0)
+      mid += (r >> 10) % 2 ? 1 : -1;
+    const unsigned kind = (r >> 20) % 100;
+
+    if (live.size() < resting / 2 || (kind < 50 && live.size() < 2 * resting)) {
+      const Side side = (r >> 32) % 2 ? Side::Sell : Side::Buy;
+      const Price price = place(side);
+      const auto quantity = static_cast<Quantity>(100 * (1 + (r >> 40) % 10));
+      model.AddOrder(nextOrderId, side, price, quantity);
+      placed.emplace_back(side, price);
+      events.push_back(Event{Event::Type::Add, side, nextOrderId, 0, price,
+                             quantity, quantity});
+      live.push_back(nextOrderId++);
+      continue;
+    }
+
+    const std::size_t index = (r >> 32) % live.size();
+    const OrderId orderId = live[index];
+    const auto [side, price] = placed[orderId];
+    const Quantity quantity = model.GetQuantity(orderId);
+    auto retire = [&] {
+      live[index] = live.back();
+      live.pop_back();
+    };
+
+    if (kind < 88) {
+      model.DeleteOrder(orderId);
+      events.push_back(
+          Event{Event::Type::Delete, side, orderId, 0, price, quantity, 0});
+      retire();
+    } else if (kind < 97) {
+      const bool executed = kind < 94;
+      const Quantity taken =
+          std::min<Quantity>(quantity, 100 * (1 + (r >> 40) % 3));
+      if (executed)
+        model.ExecuteOrder(orderId, taken);
+      else
+        model.ReduceOrder(orderId, taken);
+      events.push_back(Event{executed ? Event::Type::Execute
+                                      : Event::Type::Reduce,
+                             side, orderId, 0, price, taken, quantity - taken});
+      if (taken == quantity)
+        retire();
+    } else {
+      const Price newPrice = place(side);
+      model.ReplaceOrder(orderId, nextOrderId, newPrice, quantity);
+      placed.emplace_back(side, newPrice);
+      events.push_back(Event{Event::Type::Replace, side, orderId, nextOrderId,
+                             newPrice, quantity, quantity});
+      live[index] = nextOrderId++;
+    }
+  }
+  return events;
+}
+
+// The order messages of symbol in an ITCH 5.0 file, as events. Messages for
+// orders the file never added (it started mid-day) or for a reference
+// already in use are dropped, so both books get a stream they can apply.
+// The events are decoded before either book is timed, as the generated ones
+// are generated.
+static std::vector<Event> Load(const std::string &path,
+                               std::string_view symbol) {
+  const MappedFile file{path};
+  BookBuilder model;
+  std::unordered_map<OrderId, std::pair<Side, Price>> placed;
+  std::optional<std::uint16_t> locate;
+  std::vector<Event> events;
+
+  auto reduce = [&](Event::Type type, OrderId orderId, Quantity shares) {
+    const Quantity quantity = model.GetQuantity(orderId);
+    if (quantity == 0)
+      return;
+    const auto [side, price] = placed[orderId];
+    const Quantity taken = std::min(shares, quantity);
+    if (type == Event::Type::Execute)
+      model.ExecuteOrder(orderId, taken);
+    else
+      model.ReduceOrder(orderId, taken);
+    events.push_back(
+        Event{type, side, orderId, 0, price, taken, quantity - taken});
+    if (taken == quantity)
+      placed.erase(orderId);
+  };
+
+  itch::ForEachMessage(file.GetData(), file.GetSize(), [&](const auto &message) {
+    using View = std::decay_t<decltype(message)>;
+    if constexpr (std::is_same_v<View, itch::StockDirectory>) {
+      if (message.GetStock() == symbol)
+        locate = message.GetStockLocate();
+    } else if constexpr (!std::is_same_v<View, itch::Message>) {
+      if (message.GetStockLocate() != locate)
+        return;
+      if constexpr (std::is_same_v<View, itch::AddOrder>) {
+        const OrderId orderId = message.GetReference();
+        if (!model.AddOrder(orderId, message.GetSide(), message.GetPrice(),
+                            message.GetShares()))
+          return;
+        placed[orderId] = {message.GetSide(), message.GetPrice()};
+        events.push_back(Event{Event::Type::Add, message.GetSide(), orderId, 0,
+                               message.GetPrice(), message.GetShares(),
+                               message.GetShares()});
+      } else if constexpr (std::is_base_of_v<itch::OrderExecuted, View>) {
+        reduce(Event::Type::Execute, message.GetReference(),
+               message.GetExecutedShares());
+      } else if constexpr (std::is_same_v<View, itch::OrderCancel>) {
+        reduce(Event::Type::Reduce, message.GetReference(),
+               message.GetCancelledShares());
+      } else if constexpr (std::is_same_v<View, itch::OrderDelete>) {
+        const OrderId orderId = message.GetReference();
+        const Quantity quantity = model.GetQuantity(orderId);
+        if (!model.DeleteOrder(orderId))
+          return;
+        events.push_back(Event{Event::Type::Delete, placed[orderId].first,
+                               orderId, 0, placed[orderId].second, quantity,
+                               0});
+        placed.erase(orderId);
+      } else if constexpr (std::is_same_v<View, itch::OrderReplace>) {
+        const OrderId orderId = message.GetOriginalReference();
+        const OrderId newOrderId = message.GetNewReference();
+        if (!model.ReplaceOrder(orderId, newOrderId, message.GetPrice(),
+                                message.GetShares()))
+          return;
+        const Side side = placed[orderId].first;
+        placed.erase(orderId);
+        placed[newOrderId] = {side, message.GetPrice()};
+        events.push_back(Event{Event::Type::Replace, side, orderId, newOrderId,
+                               message.GetPrice(), message.GetShares(),
+                               message.GetShares()});
+      }
+    }
+  });
+  if (!locate)
+    throw std::runtime_error(
+        std::format("{} is not in the stock directory of {}", symbol, path));
+  return events;
+}
+
+static double Elapsed(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+static double RunBuilder(const std::vector<Event> &events,
+                         OrderBookLevelInfos &levels) {
+  BookBuilder builder;
+  builder.Reserve(1 << 16, 1024);
+  std::size_t rejected = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto &event : events) {
+    bool applied = false;
+    switch (event.type_) {
+    case Event::Type::Add:
+      applied = builder.AddOrder(event.orderId_, event.side_, event.price_,
+                                 event.quantity_);
+      break;
+    case Event::Type::Execute:
+      applied = builder.ExecuteOrder(event.orderId_, event.quantity_);
+      break;
+    case Event::Type::Reduce:
+      applied = builder.ReduceOrder(event.orderId_, event.quantity_);
+      break;
+    case Event::Type::Delete:
+      applied = builder.DeleteOrder(event.orderId_);
+      break;
+    case Event::Type::Replace:
+      applied = builder.ReplaceOrder(event.orderId_, event.newOrderId_,
+                                     event.price_, event.quantity_);
+      break;
+    }
+    rejected += !applied;
+  }
+  const double elapsed = Elapsed(start);
+  if (rejected != 0)
+    std::cerr << rejected << " events rejected by the builder\n";
+  levels = builder.GetLevelInfos();
+  return elapsed;
+}
+
+static double RunOrderBook(const std::vector<Event> &events,
+                           OrderBookLevelInfos &levels) {
+  OrderPool orderPool;
+  OrderBook orderBook;
+  WarmUp(orderBook, orderPool, 1 << 16, 1024);
+  std::size_t trades = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto &event : events) {
+    switch (event.type_) {
+    case Event::Type::Add:
+      trades += orderBook
+                    .AddOrder(orderPool.Acquire(OrderType::GoodTillCancel,
+                                                event.orderId_, event.side_,
+                                                event.price_, event.quantity_))
+                    .size();
+      break;
+    case Event::Type::Execute:
+    case Event::Type::Reduce:
+      if (event.remaining_ == 0)
+        orderBook.CancelOrder(event.orderId_);
+      else
+        trades += orderBook
+                      .MatchOrders(OrderModify{event.orderId_, event.side_,
+                                               event.price_, event.remaining_})
+                      .size();
+      break;
+    case Event::Type::Delete:
+      orderBook.CancelOrder(event.orderId_);
+      break;
+    case Event::Type::Replace:
+      orderBook.CancelOrder(event.orderId_);
+      trades += orderBook
+                    .AddOrder(orderPool.Acquire(OrderType::GoodTillCancel,
+                                                event.newOrderId_, event.side_,
+                                                event.price_, event.quantity_))
+                    .size();
+      break;
+    }
+  }
+  const double elapsed = Elapsed(start);
+  if (trades != 0)
+    std::cerr << trades << " trades in a stream that never crosses\n";
+  levels = orderBook.GetLevelInfos();
+  return elapsed;
+}
+
+static bool Same(const LevelInfos &left, const LevelInfos &right) {
+  return left.size() == right.size() &&
+         std::equal(left.begin(), left.end(), right.begin(),
+                    [](const LevelInfo &l, const LevelInfo &r) {
+                      return l.price_ == r.price_ && l.quantity_ == r.quantity_;
+                    });
+}
+
+int main(int argc, char **argv) {
+  // [count=10M] [resting=20000] for a generated stream, or an ITCH 5.0 file
+  // and the symbol to take from it.
+  std::vector<Event> events;
+  if (argc > 1 && !std::isdigit(static_cast<unsigned char>(argv[1][0]))) {
+    if (argc < 3) {
+      std::cerr << "usage: " << argv[0] << " itch-file symbol\n";
+      return 1;
+    }
+    events = Load(argv[1], argv[2]);
+    std::cout << events.size() << " order events for " << argv[2] << '\n';
+  } else {
+    events = Generate(argc > 1 ? std::stoul(argv[1]) : 10'000'000,
+                      argc > 2 ? std::stoul(argv[2]) : 20'000);
+  }
+  const std::size_t count = events.size();
+
+  for (int round = 0; round < 3; ++round) {
+    OrderBookLevelInfos builderLevels{{}, {}}, bookLevels{{}, {}};
+    const double builder = RunBuilder(events, builderLevels);
+    const double book = RunOrderBook(events, bookLevels);
+    const bool same =
+        Same(builderLevels.GetBids(), bookLevels.GetBids()) &&
+        Same(builderLevels.GetAsks(), bookLevels.GetAsks());
+    std::cout << "BookBuilder: " << builder / count << " ns/event ("
+              << count / builder * 1e3 << "M events/s), OrderBook: "
+              << book / count << " ns/event (" << count / book * 1e3
+              << "M events/s), levels " << (same ? "match" : "DIFFER") << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,188 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../WireProtocol.h"
+#include "BenchUtil.h"
+#include "orderbook.pb.h"
+
+// Encode and decode cost of a NewOrder and a Trade in the binary wire format
+// against the protobuf messages of the gRPC service. Each run encodes count
+// messages back to back into one buffer and then decodes all of them,
+// reading every field, so both codecs do the same work per message.
+
+static void Report(const std::string &name, std::size_t count,
+                   std::size_t bytes, double encode, double decode,
+                   std::uint64_t checksum) {
+  std::cout << name << ": encode " << encode * 1e9 / count << " ns, decode "
+            << decode * 1e9 / count << " ns, "
+            << static_cast<double>(bytes) / count
+            << " bytes/msg (checksum " << checksum << ")\n";
+}
+
+static void WireNewOrders(std::size_t count) {
+  std::vector<std::byte> buffer(count * wire::NewOrderEncoder::Size);
+  const double encode = Time([&] {
+    std::byte *at = buffer.data();
+    for (std::size_t i = 0; i < count; ++i, at += wire::NewOrderEncoder::Size)
+      wire::NewOrderEncoder{at}
+          .SetOrderId(i + 1)
+          .SetPrice(static_cast<Price>(1000 + i % 20))
+          .SetQuantity(static_cast<Quantity>(1 + i % 100))
+          .SetParticipantId(i % 64)
+          .SetSide(i % 2 ? Side::Sell : Side::Buy)
+          .SetOrderType(OrderType::GoodTillCancel);
+  });
+
+  std::uint64_t checksum = 0;
+  const double decode = Time([&] {
+    const std::byte *at = buffer.data();
+    const std::byte *end = at + buffer.size();
+    while (at < end) {
+      at += wire::Decode(at, end - at, [&](const auto &message) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(message)>,
+                                     wire::NewOrderDecoder>) {
+          checksum += message.GetOrderId() + message.GetPrice() +
+                      message.GetQuantity() + message.GetParticipantId() +
+                      static_cast<std::uint64_t>(message.GetSide()) +
+                      static_cast<std::uint64_t>(message.GetOrderType()) +
+                      message.IsValid();
+        }
+      });
+    }
+  });
+  Report("wire     NewOrder", count, buffer.size(), encode, decode, checksum);
+}
+
+// Length-prefixed, as a protobuf stream would have to be framed.
+static void ProtobufNewOrders(std::size_t count) {
+  std::vector<std::uint8_t> buffer(count * 64);
+  std::size_t used = 0;
+  const double encode = Time([&] {
+    orderbook::AddOrderRequest request;
+    for (std::size_t i = 0; i < count; ++i) {
+      request.set_order_id(i + 1);
+      request.set_price(static_cast<std::int64_t>(1000 + i % 20));
+      request.set_quantity(static_cast<std::uint32_t>(1 + i % 100));
+      request.set_participant_id(i % 64);
+      request.set_side(i % 2 ? orderbook::SELL : orderbook::BUY);
+      request.set_type(orderbook::GOOD_TILL_CANCEL);
+      const auto size = static_cast<std::uint8_t>(request.ByteSizeLong());
+      buffer[used++] = size;
+      request.SerializeWithCachedSizesToArray(buffer.data() + used);
+      used += size;
+    }
+  });
+
+  std::uint64_t checksum = 0;
+  const double decode = Time([&] {
+    orderbook::AddOrderRequest request;
+    for (std::size_t at = 0; at < used;) {
+      const std::size_t size = buffer[at++];
+      request.ParseFromArray(buffer.data() + at, static_cast<int>(size));
+      at += size;
+      checksum += request.order_id() + request.price() + request.quantity() +
+                  request.participant_id() + request.side() + request.type() +
+                  (request.quantity() != 0);
+    }
+  });
+  Report("protobuf NewOrder", count, used, encode, decode, checksum);
+}
+
+static Trade MakeTrade(std::size_t i) {
+  const auto quantity = static_cast<Quantity>(1 + i % 100);
+  return Trade{TradeInfo{2 * i + 1, static_cast<Price>(1000 + i % 20), quantity},
+               TradeInfo{2 * i + 2, static_cast<Price>(1000 + i % 20), quantity},
+               i % 2 ? Side::Sell : Side::Buy};
+}
+
+static std::uint64_t Checksum(const TradeInfo &info) {
+  return info.orderId_ + info.price_ + info.quantity_;
+}
+
+static void WireTrades(std::size_t count) {
+  std::vector<std::byte> buffer(count * wire::TradeEncoder::Size);
+  const double encode = Time([&] {
+    std::byte *at = buffer.data();
+    for (std::size_t i = 0; i < count; ++i, at += wire::TradeEncoder::Size)
+      wire::TradeEncoder{at}.From(MakeTrade(i));
+  });
+
+  std::uint64_t checksum = 0;
+  const double decode = Time([&] {
+    const std::byte *at = buffer.data();
+    const std::byte *end = at + buffer.size();
+    while (at < end) {
+      at += wire::Decode(at, end - at, [&](const auto &message) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(message)>,
+                                     wire::TradeDecoder>) {
+          const auto trade = message.ToTrade();
+          checksum += Checksum(trade.GetBidTrade()) +
+                      Checksum(trade.GetAskTrade()) +
+                      static_cast<std::uint64_t>(trade.GetAggressorSide());
+        }
+      });
+    }
+  });
+  Report("wire     Trade   ", count, buffer.size(), encode, decode, checksum);
+}
+
+static void ToProto(const TradeInfo &info, orderbook::TradeInfo &out) {
+  out.set_order_id(info.orderId_);
+  out.set_price(info.price_);
+  out.set_quantity(info.quantity_);
+}
+
+static TradeInfo FromProto(const orderbook::TradeInfo &info) {
+  return TradeInfo{info.order_id(), info.price(), info.quantity()};
+}
+
+static void ProtobufTrades(std::size_t count) {
+  std::vector<std::uint8_t> buffer(count * 64);
+  std::size_t used = 0;
+  const double encode = Time([&] {
+    orderbook::Trade message;
+    for (std::size_t i = 0; i < count; ++i) {
+      const auto trade = MakeTrade(i);
+      ToProto(trade.GetBidTrade(), *message.mutable_bid());
+      ToProto(trade.GetAskTrade(), *message.mutable_ask());
+      message.set_aggressor(trade.GetAggressorSide() == Side::Buy
+                                ? orderbook::BUY
+                                : orderbook::SELL);
+      const auto size = static_cast<std::uint8_t>(message.ByteSizeLong());
+      buffer[used++] = size;
+      message.SerializeWithCachedSizesToArray(buffer.data() + used);
+      used += size;
+    }
+  });
+
+  std::uint64_t checksum = 0;
+  const double decode = Time([&] {
+    orderbook::Trade message;
+    for (std::size_t at = 0; at < used;) {
+      const std::size_t size = buffer[at++];
+      message.ParseFromArray(buffer.data() + at, static_cast<int>(size));
+      at += size;
+      const Trade trade{FromProto(message.bid()), FromProto(message.ask()),
+                        message.aggressor() == orderbook::BUY ? Side::Buy
+                                                              : Side::Sell};
+      checksum += Checksum(trade.GetBidTrade()) + Checksum(trade.GetAskTrade()) +
+                  static_cast<std::uint64_t>(trade.GetAggressorSide());
+    }
+  });
+  Report("protobuf Trade   ", count, used, encode, decode, checksum);
+}
+
+int main(int argc, char **argv) {
+  const std::size_t count = argc > 1 ? std::stoul(argv[1]) : 1'000'000;
+  for (int round = 0; round < 3; ++round) {
+    WireNewOrders(count);
+    ProtobufNewOrders(count);
+    WireTrades(count);
+    ProtobufTrades(count);
+  }
+  return 0;
+}
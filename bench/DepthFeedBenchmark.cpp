@@ -0,0 +1,99 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Orderbook.h"
+
+// One writer publishes a new depth through a DepthFeed as fast as it can
+// while reader threads load it and check every copy for tearing. Snapshot n
+// is built entirely from n: every quantity is n, prices step away from a
+// mid of n, and the level counts cycle with n. So a copy that mixes two
+// stores shows up as quantities that differ, prices that do not match
+// them, or entries set past the counts. Readers also check that the
+// versions they see never go backwards.
+static constexpr std::size_t Depth = 10;
+static constexpr Price Mid = 1'000'000;
+
+static DepthSnapshot<Depth> Make(Quantity n) {
+  DepthSnapshot<Depth> depth;
+  depth.bidCount_ = depth.askCount_ = 1 + n % Depth;
+  for (std::uint32_t i = 0; i < depth.bidCount_; ++i) {
+    depth.bids_[i] = LevelInfo{Mid + n - i, n};
+    depth.asks_[i] = LevelInfo{Mid + n + 1 + i, n};
+  }
+  return depth;
+}
+
+static bool Consistent(const DepthSnapshot<Depth> &depth) {
+  if (depth.bidCount_ == 0)
+    return depth == DepthSnapshot<Depth>{};
+  const Quantity n = depth.bids_[0].quantity_;
+  return depth.bidCount_ == 1 + n % Depth && depth == Make(n);
+}
+
+struct ReaderResult {
+  std::uint64_t loads_{0};
+  std::uint64_t retries_{0};
+  std::uint64_t torn_{0};
+  std::uint64_t backwards_{0};
+};
+
+int main(int argc, char **argv) {
+  const unsigned readers = argc > 1 ? std::stoul(argv[1]) : 3;
+  const double seconds = argc > 2 ? std::stod(argv[2]) : 2.0;
+
+  DepthFeed<Depth> feed;
+  std::atomic<bool> stop{false};
+  std::vector<ReaderResult> results(readers);
+  std::vector<std::thread> threads;
+  for (unsigned r = 0; r < readers; ++r) {
+    threads.emplace_back([&feed, &stop, &result = results[r]] {
+      Quantity last = 0;
+      DepthSnapshot<Depth> depth;
+      while (!stop.load(std::memory_order_relaxed)) {
+        if (!feed.TryLoad(depth)) {
+          ++result.retries_;
+          continue;
+        }
+        ++result.loads_;
+        if (!Consistent(depth)) {
+          ++result.torn_;
+          continue;
+        }
+        const Quantity n = depth.bids_[0].quantity_;
+        result.backwards_ += n < last;
+        last = n;
+      }
+    });
+  }
+
+  std::uint64_t published = 0;
+  const auto start = std::chrono::steady_clock::now();
+  const auto end = start + std::chrono::duration<double>(seconds);
+  for (Quantity n = 1; std::chrono::steady_clock::now() < end; ++n)
+    published += feed.Publish(Make(n));
+  stop = true;
+  for (auto &thread : threads)
+    thread.join();
+  const double elapsed = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+  std::cout << published / elapsed / 1e6 << "M depth stores/s, version "
+            << feed.GetVersion() << '\n';
+  bool clean = feed.GetVersion() == published;
+  for (unsigned r = 0; r < readers; ++r) {
+    const auto &result = results[r];
+    std::cout << "reader " << r << ": " << result.loads_ / elapsed / 1e6
+              << "M loads/s, " << result.retries_ << " retries, "
+              << result.torn_ << " torn, " << result.backwards_
+              << " out of order\n";
+    clean &= result.torn_ == 0 && result.backwards_ == 0;
+  }
+  std::cout << (clean ? "no torn snapshots" : "TORN SNAPSHOTS") << std::endl;
+  return clean ? 0 : 1;
+}
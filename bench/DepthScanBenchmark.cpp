@@ -0,0 +1,137 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../BookBuilder.h"
+#include "../DepthLadder.h"
+#include "BenchUtil.h"
+
+// Fills the ask side of a book with levels levels of random size and answers
+// depth queries against it, for buy orders of random size: the level at
+// which the order would be filled, a fill-or-kill check against a limit,
+// and the quantity within that limit. They are answered by walking a level
+// map, as the book itself would, and by a DepthLadder with each set of
+// kernels the CPU supports. Every way must give the same answers.
+//
+// The ladder is a copy, stale as soon as the book changes. So each kernel
+// set is timed twice: with one Assign for all queries, which only holds
+// while the book stands still, and with an Assign before every query, as
+// when every query sees a changed book. The break-even is how many queries
+// one Assign has to serve before the ladder beats walking the map.
+int main(int argc, char **argv) {
+  const std::size_t levels = argc > 1 ? std::stoul(argv[1]) : 500;
+  const std::size_t queries = argc > 2 ? std::stoul(argv[2]) : 1'000'000;
+
+  XorShift next;
+
+  BookBuilder book;
+  std::map<Price, Quantity> levelMap;
+  OrderId orderId = 1;
+  std::uint64_t depth = 0;
+  for (std::size_t level = 0; level < levels; ++level) {
+    const Price price = 10'001 + static_cast<Price>(level);
+    for (auto orders = 1 + next() % 4; orders != 0; --orders) {
+      const auto quantity = static_cast<Quantity>(100 * (1 + next() % 20));
+      book.AddOrder(orderId++, Side::Sell, price, quantity);
+      levelMap[price] += quantity;
+      depth += quantity;
+    }
+  }
+
+  // Sizes up to the whole side, limits up to the last level.
+  std::vector<std::pair<std::uint64_t, Price>> orders(queries);
+  for (auto &[quantity, limit] : orders) {
+    quantity = 1 + next() % depth;
+    limit = 10'001 + static_cast<Price>(next() % levels);
+  }
+
+  struct Answers {
+    std::uint64_t levels_{0};
+    std::uint64_t fillable_{0};
+    std::uint64_t within_{0};
+    bool operator==(const Answers &) const = default;
+  };
+
+  Answers walked;
+  const double walkSeconds = Time([&] {
+    for (const auto &[quantity, limit] : orders) {
+      std::uint64_t total = 0, within = 0;
+      std::size_t index = 0;
+      for (const auto &[price, levelQuantity] : levelMap) {
+        if ((total += levelQuantity) >= quantity)
+          break;
+        ++index;
+      }
+      walked.levels_ += index;
+      for (const auto &[price, levelQuantity] : levelMap) {
+        if (price > limit)
+          break;
+        within += levelQuantity;
+      }
+      walked.fillable_ += within >= quantity;
+      walked.within_ += within;
+    }
+  });
+  std::cout << levels << " levels, " << queries << " queries\n"
+            << "level map walk: " << walkSeconds * 1e9 / queries
+            << " ns per query\n";
+
+  bool match = true;
+  for (const auto isa : {depth_scan::Isa::Scalar, depth_scan::Isa::Avx2,
+                         depth_scan::Isa::Avx512}) {
+    static constexpr const char *Names[] = {"scalar", "avx2", "avx512"};
+    const char *name = Names[static_cast<int>(isa)];
+    if (!depth_scan::IsSupported(isa)) {
+      std::cout << name << ": not supported\n";
+      continue;
+    }
+    DepthLadder ladder{depth_scan::GetKernels(isa)};
+    const double assignSeconds =
+        Time([&] { ladder.Assign(book, Side::Sell); });
+
+    Answers scanned;
+    const double scanSeconds = Time([&] {
+      for (const auto &[quantity, limit] : orders) {
+        scanned.levels_ += ladder.FindLevel(quantity);
+        scanned.fillable_ += ladder.CanFill(limit, quantity);
+        scanned.within_ += ladder.GetQuantityWithin(limit);
+      }
+    });
+
+    Answers fresh;
+    const double freshSeconds = Time([&] {
+      for (const auto &[quantity, limit] : orders) {
+        ladder.Assign(book, Side::Sell);
+        fresh.levels_ += ladder.FindLevel(quantity);
+        fresh.fillable_ += ladder.CanFill(limit, quantity);
+        fresh.within_ += ladder.GetQuantityWithin(limit);
+      }
+    });
+
+    std::vector<std::uint64_t> sums;
+    const double prefixSeconds =
+        Time([&] { sums = ladder.GetCumulativeQuantities(); });
+    std::uint64_t total = 0;
+    for (std::size_t i = 0; i < sums.size(); ++i)
+      match &= sums[i] == (total += ladder.GetQuantities()[i]);
+
+    match &= scanned == walked && fresh == walked;
+    std::cout << name << ": " << scanSeconds * 1e9 / queries
+              << " ns per query, " << freshSeconds * 1e9 / queries
+              << " ns with an Assign before each, Assign "
+              << assignSeconds * 1e6 << " us, running totals "
+              << prefixSeconds * 1e9 / levels << " ns per level, ";
+    if (scanSeconds < walkSeconds)
+      std::cout << "break-even "
+                << (freshSeconds - scanSeconds) / (walkSeconds - scanSeconds)
+                << " queries per Assign\n";
+    else
+      std::cout << "no break-even\n";
+  }
+
+  std::cout << (match ? "answers match" : "ANSWERS DIFFER") << std::endl;
+  return match ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <string>
+
+#include "../BookMemory.h"
+#include "BenchUtil.h"
+#include "PerfCounter.h"
+
+static const char *ToString(HugePageArena::Backing backing) {
+  switch (backing) {
+  case HugePageArena::Backing::HugeTlb:
+    return "hugetlb";
+  case HugePageArena::Backing::TransparentHugePages:
+    return "transparent huge pages";
+  case HugePageArena::Backing::NormalPages:
+    return "normal pages";
+  }
+  return "unknown";
+}
+
+// Fills a book with count resting orders spread over many levels, then
+// cancels and re-adds random orders so every operation lands on a cold index
+// bucket, list node and order object somewhere in the book's footprint.
+static void Run(const std::string &name, std::size_t count,
+                std::pmr::memory_resource *upstream) {
+  OrderPool orderPool{upstream};
+  OrderBook orderBook{upstream};
+  WarmUp(orderBook, orderPool, count, 8192);
+
+  XorShift next{0x2545F4914F6CDD1Dull};
+  auto add = [&](OrderId orderId) {
+    const Side side = orderId % 2 ? Side::Sell : Side::Buy;
+    const Price level = static_cast<Price>(next() % 4096);
+    const Price price = side == Side::Buy ? 100'000 - level : 100'001 + level;
+    orderBook.AddOrder(orderPool.Acquire(OrderType::GoodTillCancel, orderId,
+                                         side, price, 10));
+  };
+  for (OrderId orderId = 1; orderId <= count; ++orderId)
+    add(orderId);
+
+  auto misses = PerfCounter::DataTlbMisses();
+  const std::size_t operations = count;
+  misses.Start();
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < operations; ++i) {
+    const OrderId orderId = 1 + next() % count;
+    orderBook.CancelOrder(orderId);
+    add(orderId);
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  const auto tlbMisses = misses.Stop();
+
+  std::cout << name << ": "
+            << std::chrono::duration<double, std::nano>(elapsed).count() /
+                   operations
+            << " ns/cancel+add, dTLB-load-misses/op: ";
+  if (tlbMisses)
+    std::cout << static_cast<double>(*tlbMisses) / operations << '\n';
+  else
+    std::cout << "n/a (perf counters unavailable)\n";
+}
+
+int main(int argc, char **argv) {
+  const std::size_t count = argc > 1 ? std::stoul(argv[1]) : 2'000'000;
+
+  Run("heap (4K pages)", count, std::pmr::get_default_resource());
+
+  // Order + control block, list node and index node per order, index
+  // buckets and the pools' chunks come to about 300 bytes per order here,
+  // with the arena's rounding; overflow falls back to the heap anyway.
+  HugePageArena arena{count * 384};
+  arena.Prefault();
+  Run(std::string{"huge page arena ("} + ToString(arena.GetBacking()) + ")",
+      count, &arena);
+  std::cout << "arena used " << (arena.GetUsed() >> 20) << " of "
+            << (arena.GetCapacity() >> 20) << " MiB\n";
+  return 0;
+}
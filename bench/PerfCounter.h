@@ -0,0 +1,70 @@
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+// Thin wrapper around a single perf_event_open counter for the calling thread.
+// Containers and VMs frequently hide the PMU; in that case the counter is
+// simply invalid and Stop() returns std::nullopt so benchmarks can still
+// report wall-clock numbers.
+class PerfCounter {
+public:
+  PerfCounter(std::uint32_t type, std::uint64_t config) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+
+  static PerfCounter BranchMisses() {
+    return PerfCounter{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES};
+  }
+
+  static PerfCounter DataTlbMisses() {
+    return PerfCounter{PERF_TYPE_HW_CACHE,
+                       PERF_COUNT_HW_CACHE_DTLB |
+                           (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+  }
+
+  PerfCounter(const PerfCounter &) = delete;
+  PerfCounter &operator=(const PerfCounter &) = delete;
+  PerfCounter(PerfCounter &&other) noexcept : fd_{other.fd_} { other.fd_ = -1; }
+  ~PerfCounter() {
+    if (fd_ >= 0)
+      close(fd_);
+  }
+
+  bool IsValid() const { return fd_ >= 0; }
+
+  void Start() {
+    if (!IsValid())
+      return;
+    ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+  }
+
+  std::optional<std::uint64_t> Stop() {
+    if (!IsValid())
+      return std::nullopt;
+    ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+    std::uint64_t count = 0;
+    if (read(fd_, &count, sizeof(count)) != sizeof(count))
+      return std::nullopt;
+    return count;
+  }
+
+private:
+  int fd_{-1};
+};
@@ -0,0 +1,91 @@
+#include <chrono>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include "../BookMemory.h"
+#include "BenchUtil.h"
+
+// Every order is tagged with one of many participants, and half of them cross
+// the spread, so most matches compare two different participants. Running the
+// same flow with and without a prevention mode on the aggressors isolates the
+// cost of the per-match participant compare.
+static void Run(const std::string &name, std::size_t count,
+                SelfTradePrevention selfTradePrevention) {
+  OrderPool orderPool;
+  OrderBook orderBook;
+  WarmUp(orderBook, orderPool, count, 1024);
+
+  XorShift next;
+
+  std::size_t trades = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (OrderId orderId = 1; orderId <= count; ++orderId) {
+    const auto r = next();
+    const Side side = r % 2 ? Side::Sell : Side::Buy;
+    const Price offset = static_cast<Price>((r >> 8) % 20) - 10;
+    const Price price = side == Side::Buy ? 1000 + offset : 1000 - offset;
+    trades += orderBook
+                  .AddOrder(orderPool.Acquire(
+                      OrderType::GoodTillCancel, orderId, side, price,
+                      static_cast<Quantity>(1 + (r >> 16) % 100),
+                      ParticipantId{1 + (r >> 24) % 4096}, selfTradePrevention))
+                  .size();
+  }
+  const auto elapsed = std::chrono::duration<double, std::nano>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+
+  std::cout << name << ": " << elapsed / count << " ns/order, "
+            << elapsed / trades << " ns/trade, " << trades << " trades\n";
+}
+
+// A fill-or-kill order must not count its own participant's resting orders,
+// which prevention removes or answers by shrinking the aggressor instead of
+// trading. Participant 7 buys 10 against 5 of its own and 5 of participant
+// 8's: the order has to be killed and leave both untouched. With its own
+// behind 10 of participant 8's, it has to fill completely.
+static bool CheckFillOrKill(const std::string &name,
+                            SelfTradePrevention selfTradePrevention) {
+  auto run = [selfTradePrevention](std::initializer_list<ParticipantId> sellers) {
+    OrderPool orderPool;
+    OrderBook orderBook;
+    OrderId orderId = 1;
+    for (const ParticipantId seller : sellers)
+      orderBook.AddOrder(orderPool.Acquire(OrderType::GoodTillCancel,
+                                           orderId++, Side::Sell, 100, 5,
+                                           seller));
+    Quantity filled = 0;
+    for (const auto &trade :
+         orderBook.AddOrder(orderPool.Acquire(OrderType::FillOrkill, orderId,
+                                              Side::Buy, 100, 10,
+                                              ParticipantId{7},
+                                              selfTradePrevention)))
+      filled += trade.GetQuantity();
+    return std::pair{filled, orderBook.Size()};
+  };
+  const auto [killedFill, killedSize] = run({7, 8});
+  const auto [filledFill, filledSize] = run({8, 8, 7});
+  const bool ok = killedFill == 0 && killedSize == 2 && filledFill == 10 &&
+                  filledSize == 1;
+  std::cout << name << ": fill-or-kill against own orders "
+            << (ok ? "ok" : "BROKEN") << " (filled " << killedFill
+            << " of 10 with its own ahead, " << filledFill
+            << " of 10 with its own behind)\n";
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  const std::size_t count = argc > 1 ? std::stoul(argv[1]) : 2'000'000;
+  bool ok = true;
+  ok &= CheckFillOrKill("cancel-newest", SelfTradePrevention::CancelNewest);
+  ok &= CheckFillOrKill("cancel-oldest", SelfTradePrevention::CancelOldest);
+  ok &= CheckFillOrKill("cancel-both  ", SelfTradePrevention::CancelBoth);
+  ok &= CheckFillOrKill("decrement    ", SelfTradePrevention::Decrement);
+  for (int round = 0; round < 3; ++round) {
+    Run("unprotected     ", count, SelfTradePrevention::None);
+    Run("stp cancel-both ", count, SelfTradePrevention::CancelBoth);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,238 @@
+#include <sched.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../Orderbook.h"
+#include "BenchUtil.h"
+#include "PerfCounter.h"
+
+// The book as it was before the side-specialized matching loop: every
+// operation branches on Side at runtime and the matcher walks both tops.
+// Kept here only as the baseline for the comparison below.
+class RuntimeSideOrderBook {
+  using OrderPointers = std::list<OrderPointer>;
+
+public:
+  Trades AddOrder(OrderPointer order) {
+    if (orders_.contains(order->GetOrderId()))
+      return {};
+    if (order->GetOrderType() == OrderType::FillOrkill &&
+        !CanFullyFill(order->GetSide(), order->GetPrice(),
+                      order->GetOpenQuantity()))
+      return {};
+
+    OrderPointers::iterator iterator;
+    if (order->GetSide() == Side::Buy) {
+      auto &orders = bids_[order->GetPrice()];
+      orders.push_back(order);
+      iterator = std::prev(orders.end());
+    } else {
+      auto &orders = asks_[order->GetPrice()];
+      orders.push_back(order);
+      iterator = std::prev(orders.end());
+    }
+    orders_.insert({order->GetOrderId(), OrderEntry{order, iterator}});
+    return MatchOrders();
+  }
+
+  void CancelOrder(OrderId orderId) {
+    auto it = orders_.find(orderId);
+    if (it == orders_.end())
+      return;
+    const auto [order, iterator] = it->second;
+    orders_.erase(it);
+    if (order->GetSide() == Side::Sell) {
+      auto level = asks_.find(order->GetPrice());
+      level->second.erase(iterator);
+      if (level->second.empty())
+        asks_.erase(level);
+    } else {
+      auto level = bids_.find(order->GetPrice());
+      level->second.erase(iterator);
+      if (level->second.empty())
+        bids_.erase(level);
+    }
+  }
+
+  std::size_t Size() const { return orders_.size(); }
+
+private:
+  struct OrderEntry {
+    OrderPointer order_{nullptr};
+    OrderPointers::iterator location_;
+  };
+
+  std::map<Price, OrderPointers, std::greater<Price>> bids_;
+  std::map<Price, OrderPointers, std::less<Price>> asks_;
+  std::unordered_map<OrderId, OrderEntry> orders_;
+
+  bool CanFullyFill(Side side, Price price, Quantity quantity) const {
+    Quantity available = 0;
+    if (side == Side::Buy) {
+      for (const auto &[levelPrice, orders] : asks_) {
+        if (price < levelPrice)
+          break;
+        for (const auto &order : orders)
+          if ((available += order->GetOpenQuantity()) >= quantity)
+            return true;
+      }
+    } else {
+      for (const auto &[levelPrice, orders] : bids_) {
+        if (price > levelPrice)
+          break;
+        for (const auto &order : orders)
+          if ((available += order->GetOpenQuantity()) >= quantity)
+            return true;
+      }
+    }
+    return false;
+  }
+
+  Trades MatchOrders() {
+    Trades trades;
+    while (!bids_.empty() && !asks_.empty()) {
+      auto bidLevel = bids_.begin();
+      auto askLevel = asks_.begin();
+      if (bidLevel->first < askLevel->first)
+        break;
+
+      auto &bids = bidLevel->second;
+      auto &asks = askLevel->second;
+      while (!bids.empty() && !asks.empty()) {
+        auto bid = bids.front();
+        auto ask = asks.front();
+        Quantity quantity =
+            std::min(bid->GetRemainingQuantity(), ask->GetRemainingQuantity());
+        bid->Fill(quantity);
+        ask->Fill(quantity);
+        if (bid->isFilled()) {
+          bids.pop_front();
+          orders_.erase(bid->GetOrderId());
+        }
+        if (ask->isFilled()) {
+          asks.pop_front();
+          orders_.erase(ask->GetOrderId());
+        }
+        // Ids are handed out in arrival order, so the newer order aggressed.
+        trades.push_back(
+            Trade{TradeInfo{bid->GetOrderId(), bid->GetPrice(), quantity},
+                  TradeInfo{ask->GetOrderId(), ask->GetPrice(), quantity},
+                  bid->GetOrderId() > ask->GetOrderId() ? Side::Buy
+                                                        : Side::Sell});
+      }
+      if (bids.empty())
+        bids_.erase(bidLevel);
+      if (asks.empty())
+        asks_.erase(askLevel);
+    }
+    for (Side side : {Side::Buy, Side::Sell}) {
+      if (side == Side::Buy ? bids_.empty() : asks_.empty())
+        continue;
+      const auto &order = side == Side::Buy ? bids_.begin()->second.front()
+                                            : asks_.begin()->second.front();
+      if (order->GetOrderType() == OrderType::FillOrkill)
+        CancelOrder(order->GetOrderId());
+    }
+    return trades;
+  }
+};
+
+struct Command {
+  OrderType type_;
+  Side side_;
+  Price price_;
+  Quantity quantity_;
+  bool cancel_;
+};
+
+// Strictly alternating buy/sell flow around a drifting mid, with a mix of
+// passive, crossing and fill-or-kill orders and periodic cancels. The side
+// pattern is trivially predictable; what the runtime book cannot predict is
+// which of its duplicated per-side code paths the data will send it down.
+static std::vector<Command> MakeAlternatingFlow(std::size_t count) {
+  std::vector<Command> flow;
+  flow.reserve(count);
+  XorShift next{0x9E3779B97F4A7C15ull};
+
+  for (std::size_t i = 0; i < count; ++i) {
+    const Side side = i % 2 ? Side::Sell : Side::Buy;
+    const auto r = next();
+    const Price offset = static_cast<Price>(r % 16) - 4;
+    const Price price = side == Side::Buy ? 1000 - offset : 1000 + offset;
+    const OrderType type =
+        r % 11 == 0 ? OrderType::FillOrkill : OrderType::GoodTillCancel;
+    flow.push_back(Command{type, side, price,
+                           static_cast<Quantity>(1 + (r >> 8) % 50),
+                           (r >> 16) % 4 == 0});
+  }
+  return flow;
+}
+
+// Returns ns/order.
+template <typename Book>
+static double Run(const std::string &name, const std::vector<Command> &flow) {
+  auto misses = PerfCounter::BranchMisses();
+  Book book;
+  std::size_t trades = 0;
+
+  misses.Start();
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < flow.size(); ++i) {
+    const auto &command = flow[i];
+    trades += book
+                  .AddOrder(std::make_shared<Order>(
+                      command.type_, i + 1, command.side_, command.price_,
+                      command.quantity_))
+                  .size();
+    if (command.cancel_ && i >= 64)
+      book.CancelOrder(i - 63);
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  const auto branchMisses = misses.Stop();
+
+  const double ns =
+      std::chrono::duration<double, std::nano>(elapsed).count() / flow.size();
+  std::cout << name << ": " << ns << " ns/order, " << trades << " trades, "
+            << book.Size() << " resting, branch-misses/order: ";
+  if (branchMisses)
+    std::cout << static_cast<double>(*branchMisses) / flow.size() << '\n';
+  else
+    std::cout << "n/a (perf counters unavailable)\n";
+  return ns;
+}
+
+static double Median(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+int main(int argc, char **argv) {
+  const std::size_t count = argc > 1 ? std::stoul(argv[1]) : 2'000'000;
+  const int rounds = argc > 2 ? std::stoi(argv[2]) : 7;
+  const auto flow = MakeAlternatingFlow(count);
+
+  // Stay on one CPU so both variants see the same caches and predictor.
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(sched_getcpu(), &cpus);
+  if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+    std::cout << "could not pin to a CPU, numbers will be noisier\n";
+
+  // Alternate the variants so neither consistently inherits a warmer or more
+  // fragmented heap from the other.
+  std::vector<double> runtime, traits;
+  for (int round = 0; round < rounds; ++round) {
+    runtime.push_back(Run<RuntimeSideOrderBook>("runtime side", flow));
+    traits.push_back(Run<OrderBook>("side traits ", flow));
+  }
+  // OrderBook also carries everything added since (pooled nodes, level
+  // totals, owners, stops, expiries, top of book), so this compares whole
+  // books, not side dispatch alone.
+  std::cout << "median ns/order: runtime side " << Median(runtime)
+            << ", side traits " << Median(traits) << std::endl;
+  return 0;
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../BookMemory.h"
+#include "../TradeStatistics.h"
+#include "BenchUtil.h"
+
+// Feeds the trades of a random order flow through TradeStatistics and, for
+// comparison, answers the same questions the way downstream code without it
+// does: by scanning the trade history kept so far. After every batch of
+// queryEvery trades both sides read the session VWAP, high, low and last
+// and the current one-second bar. The answers must agree.
+struct TimedTrade {
+  Trade trade_;
+  Timestamp time_;
+};
+
+static std::vector<TimedTrade> Generate(std::size_t count) {
+  XorShift next;
+
+  OrderPool orderPool;
+  OrderBook orderBook;
+  std::vector<TimedTrade> trades;
+  trades.reserve(count);
+  Price mid = 10'000;
+  Timestamp now = 0;
+  for (OrderId orderId = 1; trades.size() < count; ++orderId) {
+    now += 1 + next() % 20'000;
+    if (next() % 64 == 0)
+      mid += static_cast<Price>(next() % 3) - 1;
+    const Side side = next() % 2 ? Side::Buy : Side::Sell;
+    // A quarter of the orders cross by up to two ticks.
+    const auto offset = static_cast<Price>(next() % 8) - 2;
+    const Price price = side == Side::Buy ? mid - offset : mid + offset;
+    for (const auto &trade : orderBook.AddOrder(orderPool.Acquire(
+             OrderType::GoodTillCancel, orderId, side, price,
+             static_cast<Quantity>(100 * (1 + next() % 10)))))
+      trades.push_back({trade, now});
+    if (orderBook.Size() > 10'000)
+      orderBook.CancelOrder(orderId - 10'000);
+  }
+  trades.erase(trades.begin() + count, trades.end());
+  return trades;
+}
+
+struct Answer {
+  std::int64_t notional_{0};
+  std::uint64_t volume_{0};
+  Price high_{0};
+  Price low_{0};
+  Price last_{0};
+  Bar bar_;
+
+  bool operator==(const Answer &other) const {
+    return notional_ == other.notional_ && volume_ == other.volume_ &&
+           high_ == other.high_ && low_ == other.low_ &&
+           last_ == other.last_ && bar_.start_ == other.bar_.start_ &&
+           bar_.open_ == other.bar_.open_ && bar_.high_ == other.bar_.high_ &&
+           bar_.low_ == other.bar_.low_ && bar_.close_ == other.bar_.close_ &&
+           bar_.volume_ == other.bar_.volume_;
+  }
+};
+
+constexpr Timestamp BarInterval = 1'000'000'000;
+
+static Answer Scan(const std::vector<TimedTrade> &history) {
+  Answer answer;
+  answer.low_ = history.front().trade_.GetPrice();
+  const Timestamp barStart =
+      history.back().time_ - history.back().time_ % BarInterval;
+  for (const auto &[trade, time] : history) {
+    const Price price = trade.GetPrice();
+    answer.notional_ += price * static_cast<std::int64_t>(trade.GetQuantity());
+    answer.volume_ += trade.GetQuantity();
+    answer.high_ = std::max(answer.high_, price);
+    answer.low_ = std::min(answer.low_, price);
+    answer.last_ = price;
+    if (time >= barStart) {
+      if (answer.bar_.trades_ == 0)
+        answer.bar_.start_ = barStart;
+      answer.bar_.Add(price, trade.GetQuantity(), time);
+    }
+  }
+  return answer;
+}
+
+static Answer Read(const TradeStatistics &statistics) {
+  const auto session = *statistics.GetSession();
+  return {statistics.GetNotional(), statistics.GetVolume(), session.high_,
+          session.low_, session.close_, statistics.GetTimeBar()};
+}
+
+int main(int argc, char **argv) {
+  const std::size_t count = argc > 1 ? std::stoul(argv[1]) : 1'000'000;
+  const std::size_t queryEvery = argc > 2 ? std::stoul(argv[2]) : 1'000;
+  const auto trades = Generate(count);
+
+  using Clock = std::chrono::steady_clock;
+  std::vector<Answer> incremental, scanned;
+
+  TradeStatistics statistics{BarInterval, 10'000};
+  auto start = Clock::now();
+  for (std::size_t i = 0; i < trades.size(); ++i) {
+    statistics.Add(trades[i].trade_, trades[i].time_);
+    if ((i + 1) % queryEvery == 0)
+      incremental.push_back(Read(statistics));
+  }
+  const double incrementalSeconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::vector<TimedTrade> history;
+  history.reserve(trades.size());
+  start = Clock::now();
+  for (std::size_t i = 0; i < trades.size(); ++i) {
+    history.push_back(trades[i]);
+    if ((i + 1) % queryEvery == 0)
+      scanned.push_back(Scan(history));
+  }
+  const double scanSeconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::cout << trades.size() << " trades, a query every " << queryEvery
+            << ", " << statistics.GetTimeBars().Size() << " time bars, "
+            << statistics.GetVolumeBars().Size() << " volume bars\n"
+            << "incremental: " << incrementalSeconds * 1e9 / trades.size()
+            << " ns per trade\n"
+            << "history scan: " << scanSeconds * 1e9 / trades.size()
+            << " ns per trade\n"
+            << (incremental == scanned ? "answers match" : "ANSWERS DIFFER")
+            << std::endl;
+  return incremental == scanned ? 0 : 1;
+}
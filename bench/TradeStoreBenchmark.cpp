@@ -0,0 +1,174 @@
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../BookMemory.h"
+#include "../TradeStore.h"
+#include "BenchUtil.h"
+
+// Writes the trades of a random order flow to a TradeStore in a scratch
+// directory of its own, removed again at the end, and keeps the same trades
+// in a vector of Trade objects, the way they are held today. Then runs the
+// same queries against both: volume in a price range, over all trades and
+// over a time window, and the trades of a sample of order ids, after
+// checking that the reopened store reads back what was written. The answers
+// must agree; the scan rates are the point.
+struct TimedTrade {
+  Trade trade_;
+  Timestamp time_;
+};
+
+// A directory this run created, and so may delete. The store runs to about
+// 45 bytes per trade, so pick the parent with that in mind.
+class ScratchDirectory {
+public:
+  explicit ScratchDirectory(const std::filesystem::path &parent)
+      : path_{parent / ("trade_store_bench." + std::to_string(getpid()))} {
+    if (!std::filesystem::create_directory(path_))
+      throw std::runtime_error(path_.string() + " already exists");
+  }
+  ScratchDirectory(const ScratchDirectory &) = delete;
+  ScratchDirectory &operator=(const ScratchDirectory &) = delete;
+  ~ScratchDirectory() { std::filesystem::remove_all(path_); }
+
+  const std::filesystem::path &GetPath() const { return path_; }
+
+private:
+  std::filesystem::path path_;
+};
+
+int main(int argc, char **argv) {
+  const std::filesystem::path parent =
+      argc > 1 ? std::filesystem::path{argv[1]}
+               : std::filesystem::temp_directory_path();
+  const std::size_t count = argc > 2 ? std::stoul(argv[2]) : 20'000'000;
+  const ScratchDirectory scratch{parent};
+  const std::filesystem::path &directory = scratch.GetPath();
+
+  XorShift next;
+
+  std::vector<TimedTrade> objects;
+  objects.reserve(count);
+  double appendSeconds = 0;
+  {
+    OrderPool orderPool;
+    OrderBook orderBook;
+    TradeStore store{directory};
+    Price mid = 10'000;
+    Timestamp now = 0;
+    for (OrderId orderId = 1; objects.size() < count; ++orderId) {
+      now += 1 + next() % 2'000;
+      if (next() % 64 == 0)
+        mid += static_cast<Price>(next() % 3) - 1;
+      const Side side = next() % 2 ? Side::Buy : Side::Sell;
+      const auto offset = static_cast<Price>(next() % 8) - 2;
+      const auto trades = orderBook.AddOrder(orderPool.Acquire(
+          OrderType::GoodTillCancel, orderId, side,
+          side == Side::Buy ? mid - offset : mid + offset,
+          static_cast<Quantity>(100 * (1 + next() % 10))));
+      for (const auto &trade : trades)
+        objects.push_back({trade, now});
+      appendSeconds += Time([&] { store.Append(trades, now); });
+      if (orderBook.Size() > 10'000)
+        orderBook.CancelOrder(orderId - 10'000);
+    }
+    std::cout << store.Size() << " trades in " << store.GetSegmentCount()
+              << " segments, appended at "
+              << store.Size() / appendSeconds / 1e6 << "M trades/s\n";
+  }
+
+  // Queried through a store opened afresh, as an audit tool would.
+  const TradeStore store{directory};
+  const Price low = 9'990, high = 10'010;
+  const Timestamp from = objects[objects.size() / 4].time_;
+  const Timestamp to = objects[objects.size() / 2].time_;
+  bool match = store.Size() == objects.size();
+  for (std::size_t i = 0; match && i < objects.size(); i += 997) {
+    const Trade trade = store.GetTrade(i);
+    const Trade &object = objects[i].trade_;
+    match = store.GetTime(i) == objects[i].time_ &&
+            trade.GetAggressorSide() == object.GetAggressorSide() &&
+            trade.GetBidTrade().orderId_ == object.GetBidTrade().orderId_ &&
+            trade.GetBidTrade().price_ == object.GetBidTrade().price_ &&
+            trade.GetAskTrade().orderId_ == object.GetAskTrade().orderId_ &&
+            trade.GetAskTrade().price_ == object.GetAskTrade().price_ &&
+            trade.GetQuantity() == object.GetQuantity();
+  }
+
+  auto report = [&](const char *what, double columnSeconds,
+                    double objectSeconds, double bytes) {
+    std::cout << what << ": columns " << columnSeconds * 1e3 << " ms ("
+              << bytes / columnSeconds / 1e9 << " GB/s), Trade objects "
+              << objectSeconds * 1e3 << " ms\n";
+  };
+
+  for (int pass = 0; pass < 2; ++pass) {
+    std::uint64_t columnVolume = 0, objectVolume = 0;
+    const double columnSeconds =
+        Time([&] { columnVolume = store.GetVolume(low, high); });
+    const double objectSeconds = Time([&] {
+      for (const auto &[trade, time] : objects)
+        if (trade.GetPrice() >= low && trade.GetPrice() <= high)
+          objectVolume += trade.GetQuantity();
+    });
+    match &= columnVolume == objectVolume;
+    // The first pass faults the mapping in; the second shows the scan.
+    if (pass == 1)
+      report("volume in price range", columnSeconds, objectSeconds,
+             static_cast<double>(store.Size()) *
+                 (sizeof(Price) + sizeof(Quantity)));
+  }
+
+  {
+    std::uint64_t columnVolume = 0, objectVolume = 0;
+    const double columnSeconds =
+        Time([&] { columnVolume = store.GetVolume(low, high, from, to); });
+    const double objectSeconds = Time([&] {
+      for (const auto &[trade, time] : objects)
+        if (time >= from && time <= to && trade.GetPrice() >= low &&
+            trade.GetPrice() <= high)
+          objectVolume += trade.GetQuantity();
+    });
+    match &= columnVolume == objectVolume;
+    report("volume in price range, middle quarter of the day", columnSeconds,
+           objectSeconds,
+           static_cast<double>(store.Size()) / 4 *
+               (sizeof(Price) + sizeof(Quantity)));
+  }
+
+  {
+    constexpr std::size_t Lookups = 10;
+    std::size_t columnFound = 0, objectFound = 0;
+    std::vector<OrderId> orderIds;
+    for (std::size_t i = 0; i < Lookups; ++i)
+      orderIds.push_back(
+          objects[next() % objects.size()].trade_.GetBidTrade().orderId_);
+    const double columnSeconds = Time([&] {
+      for (const OrderId orderId : orderIds) {
+        const auto found = store.FindTrades(orderId);
+        columnFound += found.size();
+        for (const auto index : found)
+          match &= store.GetTrade(index).GetBidTrade().orderId_ == orderId ||
+                   store.GetTrade(index).GetAskTrade().orderId_ == orderId;
+      }
+    });
+    const double objectSeconds = Time([&] {
+      for (const OrderId orderId : orderIds)
+        for (const auto &[trade, time] : objects)
+          objectFound += trade.GetBidTrade().orderId_ == orderId ||
+                         trade.GetAskTrade().orderId_ == orderId;
+    });
+    match &= columnFound == objectFound;
+    report("trades of 10 order ids", columnSeconds, objectSeconds,
+           static_cast<double>(store.Size()) * Lookups * 2 * sizeof(OrderId));
+  }
+
+  std::cout << (match ? "answers match" : "ANSWERS DIFFER") << std::endl;
+  return match ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "../BookMemory.h"
+
+// Measures the latency of each of the first orders into a fresh book, with and
+// without WarmUp(), and compares the early tail against the steady state.
+static void Run(const std::string &name, std::size_t count, bool warm,
+                bool lockMemory) {
+  OrderPool orderPool;
+  OrderBook orderBook;
+  if (warm && !WarmUp(orderBook, orderPool, count, 1024, lockMemory))
+    std::cout << "mlockall failed (needs CAP_IPC_LOCK or a higher "
+                 "RLIMIT_MEMLOCK), running unlocked\n";
+
+  std::vector<double> latencies;
+  latencies.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    // Passive orders only: every one of them allocates a new index entry and
+    // list node, and every 16th one a new price level.
+    const Side side = i % 2 ? Side::Sell : Side::Buy;
+    const Price level = static_cast<Price>((i / 32) % 512);
+    const Price price = side == Side::Buy ? 10'000 - level : 10'001 + level;
+
+    const auto start = std::chrono::steady_clock::now();
+    orderBook.AddOrder(orderPool.Acquire(OrderType::GoodTillCancel, i + 1,
+                                         side, price, 10));
+    latencies.push_back(std::chrono::duration<double, std::nano>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+  }
+
+  auto percentile = [](std::vector<double> window, double p) {
+    std::sort(window.begin(), window.end());
+    return window[static_cast<std::size_t>(p * (window.size() - 1))];
+  };
+  const std::size_t head = std::min<std::size_t>(10'000, count / 10);
+  std::vector<double> first(latencies.begin(), latencies.begin() + head);
+  std::vector<double> last(latencies.end() - head, latencies.end());
+
+  std::cout << name << ": first " << head
+            << " orders p50/p99/max ns: " << percentile(first, 0.5) << '/'
+            << percentile(first, 0.99) << '/' << percentile(first, 1.0)
+            << ", last " << head << " p50/p99/max ns: " << percentile(last, 0.5)
+            << '/' << percentile(last, 0.99) << '/' << percentile(last, 1.0)
+            << '\n';
+}
+
+int main(int argc, char **argv) {
+  const std::size_t count = argc > 1 ? std::stoul(argv[1]) : 1'000'000;
+  const bool lockMemory = argc > 2 && std::string{argv[2]} == "lock";
+  Run("cold  ", count, false, false);
+  Run("warmed", count, true, lockMemory);
+  return 0;
+}
@@ -0,0 +1,181 @@
+#include <poll.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "../BookMemory.h"
+#include "../bench/BenchUtil.h"
+#include "UdpFeed.h"
+
+// feed_loopback [commands] [drop every nth packet] [address] [port]
+// Runs a book and a UdpFeedPublisher on one thread and a reference
+// UdpFeedSubscriber on another, over loopback (unicast, or a multicast group
+// if address is one), with the snapshot channel on port + 1. The subscriber
+// can be made to drop every nth incremental packet on top of whatever the
+// kernel drops, to exercise gap recovery.
+//
+// Whenever the publisher sends a snapshot it also records the book's
+// GetLevelInfos() at that sequence; the subscriber compares its rebuilt
+// depth with every such checkpoint it reaches in sync, and once more with
+// the final book after the publisher stops.
+static constexpr std::size_t Depth = 64;
+
+struct Checkpoint {
+  std::uint64_t sequence_;
+  OrderBookLevelInfos levels_;
+};
+
+static LevelInfos Truncate(const LevelInfos &levels) {
+  return LevelInfos(levels.begin(),
+                    levels.begin() + std::min(levels.size(), Depth));
+}
+
+static bool Same(const LevelInfos &left, const LevelInfos &right) {
+  return left.size() == right.size() &&
+         std::equal(left.begin(), left.end(), right.begin(),
+                    [](const LevelInfo &l, const LevelInfo &r) {
+                      return l.price_ == r.price_ && l.quantity_ == r.quantity_;
+                    });
+}
+
+static bool Same(const OrderBookLevelInfos &subscriber,
+                 const OrderBookLevelInfos &book) {
+  return Same(subscriber.GetBids(), Truncate(book.GetBids())) &&
+         Same(subscriber.GetAsks(), Truncate(book.GetAsks()));
+}
+
+int main(int argc, char **argv) {
+  const std::size_t commands = argc > 1 ? std::stoul(argv[1]) : 1'000'000;
+  const std::size_t dropEvery = argc > 2 ? std::stoul(argv[2]) : 0;
+  const std::string address = argc > 3 ? argv[3] : "127.0.0.1";
+  const auto port =
+      static_cast<std::uint16_t>(argc > 4 ? std::stoul(argv[4]) : 31000);
+  const auto snapshotPort = static_cast<std::uint16_t>(port + 1);
+  constexpr std::size_t CommandsPerFlush = 8;
+  constexpr std::size_t CommandsPerSnapshot = 10'000;
+
+  std::mutex mutex;
+  std::deque<Checkpoint> checkpoints;
+  std::atomic<std::uint64_t> finalSequence{UINT64_MAX};
+  std::atomic<bool> caughtUp{false};
+
+  UdpFeedSubscriber subscriber;
+  std::size_t verified = 0, mismatched = 0, dropped = 0;
+  const int incrementalFd = udp_feed::OpenReceiver(address, port);
+  const int snapshotFd = udp_feed::OpenReceiver(address, snapshotPort);
+
+  std::thread receiver{[&] {
+    pollfd fds[2] = {{incrementalFd, POLLIN, 0}, {snapshotFd, POLLIN, 0}};
+    std::byte packet[udp_feed::MaxPacketSize];
+    std::size_t received = 0;
+    auto check = [&] {
+      const std::uint64_t applied = subscriber.GetNextSequence() - 1;
+      std::lock_guard lock{mutex};
+      while (!checkpoints.empty() && checkpoints.front().sequence_ < applied)
+        checkpoints.pop_front();
+      if (!checkpoints.empty() && checkpoints.front().sequence_ == applied &&
+          subscriber.IsSynchronized()) {
+        ++(Same(subscriber.GetLevelInfos(), checkpoints.front().levels_)
+               ? verified
+               : mismatched);
+        checkpoints.pop_front();
+      }
+    };
+    while (!(subscriber.IsSynchronized() &&
+             subscriber.GetNextSequence() - 1 == finalSequence.load())) {
+      poll(fds, 2, 1);
+      for (ssize_t size;
+           (size = recv(incrementalFd, packet, sizeof(packet), 0)) > 0;) {
+        if (dropEvery != 0 && ++received % dropEvery == 0) {
+          ++dropped;
+          continue;
+        }
+        subscriber.OnIncremental(packet, static_cast<std::size_t>(size));
+        check();
+      }
+      for (ssize_t size;
+           (size = recv(snapshotFd, packet, sizeof(packet), 0)) > 0;) {
+        subscriber.OnSnapshot(packet, static_cast<std::size_t>(size));
+        check();
+      }
+    }
+    caughtUp = true;
+  }};
+
+  OrderPool orderPool;
+  OrderBook orderBook;
+  UdpFeedPublisher<Depth> publisher{address, port, snapshotPort};
+  XorShift next;
+  // Recorded before anything at that sequence is sent, so the subscriber
+  // cannot get there first.
+  auto snapshot = [&] {
+    publisher.Flush();
+    {
+      std::lock_guard lock{mutex};
+      checkpoints.push_back(
+          Checkpoint{publisher.GetSequence(), orderBook.GetLevelInfos()});
+    }
+    publisher.PublishSnapshot(orderBook);
+  };
+
+  const auto start = std::chrono::steady_clock::now();
+  OrderId nextOrderId = 1;
+  for (std::size_t command = 1; command <= commands; ++command) {
+    const auto r = next();
+    Trades trades;
+    if (r % 3 == 0 && nextOrderId > 1) {
+      orderBook.CancelOrder(1 + (r >> 8) % (nextOrderId - 1));
+    } else {
+      const Side side = (r >> 4) % 2 ? Side::Sell : Side::Buy;
+      const Price offset = static_cast<Price>((r >> 16) % 20) - 10;
+      trades = orderBook.AddOrder(orderPool.Acquire(
+          OrderType::GoodTillCancel, nextOrderId++, side,
+          side == Side::Buy ? 1000 + offset : 1000 - offset,
+          static_cast<Quantity>(1 + (r >> 24) % 100)));
+    }
+    publisher.Publish(orderBook, trades);
+    if (command % CommandsPerFlush == 0)
+      publisher.Flush();
+    if (command % CommandsPerSnapshot == 0)
+      snapshot();
+  }
+  publisher.Flush();
+  const double elapsed = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  finalSequence = publisher.GetSequence();
+
+  // Keep the snapshot channel going until the subscriber has caught up.
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+  while (!caughtUp && std::chrono::steady_clock::now() < deadline) {
+    snapshot();
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+  if (!caughtUp) {
+    std::cerr << "subscriber did not catch up with sequence "
+              << finalSequence.load() << "\n";
+    std::quick_exit(1);
+  }
+  receiver.join();
+  close(incrementalFd);
+  close(snapshotFd);
+
+  const bool final = Same(subscriber.GetLevelInfos(), orderBook.GetLevelInfos());
+  std::cout << commands << " commands, " << publisher.GetSequence()
+            << " messages in " << publisher.GetPackets() << " packets, "
+            << publisher.GetSequence() / elapsed << " msgs/s\n"
+            << dropped << " packets dropped on purpose, "
+            << subscriber.GetGaps() << " gaps, " << subscriber.GetRecoveries()
+            << " snapshot recoveries\n"
+            << verified << " checkpoints matched, " << mismatched
+            << " mismatched, final book "
+            << (final ? "matches" : "DOES NOT MATCH") << " GetLevelInfos()\n";
+  return final && mismatched == 0 ? 0 : 1;
+}
@@ -0,0 +1,227 @@
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <system_error>
+
+#include "../BookMemory.h"
+#include "../MarketData.h"
+#include "../SharedMemoryRing.h"
+#include "../bench/BenchUtil.h"
+
+// shm_loopback [commands] [ring capacity] [subscriber ns per message]
+// shm_loopback attach <ring name>
+//
+// Runs a book, a MarketDataBuilder and a SharedMemoryPublisher in this
+// process and a SharedMemorySubscriber in a forked child, the same order
+// flow as feed_loopback. The child checks the sequence of every message it
+// gets: whatever it skipped must be exactly what the ring counted as
+// overrun, and received plus overrun must be everything published. When
+// nothing was lost it also rebuilds the depth and traded volume from the
+// messages and compares them with the parent's final book. Spinning in the
+// child for some nanoseconds per message makes the publisher lap it.
+//
+// attach follows a ring some other process publishes, e.g. the gateway's,
+// and prints messages and overruns once a second until interrupted.
+static constexpr std::size_t Depth = 10;
+
+using Publisher = SharedMemoryPublisher<MarketDataMessage>;
+using Subscriber = SharedMemorySubscriber<MarketDataMessage>;
+
+// What the parent sends the child once it has published everything.
+struct Final {
+  std::uint64_t published_;
+  std::uint64_t volume_;
+  DepthSnapshot<Depth> depth_;
+  TopOfBook topOfBook_;
+};
+
+static void Check(bool ok, const char *what) {
+  if (!ok)
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+// Rebuilds what the messages describe and tracks their sequence.
+class Follower {
+public:
+  explicit Follower(const Subscriber &subscriber) : subscriber_{subscriber} {}
+
+  void operator()(const MarketDataMessage &message) {
+    const std::uint64_t sequence = subscriber_.GetPosition() - 1;
+    gaps_ += sequence - expected_;
+    expected_ = sequence + 1;
+    ++received_;
+    if (const auto *trade = std::get_if<Trade>(&message)) {
+      volume_ += trade->GetQuantity();
+    } else if (const auto *update = std::get_if<LevelUpdate>(&message)) {
+      auto apply = [update](auto &levels) {
+        if (update->quantity_ == 0)
+          levels.erase(update->price_);
+        else
+          levels[update->price_] = update->quantity_;
+      };
+      update->side_ == Side::Buy ? apply(bids_) : apply(asks_);
+    } else {
+      topOfBook_ = std::get<TopOfBook>(message);
+    }
+  }
+
+  bool Matches(const Final &final) const {
+    DepthSnapshot<Depth> depth;
+    for (const auto &[price, quantity] : bids_)
+      if (depth.bidCount_ < Depth)
+        depth.bids_[depth.bidCount_++] = LevelInfo{price, quantity};
+    for (const auto &[price, quantity] : asks_)
+      if (depth.askCount_ < Depth)
+        depth.asks_[depth.askCount_++] = LevelInfo{price, quantity};
+    return bids_.size() <= Depth && asks_.size() <= Depth &&
+           depth == final.depth_ && topOfBook_ == final.topOfBook_ &&
+           volume_ == final.volume_;
+  }
+
+  std::uint64_t GetReceived() const { return received_; }
+  std::uint64_t GetGaps() const { return gaps_; }
+
+private:
+  const Subscriber &subscriber_;
+  std::uint64_t expected_{0};
+  std::uint64_t received_{0};
+  std::uint64_t gaps_{0};
+  std::uint64_t volume_{0};
+  std::map<Price, Quantity, std::greater<Price>> bids_;
+  std::map<Price, Quantity> asks_;
+  TopOfBook topOfBook_;
+};
+
+static int Subscribe(const std::string &name, int readyFd, int finalFd,
+                     std::uint64_t spinNanoseconds) {
+  Subscriber subscriber{name};
+  Follower follower{subscriber};
+  Check(write(readyFd, "", 1) == 1, "write");
+
+  auto spin = [spinNanoseconds] {
+    const auto until = std::chrono::steady_clock::now() +
+                       std::chrono::nanoseconds{spinNanoseconds};
+    while (std::chrono::steady_clock::now() < until) {
+    }
+  };
+  Final final{};
+  bool finished = false;
+  while (!finished || subscriber.GetPosition() < final.published_) {
+    const std::size_t count = subscriber.Poll([&](const auto &message) {
+      follower(message);
+      if (spinNanoseconds)
+        spin();
+    });
+    if (count == 0 && !finished) {
+      pollfd fd{finalFd, POLLIN, 0};
+      if (poll(&fd, 1, 0) == 1) {
+        Check(read(finalFd, &final, sizeof(final)) == sizeof(final), "read");
+        finished = true;
+      }
+    }
+  }
+
+  const std::uint64_t overruns = subscriber.GetOverruns();
+  const bool counted = follower.GetReceived() + overruns == final.published_ &&
+                       follower.GetGaps() == overruns;
+  const bool rebuilt = overruns != 0 || follower.Matches(final);
+  std::cout << "subscriber: " << follower.GetReceived() << " received, "
+            << overruns << " overrun, " << follower.GetGaps()
+            << " skipped in sequence, counts "
+            << (counted ? "add up" : "DO NOT ADD UP") << ", ";
+  if (overruns != 0)
+    std::cout << "book not checked after overruns\n";
+  else
+    std::cout << "rebuilt book " << (rebuilt ? "matches" : "DOES NOT MATCH")
+              << '\n';
+  return counted && rebuilt ? 0 : 1;
+}
+
+static int Attach(const std::string &name) {
+  Subscriber subscriber{name};
+  std::uint64_t received = 0, overruns = 0;
+  for (auto next = std::chrono::steady_clock::now();;) {
+    received += subscriber.Poll([](const MarketDataMessage &) {});
+    if (std::chrono::steady_clock::now() < next)
+      continue;
+    next += std::chrono::seconds{1};
+    std::cout << "position " << subscriber.GetPosition() << ", "
+              << received << " messages/s, "
+              << subscriber.GetOverruns() - overruns << " overrun"
+              << std::endl;
+    received = 0;
+    overruns = subscriber.GetOverruns();
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc > 2 && std::strcmp(argv[1], "attach") == 0)
+    return Attach(argv[2]);
+  const std::size_t commands = argc > 1 ? std::stoul(argv[1]) : 1'000'000;
+  const std::size_t capacity = argc > 2 ? std::stoul(argv[2]) : 1 << 16;
+  const std::uint64_t spinNanoseconds = argc > 3 ? std::stoull(argv[3]) : 0;
+  const std::string name = "/orderbook_shm_loopback." + std::to_string(getpid());
+
+  Publisher publisher{name, capacity};
+  int ready[2], final[2];
+  Check(pipe(ready) == 0 && pipe(final) == 0, "pipe");
+  const pid_t child = fork();
+  Check(child >= 0, "fork");
+  if (child == 0) {
+    // _exit, so the child's copy of the publisher leaves the ring alone.
+    const int status = Subscribe(name, ready[1], final[0], spinNanoseconds);
+    std::cout.flush();
+    _exit(status);
+  }
+  char byte;
+  Check(read(ready[0], &byte, 1) == 1, "subscriber did not start");
+
+  OrderPool orderPool;
+  OrderBook orderBook;
+  MarketDataBuilder<Depth> builder;
+  XorShift next;
+  std::uint64_t volume = 0;
+  auto publish = [&publisher](const MarketDataMessage &message) {
+    publisher.Publish(message);
+  };
+  const double elapsed = Time([&] {
+    OrderId nextOrderId = 1;
+    for (std::size_t command = 1; command <= commands; ++command) {
+      const auto r = next();
+      Trades trades;
+      if (r % 3 == 0 && nextOrderId > 1) {
+        orderBook.CancelOrder(1 + (r >> 8) % (nextOrderId - 1));
+      } else {
+        const Side side = (r >> 4) % 2 ? Side::Sell : Side::Buy;
+        const Price offset = static_cast<Price>((r >> 16) % 20) - 10;
+        trades = orderBook.AddOrder(orderPool.Acquire(
+            OrderType::GoodTillCancel, nextOrderId++, side,
+            side == Side::Buy ? 1000 + offset : 1000 - offset,
+            static_cast<Quantity>(1 + (r >> 24) % 100)));
+      }
+      for (const auto &trade : trades)
+        volume += trade.GetQuantity();
+      builder.Publish(orderBook, trades, publish);
+    }
+  });
+
+  const Final summary{publisher.GetPublished(), volume,
+                      orderBook.GetDepth<Depth>(), orderBook.GetTopOfBook()};
+  Check(write(final[1], &summary, sizeof(summary)) == sizeof(summary),
+        "write");
+  std::cout << "publisher: " << commands << " commands, "
+            << summary.published_ << " messages, "
+            << summary.published_ / elapsed << " msgs/s" << std::endl;
+
+  int status;
+  Check(waitpid(child, &status, 0) == child, "waitpid");
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,421 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "../MarketData.h"
+#include "../WireProtocol.h"
+
+// Sequenced UDP market data in the style of MoldUDP64: every market data
+// message gets the next sequence number, and a datagram is a 16-byte packet
+// header (sequence of its first message, message count) followed by as many
+// wire protocol messages as fit in one MTU. A receiver that sees a packet
+// start past the sequence it expects has lost something.
+//
+// Losses are repaired from a second, snapshot channel rather than by
+// retransmission: the publisher periodically sends the whole published depth
+// as one or more Snapshot packets stamped with the last incremental sequence
+// it reflects. A subscriber that detects a gap buffers incremental packets
+// from there on, waits for a snapshot no older than the first buffered one,
+// installs it and replays the buffer past the snapshot's sequence.
+namespace udp_feed {
+
+// Ethernet MTU less the IPv4 and UDP headers, so nothing is fragmented.
+inline constexpr std::size_t MaxPacketSize = 1472;
+
+// Packet header: 0 sequence u64, 8 messageCount u16, 10 reserved
+class PacketHeader {
+public:
+  static constexpr std::size_t Size = 16;
+
+  explicit PacketHeader(const std::byte *buffer) : buffer_{buffer} {}
+
+  std::uint64_t GetSequence() const {
+    return wire::Load<std::uint64_t>(buffer_);
+  }
+  std::uint16_t GetMessageCount() const {
+    return wire::Load<std::uint16_t>(buffer_ + 8);
+  }
+
+  static void Write(std::byte *buffer, std::uint64_t sequence,
+                    std::uint16_t messageCount) {
+    wire::Store<std::uint64_t>(buffer, sequence);
+    wire::Store<std::uint16_t>(buffer + 8, messageCount);
+    std::fill(buffer + 10, buffer + Size, std::byte{0});
+  }
+
+private:
+  const std::byte *buffer_;
+};
+
+inline std::system_error Error(const std::string &what) {
+  return std::system_error(errno, std::generic_category(), what);
+}
+
+inline sockaddr_in Endpoint(const std::string &address, std::uint16_t port) {
+  sockaddr_in endpoint{};
+  endpoint.sin_family = AF_INET;
+  endpoint.sin_port = htons(port);
+  if (inet_pton(AF_INET, address.c_str(), &endpoint.sin_addr) != 1)
+    throw std::invalid_argument(std::format("bad IPv4 address {}", address));
+  return endpoint;
+}
+
+inline bool IsMulticast(const sockaddr_in &endpoint) {
+  return IN_MULTICAST(ntohl(endpoint.sin_addr.s_addr));
+}
+
+// A socket for sending to a group or unicast address. Multicast stays on
+// this host (TTL 0) and is looped back to local subscribers.
+inline int OpenSender() {
+  const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0)
+    throw Error("socket");
+  const unsigned char ttl = 0, loop = 1;
+  setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+  return fd;
+}
+
+// A non-blocking socket receiving what is sent to address:port, joining the
+// group when address is a multicast one.
+inline int OpenReceiver(const std::string &address, std::uint16_t port) {
+  const sockaddr_in endpoint = Endpoint(address, port);
+  const int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  if (fd < 0)
+    throw Error("socket");
+  const int one = 1, bufferSize = 8 << 20;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+  if (bind(fd, reinterpret_cast<const sockaddr *>(&endpoint),
+           sizeof(endpoint)) != 0) {
+    const auto error = Error(std::format("bind {}:{}", address, port));
+    close(fd);
+    throw error;
+  }
+  if (IsMulticast(endpoint)) {
+    ip_mreq membership{};
+    membership.imr_multiaddr = endpoint.sin_addr;
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership,
+                   sizeof(membership)) != 0) {
+      const auto error = Error(std::format("join {}", address));
+      close(fd);
+      throw error;
+    }
+  }
+  return fd;
+}
+
+} // namespace udp_feed
+
+// Publishes the market data of one book: call Publish() after every command
+// and PublishSnapshot() every so often. Messages are packed into the current
+// packet, which goes out when the next message would not fit or on Flush().
+template <std::size_t Depth> class UdpFeedPublisher {
+public:
+  UdpFeedPublisher(const std::string &address, std::uint16_t incrementalPort,
+                   std::uint16_t snapshotPort,
+                   std::size_t packetSize = udp_feed::MaxPacketSize)
+      : incremental_{udp_feed::Endpoint(address, incrementalPort)},
+        snapshot_{udp_feed::Endpoint(address, snapshotPort)},
+        packetSize_{std::min(packetSize, udp_feed::MaxPacketSize)},
+        fd_{udp_feed::OpenSender()} {}
+
+  UdpFeedPublisher(const UdpFeedPublisher &) = delete;
+  UdpFeedPublisher &operator=(const UdpFeedPublisher &) = delete;
+
+  ~UdpFeedPublisher() { close(fd_); }
+
+  void Publish(const OrderBook &orderBook, const Trades &trades) {
+    builder_.Publish(orderBook, trades, [this](const MarketDataMessage &message) {
+      std::visit(
+          [this](const auto &body) {
+            using Body = std::decay_t<decltype(body)>;
+            if constexpr (std::is_same_v<Body, Trade>)
+              Append<wire::TradeEncoder>(body);
+            else if constexpr (std::is_same_v<Body, LevelUpdate>)
+              Append<wire::LevelUpdateEncoder>(body);
+            else
+              Append<wire::TopOfBookEncoder>(body);
+          },
+          message);
+    });
+  }
+
+  // Sends the partly filled packet, if any.
+  void Flush() {
+    if (count_ == 0)
+      return;
+    udp_feed::PacketHeader::Write(packet_.data(), sequence_ - count_ + 1,
+                                  count_);
+    Send(incremental_, used_);
+    ++packets_;
+    used_ = 0;
+    count_ = 0;
+  }
+
+  // Flushes, then sends the published depth of orderBook as of the last
+  // sequence number handed out. It must be the book Publish() was last
+  // called with.
+  void PublishSnapshot(const OrderBook &orderBook) {
+    Flush();
+    const auto depth = orderBook.GetDepth<Depth>();
+    constexpr std::size_t Fixed =
+        udp_feed::PacketHeader::Size + wire::SnapshotEncoder::Size;
+    const std::size_t perFragment =
+        (packetSize_ - Fixed) / wire::LevelUpdateEncoder::Size;
+    const std::size_t levels = depth.bidCount_ + depth.askCount_;
+    const auto fragmentCount = static_cast<std::uint16_t>(
+        std::max<std::size_t>(1, (levels + perFragment - 1) / perFragment));
+
+    std::size_t level = 0;
+    for (std::uint16_t fragment = 0; fragment < fragmentCount; ++fragment) {
+      std::byte *at = packet_.data() + udp_feed::PacketHeader::Size;
+      wire::SnapshotEncoder{at}.SetLastSequence(sequence_).SetFragment(
+          fragment, fragmentCount);
+      at += wire::SnapshotEncoder::Size;
+      std::uint16_t messages = 1;
+      for (const std::size_t end = std::min(levels, level + perFragment);
+           level < end; ++level, ++messages, at += wire::LevelUpdateEncoder::Size)
+        wire::LevelUpdateEncoder{at}.From(
+            level < depth.bidCount_
+                ? LevelUpdate{Side::Buy, depth.bids_[level].price_,
+                              depth.bids_[level].quantity_}
+                : LevelUpdate{Side::Sell,
+                              depth.asks_[level - depth.bidCount_].price_,
+                              depth.asks_[level - depth.bidCount_].quantity_});
+      udp_feed::PacketHeader::Write(packet_.data(), ++snapshots_, messages);
+      Send(snapshot_, static_cast<std::size_t>(at - packet_.data()));
+    }
+  }
+
+  // Sequence number of the last message published; 0 before the first.
+  std::uint64_t GetSequence() const { return sequence_; }
+  std::uint64_t GetPackets() const { return packets_; }
+
+private:
+  MarketDataBuilder<Depth> builder_;
+  sockaddr_in incremental_;
+  sockaddr_in snapshot_;
+  std::size_t packetSize_;
+  int fd_;
+
+  std::array<std::byte, udp_feed::MaxPacketSize> packet_;
+  std::size_t used_{0};
+  std::uint16_t count_{0};
+  std::uint64_t sequence_{0};
+  std::uint64_t packets_{0};
+  std::uint64_t snapshots_{0};
+
+  template <typename Encoder, typename Body> void Append(const Body &body) {
+    if (used_ + Encoder::Size > packetSize_)
+      Flush();
+    if (used_ == 0)
+      used_ = udp_feed::PacketHeader::Size;
+    Encoder{packet_.data() + used_}.From(body);
+    used_ += Encoder::Size;
+    ++count_;
+    ++sequence_;
+  }
+
+  // A full socket buffer blocks the publisher rather than dropping
+  // silently on the sending side; receivers still drop when they lag.
+  void Send(const sockaddr_in &to, std::size_t size) {
+    if (sendto(fd_, packet_.data(), size, 0,
+               reinterpret_cast<const sockaddr *>(&to), sizeof(to)) < 0 &&
+        errno != ECONNREFUSED)
+      throw udp_feed::Error("sendto");
+  }
+};
+
+// Protocol side of a subscriber: rebuilds the published depth from the
+// packets it is handed, detects gaps and recovers from snapshots. It owns no
+// sockets, so the caller decides how packets arrive (and can drop some).
+class UdpFeedSubscriber {
+public:
+  void OnIncremental(const std::byte *packet, std::size_t size) {
+    if (size < udp_feed::PacketHeader::Size)
+      return;
+    const udp_feed::PacketHeader header{packet};
+    const std::uint64_t first = header.GetSequence();
+    const std::uint64_t end = first + header.GetMessageCount();
+
+    if (synchronized_) {
+      if (end <= next_)
+        return;
+      if (first <= next_)
+        return ApplyPacket(packet, size);
+      ++gaps_;
+      synchronized_ = false;
+      pending_.clear();
+    } else if (!pending_.empty()) {
+      if (end <= pendingEnd_)
+        return;
+      // A second gap while recovering; only the newest run can be replayed.
+      if (first > pendingEnd_)
+        pending_.clear();
+    }
+    pending_.emplace_back(packet, packet + size);
+    pendingEnd_ = end;
+  }
+
+  void OnSnapshot(const std::byte *packet, std::size_t size) {
+    if (synchronized_ || size < udp_feed::PacketHeader::Size)
+      return;
+    const std::byte *at = packet + udp_feed::PacketHeader::Size;
+    const std::byte *const last = packet + size;
+    bool complete = false;
+    while (at < last) {
+      const std::size_t used = wire::Decode(at, last - at, [&](const auto &m) {
+        using Message = std::decay_t<decltype(m)>;
+        if constexpr (std::is_same_v<Message, wire::SnapshotDecoder>) {
+          // Fragments come in order on one socket; anything else means one
+          // was lost and this snapshot is abandoned for the next.
+          if (m.GetFragment() == 0) {
+            snapshotSequence_ = m.GetLastSequence();
+            snapshot_.clear();
+            nextFragment_ = 0;
+          }
+          if (m.GetFragment() != nextFragment_ ||
+              m.GetLastSequence() != snapshotSequence_) {
+            nextFragment_ = NoFragment;
+            return;
+          }
+          ++nextFragment_;
+          complete = nextFragment_ == m.GetFragmentCount();
+        } else if constexpr (std::is_same_v<Message, wire::LevelUpdateDecoder>) {
+          if (nextFragment_ != NoFragment)
+            snapshot_.push_back(m.ToLevelUpdate());
+        }
+      });
+      if (used == 0)
+        return;
+      at += used;
+    }
+    if (complete && nextFragment_ != NoFragment)
+      Recover();
+  }
+
+  bool IsSynchronized() const { return synchronized_; }
+  // Sequence number of the next incremental message to apply.
+  std::uint64_t GetNextSequence() const { return next_; }
+  std::uint64_t GetGaps() const { return gaps_; }
+  std::uint64_t GetRecoveries() const { return recoveries_; }
+  std::uint64_t GetTradeCount() const { return tradeCount_; }
+  std::uint64_t GetTradedVolume() const { return tradedVolume_; }
+
+  OrderBookLevelInfos GetLevelInfos() const {
+    LevelInfos bids, asks;
+    bids.reserve(bids_.size());
+    asks.reserve(asks_.size());
+    for (const auto &[price, quantity] : bids_)
+      bids.push_back(LevelInfo{price, quantity});
+    for (const auto &[price, quantity] : asks_)
+      asks.push_back(LevelInfo{price, quantity});
+    return OrderBookLevelInfos{bids, asks};
+  }
+
+private:
+  static constexpr std::uint16_t NoFragment = 0xFFFF;
+
+  std::map<Price, Quantity, std::greater<Price>> bids_;
+  std::map<Price, Quantity, std::less<Price>> asks_;
+
+  bool synchronized_{false};
+  std::uint64_t next_{1};
+  std::uint64_t gaps_{0};
+  std::uint64_t recoveries_{0};
+  std::uint64_t tradeCount_{0};
+  std::uint64_t tradedVolume_{0};
+
+  // Contiguous incremental packets received since the gap, and the sequence
+  // right after the last of them.
+  std::vector<std::vector<std::byte>> pending_;
+  std::uint64_t pendingEnd_{0};
+
+  // The snapshot being assembled.
+  std::uint64_t snapshotSequence_{0};
+  std::uint16_t nextFragment_{NoFragment};
+  std::vector<LevelUpdate> snapshot_;
+
+  // Applies the messages of an incremental packet from next_ on.
+  void ApplyPacket(const std::byte *packet, std::size_t size) {
+    std::uint64_t sequence = udp_feed::PacketHeader{packet}.GetSequence();
+    const std::byte *at = packet + udp_feed::PacketHeader::Size;
+    const std::byte *const last = packet + size;
+    while (at < last) {
+      const std::size_t used = wire::Decode(at, last - at, [&](const auto &m) {
+        if (sequence >= next_)
+          ApplyMessage(m);
+      });
+      if (used == 0)
+        break;
+      at += used;
+      if (sequence++ >= next_)
+        next_ = sequence;
+    }
+  }
+
+  void ApplyMessage(const wire::LevelUpdateDecoder &message) {
+    if (message.GetSide() == Side::Buy)
+      SetLevel(bids_, message.ToLevelUpdate());
+    else
+      SetLevel(asks_, message.ToLevelUpdate());
+  }
+
+  void ApplyMessage(const wire::TradeDecoder &message) {
+    ++tradeCount_;
+    tradedVolume_ += message.GetBidTrade().quantity_;
+  }
+
+  template <typename Message> void ApplyMessage(const Message &) {}
+
+  template <typename Levels>
+  static void SetLevel(Levels &levels, const LevelUpdate &update) {
+    if (update.quantity_ == 0)
+      levels.erase(update.price_);
+    else
+      levels[update.price_] = update.quantity_;
+  }
+
+  // Installs the assembled snapshot if the buffered packets continue it.
+  void Recover() {
+    nextFragment_ = NoFragment;
+    if (!pending_.empty() &&
+        udp_feed::PacketHeader{pending_.front().data()}.GetSequence() >
+            snapshotSequence_ + 1)
+      return;
+
+    bids_.clear();
+    asks_.clear();
+    for (const auto &level : snapshot_) {
+      if (level.side_ == Side::Buy)
+        SetLevel(bids_, level);
+      else
+        SetLevel(asks_, level);
+    }
+    next_ = snapshotSequence_ + 1;
+    synchronized_ = true;
+    ++recoveries_;
+    for (const auto &packet : pending_)
+      ApplyPacket(packet.data(), packet.size());
+    pending_.clear();
+  }
+};
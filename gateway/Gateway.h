@@ -0,0 +1,800 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../MarketData.h"
+#include "../SharedMemoryRing.h"
+#include "../SpscQueue.h"
+#include "../WireProtocol.h"
+#include "IoUring.h"
+
+// Native TCP order gateway. One I/O thread owns every socket: it frames the
+// binary wire messages of all sessions and passes order entry messages to
+// the matching thread through a lock-free queue; acks, rejects and trades
+// come back through another and are written out by the I/O thread. Each
+// thread either sleeps when idle (epoll_wait / io_uring_enter, and a futex
+// for the matching thread) or, in busy-poll mode, spins and never makes a
+// system call just to wait.
+namespace gateway {
+
+using SessionId = std::uint32_t;
+
+// Largest message accepted from a client, header included. A NewOrder is
+// 64 bytes; the slack leaves room for blocks grown by later schema versions.
+inline constexpr std::size_t MaxMessageSize = 128;
+
+// Levels per side in the gateway's DepthFeed and market data.
+inline constexpr std::size_t Depth = 10;
+
+using MarketDataRing = SharedMemoryPublisher<MarketDataMessage>;
+
+struct Command {
+  SessionId session_;
+  std::uint32_t length_;
+  std::array<std::byte, MaxMessageSize> message_;
+};
+
+struct Reply {
+  SessionId session_;
+  std::uint32_t length_;
+  std::array<std::byte, wire::NewOrderEncoder::Size> message_;
+};
+
+inline std::system_error Error(const char *what) {
+  return std::system_error(errno, std::generic_category(), what);
+}
+
+inline int Listen(std::uint16_t port) {
+  const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (fd < 0)
+    throw Error("socket");
+  const int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    const auto error = Error("bind/listen");
+    close(fd);
+    throw error;
+  }
+  return fd;
+}
+
+struct Session {
+  static constexpr std::size_t InputSize = 64 * 1024;
+
+  Session(SessionId id, int fd) : id_{id}, fd_{fd}, input_(InputSize) {
+    const int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  ~Session() { close(fd_); }
+
+  std::byte *GetFreeInput() { return input_.data() + inputEnd_; }
+  std::size_t GetFreeInputSize() const { return input_.size() - inputEnd_; }
+
+  SessionId id_;
+  int fd_;
+  // Received bytes not yet framed are [inputBegin_, inputEnd_).
+  std::vector<std::byte> input_;
+  std::size_t inputBegin_{0};
+  std::size_t inputEnd_{0};
+  // Bytes still to send are [outputBegin_, output_.size()).
+  std::vector<std::byte> output_;
+  std::size_t outputBegin_{0};
+  bool dirty_{false};
+  bool watchingWritable_{false};
+};
+
+// Readiness based backend. Sockets are edge triggered, so readable sessions
+// are drained until EAGAIN and writability is reported once per transition,
+// which is exactly when a stalled send can make progress again.
+class EpollBackend {
+public:
+  EpollBackend(int listenFd, int wakeFd)
+      : fd_{epoll_create1(0)}, listenFd_{listenFd}, wakeFd_{wakeFd} {
+    if (fd_ < 0)
+      throw Error("epoll_create1");
+    Register(listenFd_, EPOLLIN, ListenKey);
+    Register(wakeFd_, EPOLLIN, WakeKey);
+  }
+
+  EpollBackend(const EpollBackend &) = delete;
+  EpollBackend &operator=(const EpollBackend &) = delete;
+
+  ~EpollBackend() { close(fd_); }
+
+  static constexpr const char *Name = "epoll";
+
+  void AddSession(Session &session) {
+    Register(session.fd_, EPOLLIN | EPOLLOUT | EPOLLET, session.id_);
+  }
+  void WatchWritable(Session &) {}
+
+  template <typename Handler> void Poll(Handler &handler, bool block) {
+    std::array<epoll_event, 64> events;
+    const int count = epoll_wait(fd_, events.data(), events.size(),
+                                 block ? -1 : 0);
+    for (int i = 0; i < count; ++i) {
+      const auto key = events[i].data.u64;
+      if (key == ListenKey) {
+        int fd;
+        while ((fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK)) >= 0)
+          handler.OnAccept(fd);
+      } else if (key == WakeKey) {
+        std::uint64_t value;
+        [[maybe_unused]] auto _ = read(wakeFd_, &value, sizeof(value));
+      } else if (Session *session = handler.FindSession(key)) {
+        if (events[i].events & EPOLLOUT)
+          handler.OnWritable(*session);
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+          Receive(handler, *session);
+      }
+    }
+  }
+
+private:
+  static constexpr std::uint64_t ListenKey = ~std::uint64_t{0};
+  static constexpr std::uint64_t WakeKey = ListenKey - 1;
+
+  int fd_;
+  int listenFd_;
+  int wakeFd_;
+
+  void Register(int fd, std::uint32_t events, std::uint64_t key) {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = key;
+    if (epoll_ctl(fd_, EPOLL_CTL_ADD, fd, &event) != 0)
+      throw Error("epoll_ctl");
+  }
+
+  template <typename Handler> void Receive(Handler &handler, Session &session) {
+    const SessionId id = session.id_;
+    for (;;) {
+      const ssize_t received =
+          recv(session.fd_, session.GetFreeInput(),
+               session.GetFreeInputSize(), 0);
+      if (received < 0 && errno == EAGAIN)
+        return;
+      // The handler frees the session if it closed.
+      handler.OnReceived(session, received);
+      if (received <= 0 || !handler.FindSession(id))
+        return;
+    }
+  }
+};
+
+// Completion based backend: accepts and receives are io_uring operations
+// that complete with the data already in the session's buffer, so a message
+// costs no readiness round trip and no read system call, and re-arming them
+// is batched into the next io_uring_enter. In busy-poll mode completions are
+// picked up from the shared ring without entering the kernel at all.
+class UringBackend {
+public:
+  UringBackend(int listenFd, int wakeFd)
+      : ring_{1024}, listenFd_{listenFd}, wakeFd_{wakeFd} {
+    Accept();
+    ReadWake();
+    ring_.Submit();
+  }
+
+  static constexpr const char *Name = "io_uring";
+
+  void AddSession(Session &session) { Receive(session); }
+
+  // Sends are plain non-blocking send() calls; this arms a one-shot poll so
+  // the handler hears when a full socket buffer has drained.
+  void WatchWritable(Session &session) {
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = session.fd_;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = Key(Operation::Writable, session.id_);
+  }
+
+  template <typename Handler> void Poll(Handler &handler, bool block) {
+    // Completions set aside by GetSqe() come first and mean there is work
+    // without waiting.
+    ring_.Submit(block && deferred_.empty() ? 1 : 0);
+    auto handle = [&](const io_uring_cqe &cqe) {
+      const auto operation = static_cast<Operation>(cqe.user_data >> 56);
+      const SessionId id = static_cast<SessionId>(cqe.user_data);
+      switch (operation) {
+      case Operation::Accept:
+        if (cqe.res >= 0)
+          handler.OnAccept(cqe.res);
+        Accept();
+        break;
+      case Operation::Wake:
+        ReadWake();
+        break;
+      case Operation::Receive:
+        if (Session *session = handler.FindSession(id)) {
+          handler.OnReceived(*session, cqe.res);
+          if (cqe.res > 0 && handler.FindSession(id))
+            Receive(*session);
+        }
+        break;
+      case Operation::Writable:
+        if (Session *session = handler.FindSession(id))
+          handler.OnWritable(*session);
+        break;
+      }
+    };
+    // Handling may defer more; index, not iterators, and a copy.
+    for (std::size_t i = 0; i < deferred_.size(); ++i) {
+      const io_uring_cqe cqe = deferred_[i];
+      handle(cqe);
+    }
+    deferred_.clear();
+    ring_.ForEachCompletion(handle);
+  }
+
+private:
+  enum class Operation : std::uint8_t { Accept, Wake, Receive, Writable };
+
+  IoUring ring_;
+  // Completions drained while the submission ring was full, for Poll().
+  std::vector<io_uring_cqe> deferred_;
+  int listenFd_;
+  int wakeFd_;
+  std::uint64_t wakeValue_;
+
+  static std::uint64_t Key(Operation operation, SessionId id = 0) {
+    return static_cast<std::uint64_t>(operation) << 56 | id;
+  }
+
+  // The kernel refuses submissions (EBUSY) while completions are backed up,
+  // so a full submission ring is only sure to drain once they are read.
+  // This may run inside Poll()'s completion loop, so they are set aside for
+  // Poll() rather than handled here.
+  io_uring_sqe *GetSqe() {
+    io_uring_sqe *sqe;
+    while (!(sqe = ring_.GetSqe())) {
+      ring_.Submit();
+      ring_.ForEachCompletion(
+          [this](const io_uring_cqe &cqe) { deferred_.push_back(cqe); });
+    }
+    return sqe;
+  }
+
+  void Accept() {
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenFd_;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->user_data = Key(Operation::Accept);
+  }
+
+  void ReadWake() {
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeFd_;
+    sqe->addr = reinterpret_cast<std::uint64_t>(&wakeValue_);
+    sqe->len = sizeof(wakeValue_);
+    sqe->user_data = Key(Operation::Wake);
+  }
+
+  void Receive(Session &session) {
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = session.fd_;
+    sqe->addr = reinterpret_cast<std::uint64_t>(session.GetFreeInput());
+    sqe->len = static_cast<std::uint32_t>(session.GetFreeInputSize());
+    sqe->user_data = Key(Operation::Receive, session.id_);
+  }
+};
+
+struct Statistics {
+  std::atomic<std::uint64_t> sessions_{0};
+  std::atomic<std::uint64_t> commands_{0};
+  std::atomic<std::uint64_t> replies_{0};
+};
+
+// The matching side: decodes commands, runs them against the book and
+// encodes the replies. Only ever used from the matching thread. With a
+// ring, the market data for the book's state after each command goes out
+// through it as well.
+//
+// The book runs on wall-clock time, which is what GoodTillDate expiries on
+// the wire are in, and moves forward before every command. Day orders end
+// at the next UTC midnight. Orders the book removes on its own are reported
+// to their owners with an unsolicited Cancel.
+class Matcher {
+public:
+  explicit Matcher(MarketDataRing *marketDataRing = nullptr)
+      : marketDataRing_{marketDataRing} {}
+
+  template <typename Send> void Execute(const Command &command, Send &&send) {
+    AdvanceTime(send);
+    wire::Decode(command.message_.data(), command.length_,
+                 [&](const auto &message) {
+                   Execute(command.session_, message, send);
+                 });
+  }
+
+  const OrderBook &GetOrderBook() const { return orderBook_; }
+
+private:
+  OrderPool orderPool_;
+  OrderBook orderBook_;
+  // Which session entered each order still in the book, for routing trades
+  // and for refusing cancels and modifies from anyone else.
+  std::unordered_map<OrderId, SessionId> owners_;
+  MarketDataRing *marketDataRing_;
+  MarketDataBuilder<Depth> marketData_;
+  Timestamp sessionEnd_{0};
+
+  static constexpr Timestamp DayLength = 86'400'000'000'000;
+
+  static Timestamp Now() {
+    return static_cast<Timestamp>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count());
+  }
+
+  // Expires what is due, then rolls the session over once it has ended, so
+  // Day orders from before midnight go first.
+  template <typename Send> void AdvanceTime(Send &send) {
+    const Timestamp now = Now();
+    const auto expired = orderBook_.AdvanceTime(now);
+    for (const OrderId orderId : expired)
+      Cancelled(orderId, send);
+    if (now >= sessionEnd_) {
+      sessionEnd_ = (now / DayLength + 1) * DayLength;
+      orderBook_.SetSessionEnd(sessionEnd_);
+    }
+    if (!expired.empty())
+      PublishMarketData({});
+  }
+
+  // Tells the owner, if there still is one, that orderId left the book
+  // without trading out, and forgets it.
+  template <typename Send> void Cancelled(OrderId orderId, Send &send) {
+    const auto owner = owners_.find(orderId);
+    if (owner == owners_.end())
+      return;
+    Reply reply{owner->second, wire::CancelEncoder::Size, {}};
+    wire::CancelEncoder{reply.message_.data()}.SetOrderId(orderId);
+    send(reply);
+    owners_.erase(owner);
+  }
+
+  template <typename Send>
+  static void Ack(SessionId session, OrderId orderId, Send &send) {
+    Reply reply{session, wire::AckEncoder::Size, {}};
+    wire::AckEncoder{reply.message_.data()}.SetOrderId(orderId).SetTimestamp(
+        Now());
+    send(reply);
+  }
+
+  template <typename Send>
+  static void Reject(SessionId session, OrderId orderId,
+                     wire::RejectReason reason, Send &send) {
+    Reply reply{session, wire::RejectEncoder::Size, {}};
+    wire::RejectEncoder{reply.message_.data()}.SetOrderId(orderId).SetReason(
+        reason);
+    send(reply);
+  }
+
+  // Each trade goes to the owner of either side, once if it is the same
+  // session. Then every order the book cancelled on its own is reported,
+  // and orders the trades finished are forgotten.
+  template <typename Send> void Report(const Trades &trades, Send &send) {
+    for (const auto &trade : trades) {
+      Reply reply{0, wire::TradeEncoder::Size, {}};
+      wire::TradeEncoder{reply.message_.data()}.From(trade);
+      const OrderId bid = trade.GetBidTrade().orderId_;
+      const OrderId ask = trade.GetAskTrade().orderId_;
+      const auto bidOwner = owners_.find(bid);
+      const auto askOwner = owners_.find(ask);
+      if (bidOwner != owners_.end()) {
+        reply.session_ = bidOwner->second;
+        send(reply);
+      }
+      if (askOwner != owners_.end() &&
+          (bidOwner == owners_.end() || askOwner->second != bidOwner->second)) {
+        reply.session_ = askOwner->second;
+        send(reply);
+      }
+    }
+    for (const OrderId orderId : orderBook_.GetCancelledOrders())
+      if (!orderBook_.Contains(orderId))
+        Cancelled(orderId, send);
+    for (const auto &trade : trades) {
+      for (const OrderId orderId :
+           {trade.GetBidTrade().orderId_, trade.GetAskTrade().orderId_})
+        if (!orderBook_.Contains(orderId))
+          owners_.erase(orderId);
+    }
+  }
+
+  void PublishMarketData(const Trades &trades) {
+    if (marketDataRing_)
+      marketData_.Publish(orderBook_, trades,
+                          [this](const MarketDataMessage &message) {
+                            marketDataRing_->Publish(message);
+                          });
+  }
+
+  bool Owns(SessionId session, OrderId orderId) const {
+    const auto owner = owners_.find(orderId);
+    return owner != owners_.end() && owner->second == session &&
+           orderBook_.Contains(orderId);
+  }
+
+  template <typename Send>
+  void Execute(SessionId session, const wire::NewOrderDecoder &message,
+               Send &send) {
+    const OrderId orderId = message.GetOrderId();
+    if (!message.IsValid())
+      return Reject(session, orderId, wire::RejectReason::Malformed, send);
+    if (orderBook_.Contains(orderId))
+      return Reject(session, orderId, wire::RejectReason::DuplicateOrder,
+                    send);
+
+    owners_[orderId] = session;
+    const auto trades = orderBook_.AddOrder(message.ToOrderPointer(orderPool_));
+    if (trades.empty() && !orderBook_.Contains(orderId)) {
+      // Self-trade prevention may have cancelled resting orders too.
+      owners_.erase(orderId);
+      Report(trades, send);
+      PublishMarketData(trades);
+      return Reject(session, orderId, wire::RejectReason::NotAccepted, send);
+    }
+    Ack(session, orderId, send);
+    Report(trades, send);
+    PublishMarketData(trades);
+  }
+
+  template <typename Send>
+  void Execute(SessionId session, const wire::CancelDecoder &message,
+               Send &send) {
+    const OrderId orderId = message.GetOrderId();
+    if (!Owns(session, orderId))
+      return Reject(session, orderId, wire::RejectReason::UnknownOrder, send);
+    orderBook_.CancelOrder(orderId);
+    owners_.erase(orderId);
+    Ack(session, orderId, send);
+    PublishMarketData({});
+  }
+
+  template <typename Send>
+  void Execute(SessionId session, const wire::ModifyDecoder &message,
+               Send &send) {
+    const OrderId orderId = message.GetOrderId();
+    if (!message.IsValid())
+      return Reject(session, orderId, wire::RejectReason::Malformed, send);
+    if (!Owns(session, orderId))
+      return Reject(session, orderId, wire::RejectReason::UnknownOrder, send);
+
+    const auto trades = orderBook_.MatchOrders(message.ToOrderModify());
+    if (trades.empty() && !orderBook_.Contains(orderId)) {
+      owners_.erase(orderId);
+      // The original order is gone from the book even though the modify
+      // was refused, and self-trade prevention may have cancelled others.
+      Report(trades, send);
+      PublishMarketData(trades);
+      return Reject(session, orderId, wire::RejectReason::NotAccepted, send);
+    }
+    Ack(session, orderId, send);
+    Report(trades, send);
+    PublishMarketData(trades);
+  }
+
+  // The I/O thread only forwards the three order entry messages.
+  template <typename Message, typename Send>
+  void Execute(SessionId, const Message &, Send &) {}
+};
+
+template <typename Backend> class Gateway {
+public:
+  // With a marketDataRing name, the matching thread publishes market data
+  // to /dev/shm/<name> as well.
+  Gateway(int listenFd, bool busyPoll, const std::string &marketDataRing = {})
+      : listenFd_{listenFd}, wakeFd_{eventfd(0, EFD_NONBLOCK)},
+        busyPoll_{busyPoll} {
+    if (wakeFd_ < 0)
+      throw Error("eventfd");
+    if (!marketDataRing.empty())
+      marketDataRing_ =
+          std::make_unique<MarketDataRing>(marketDataRing, QueueSize);
+  }
+
+  Gateway(const Gateway &) = delete;
+  Gateway &operator=(const Gateway &) = delete;
+
+  ~Gateway() { close(wakeFd_); }
+
+  // Runs the I/O loop on the calling thread and the matching loop on a new
+  // one until Stop().
+  void Run() {
+    {
+      Backend backend{listenFd_, wakeFd_};
+      backend_ = &backend;
+      std::thread matching{[this] { RunMatching(); }};
+      RunIo();
+      matching.join();
+      backend_ = nullptr;
+    }
+    // Only now that the backend has cancelled any receive into them.
+    sessions_.clear();
+  }
+
+  // Safe from any thread.
+  void Stop() {
+    stopping_.store(true);
+    WakeIo();
+    WakeMatching();
+  }
+
+  const Statistics &GetStatistics() const { return statistics_; }
+
+  // The book's depth as of the last batch the matching thread finished.
+  // Safe from any thread.
+  const DepthFeed<Depth> &GetDepthFeed() const { return depthFeed_; }
+
+  // Backend callbacks, all on the I/O thread.
+
+  Session *FindSession(std::uint64_t id) {
+    const auto session = sessions_.find(static_cast<SessionId>(id));
+    return session == sessions_.end() ? nullptr : session->second.get();
+  }
+
+  void OnAccept(int fd) {
+    const SessionId id = nextSession_++;
+    auto &session = sessions_[id] = std::make_unique<Session>(id, fd);
+    statistics_.sessions_.fetch_add(1, std::memory_order_relaxed);
+    backend_->AddSession(*session);
+  }
+
+  // received <= 0: the peer closed or the connection failed.
+  void OnReceived(Session &session, long received) {
+    if (received <= 0)
+      return CloseSession(session);
+    session.inputEnd_ += static_cast<std::size_t>(received);
+    if (!Frame(session))
+      return CloseSession(session);
+  }
+
+  void OnWritable(Session &session) {
+    session.watchingWritable_ = false;
+    Flush(session);
+  }
+
+private:
+  static constexpr std::size_t QueueSize = 1 << 16;
+
+  int listenFd_;
+  int wakeFd_;
+  bool busyPoll_;
+  std::atomic<bool> stopping_{false};
+  Statistics statistics_;
+  DepthFeed<Depth> depthFeed_;
+  std::unique_ptr<MarketDataRing> marketDataRing_;
+
+  // I/O thread state.
+  Backend *backend_{nullptr};
+  std::unordered_map<SessionId, std::unique_ptr<Session>> sessions_;
+  SessionId nextSession_{1};
+  std::vector<SessionId> dirty_;
+
+  SpscQueue<Command, QueueSize> commands_;
+  SpscQueue<Reply, QueueSize> replies_;
+
+  // Sleep flags for the Dekker-style handshake: a side announces it is
+  // about to sleep, then re-checks its queue; the other side pushes, then
+  // checks the flag. With a full fence on both sides one of them always
+  // sees the other, so no wakeup is lost and no system call is made to
+  // wake a thread that is awake.
+  std::atomic<bool> ioSleeping_{false};
+  std::atomic<bool> matchingSleeping_{false};
+  std::atomic<std::uint32_t> matchingEpoch_{0};
+
+  void WakeIo() {
+    const std::uint64_t one = 1;
+    [[maybe_unused]] auto _ = write(wakeFd_, &one, sizeof(one));
+  }
+
+  void WakeMatching() {
+    matchingEpoch_.fetch_add(1);
+    matchingEpoch_.notify_one();
+  }
+
+  void WakeIoIfSleeping() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ioSleeping_.load(std::memory_order_relaxed))
+      WakeIo();
+  }
+
+  void WakeMatchingIfSleeping() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (matchingSleeping_.load(std::memory_order_relaxed))
+      WakeMatching();
+  }
+
+  void CloseSession(Session &session) { sessions_.erase(session.id_); }
+
+  // Forwards every complete order entry message to the matching thread and
+  // rejects anything else. False if the stream cannot be a wire stream.
+  bool Frame(Session &session) {
+    std::byte *data = session.input_.data();
+    std::uint64_t forwarded = 0;
+    while (session.inputEnd_ - session.inputBegin_ >= wire::MessageHeader::Size) {
+      const std::byte *at = data + session.inputBegin_;
+      const wire::MessageHeader header{at};
+      const std::size_t length =
+          wire::MessageHeader::Size + header.GetBlockLength();
+      if (length > MaxMessageSize)
+        return false;
+      if (session.inputEnd_ - session.inputBegin_ < length)
+        break;
+
+      if (IsOrderEntry(header)) {
+        Command command{session.id_, static_cast<std::uint32_t>(length), {}};
+        std::memcpy(command.message_.data(), at, length);
+        while (!commands_.TryPush(command)) {
+          WakeMatchingIfSleeping();
+          DrainReplies();
+        }
+        ++forwarded;
+      } else {
+        Reply reply{session.id_, wire::RejectEncoder::Size, {}};
+        wire::RejectEncoder{reply.message_.data()}.SetOrderId(0).SetReason(
+            wire::RejectReason::Malformed);
+        Queue(reply);
+      }
+      session.inputBegin_ += length;
+    }
+
+    const std::size_t left = session.inputEnd_ - session.inputBegin_;
+    std::memmove(data, data + session.inputBegin_, left);
+    session.inputBegin_ = 0;
+    session.inputEnd_ = left;
+
+    if (forwarded != 0) {
+      statistics_.commands_.fetch_add(forwarded, std::memory_order_relaxed);
+      WakeMatchingIfSleeping();
+    }
+    return true;
+  }
+
+  static bool IsOrderEntry(const wire::MessageHeader &header) {
+    if (header.GetSchemaId() != wire::SchemaId)
+      return false;
+    switch (header.GetTemplateId()) {
+    case wire::TemplateId::NewOrder:
+      return header.GetBlockLength() >= wire::NewOrderDecoder::BlockLength;
+    case wire::TemplateId::Cancel:
+      return header.GetBlockLength() >= wire::CancelDecoder::BlockLength;
+    case wire::TemplateId::Modify:
+      return header.GetBlockLength() >= wire::ModifyDecoder::BlockLength;
+    default:
+      return false;
+    }
+  }
+
+  void Queue(const Reply &reply) {
+    const auto session = sessions_.find(reply.session_);
+    if (session == sessions_.end())
+      return;
+    auto &output = session->second->output_;
+    output.insert(output.end(), reply.message_.begin(),
+                  reply.message_.begin() + reply.length_);
+    if (!session->second->dirty_) {
+      session->second->dirty_ = true;
+      dirty_.push_back(reply.session_);
+    }
+  }
+
+  void DrainReplies() {
+    while (auto reply = replies_.TryPop())
+      Queue(*reply);
+  }
+
+  void Flush(Session &session) {
+    auto &output = session.output_;
+    while (session.outputBegin_ < output.size()) {
+      const ssize_t sent =
+          send(session.fd_, output.data() + session.outputBegin_,
+               output.size() - session.outputBegin_, MSG_NOSIGNAL);
+      if (sent < 0) {
+        if (errno == EAGAIN && !session.watchingWritable_) {
+          session.watchingWritable_ = true;
+          backend_->WatchWritable(session);
+        }
+        // On any other error the next receive reports the broken connection.
+        return;
+      }
+      session.outputBegin_ += static_cast<std::size_t>(sent);
+    }
+    output.clear();
+    session.outputBegin_ = 0;
+  }
+
+  void FlushDirty() {
+    for (const SessionId id : dirty_) {
+      if (Session *session = FindSession(id)) {
+        session->dirty_ = false;
+        Flush(*session);
+      }
+    }
+    dirty_.clear();
+  }
+
+  void RunIo() {
+    while (!stopping_.load(std::memory_order_relaxed)) {
+      bool block = false;
+      if (!busyPoll_) {
+        ioSleeping_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        block = replies_.IsEmpty();
+        if (!block)
+          ioSleeping_.store(false, std::memory_order_relaxed);
+      }
+      backend_->Poll(*this, block);
+      ioSleeping_.store(false, std::memory_order_relaxed);
+      DrainReplies();
+      FlushDirty();
+    }
+  }
+
+  void RunMatching() {
+    Matcher matcher{marketDataRing_.get()};
+    std::uint64_t replies = 0;
+    auto send = [this, &replies](const Reply &reply) {
+      while (!replies_.TryPush(reply))
+        WakeIoIfSleeping();
+      ++replies;
+    };
+    while (!stopping_.load(std::memory_order_relaxed)) {
+      bool executed = false;
+      while (auto command = commands_.TryPop()) {
+        matcher.Execute(*command, send);
+        executed = true;
+      }
+      if (executed) {
+        // One wakeup per drained batch, not per reply.
+        statistics_.replies_.store(replies, std::memory_order_relaxed);
+        WakeIoIfSleeping();
+        depthFeed_.Publish(matcher.GetOrderBook());
+        continue;
+      }
+      if (busyPoll_)
+        continue;
+
+      const auto epoch = matchingEpoch_.load();
+      matchingSleeping_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (commands_.IsEmpty() && !stopping_.load())
+        matchingEpoch_.wait(epoch);
+      matchingSleeping_.store(false, std::memory_order_relaxed);
+    }
+  }
+};
+
+} // namespace gateway
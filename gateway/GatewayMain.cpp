@@ -0,0 +1,87 @@
+#include <pthread.h>
+
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "Gateway.h"
+
+// gateway [port] [uring|epoll] [busy] [market data ring]
+// Serves one book on 127.0.0.1 until SIGINT or SIGTERM. io_uring is the
+// default and falls back to epoll where the kernel or a seccomp policy does
+// not allow it. Once a second, if the book changed, the main thread prints
+// the top of the depth the matching thread publishes. With a ring name
+// (e.g. /orderbook_md), the matching thread also publishes market data to
+// that shared-memory ring; `shm_loopback attach <name>` follows it.
+static void PrintDepth(const DepthSnapshot<gateway::Depth> &depth) {
+  auto best = [](const auto &levels, std::uint32_t count) {
+    return count ? std::to_string(levels[0].quantity_) + " @ " +
+                       std::to_string(levels[0].price_)
+                 : std::string{"-"};
+  };
+  std::cout << "depth: " << depth.bidCount_ << " bid levels, best "
+            << best(depth.bids_, depth.bidCount_) << " | " << depth.askCount_
+            << " ask levels, best " << best(depth.asks_, depth.askCount_)
+            << std::endl;
+}
+
+template <typename Backend>
+static void Serve(int listenFd, bool busyPoll, const std::string &marketDataRing,
+                  sigset_t &signals) {
+  // The queues are far too large for the stack.
+  const auto owned = std::make_unique<gateway::Gateway<Backend>>(
+      listenFd, busyPoll, marketDataRing);
+  auto &gateway = *owned;
+  std::thread io{[&gateway] { gateway.Run(); }};
+  std::cout << "Listening with " << Backend::Name
+            << (busyPoll ? " (busy polling)" : "") << std::endl;
+  const timespec second{1, 0};
+  std::uint64_t version = 0;
+  while (sigtimedwait(&signals, nullptr, &second) < 0) {
+    const auto &depthFeed = gateway.GetDepthFeed();
+    if (depthFeed.GetVersion() == version)
+      continue;
+    version = depthFeed.GetVersion();
+    PrintDepth(depthFeed.Load());
+  }
+  gateway.Stop();
+  io.join();
+
+  const auto &statistics = gateway.GetStatistics();
+  std::cout << statistics.sessions_ << " sessions, " << statistics.commands_
+            << " commands, " << statistics.replies_ << " replies" << std::endl;
+}
+
+static bool UringAvailable() {
+  try {
+    IoUring ring{8};
+    return true;
+  } catch (const std::system_error &) {
+    return false;
+  }
+}
+
+int main(int argc, char **argv) {
+  const auto port = static_cast<std::uint16_t>(argc > 1 ? std::stoul(argv[1])
+                                                        : 9000);
+  const bool epoll = argc > 2 && std::strcmp(argv[2], "epoll") == 0;
+  const bool busyPoll = argc > 3 && std::strcmp(argv[3], "busy") == 0;
+  const std::string marketDataRing = argc > 4 ? argv[4] : "";
+
+  // Blocked before any thread starts, so only sigwait sees them.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  const int listenFd = gateway::Listen(port);
+  if (!epoll && UringAvailable())
+    Serve<gateway::UringBackend>(listenFd, busyPoll, marketDataRing, signals);
+  else
+    Serve<gateway::EpollBackend>(listenFd, busyPoll, marketDataRing, signals);
+  close(listenFd);
+  return 0;
+}
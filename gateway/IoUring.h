@@ -0,0 +1,146 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+
+// Minimal io_uring ring on the raw system calls, so the gateway needs no
+// liburing. Submission entries are filled in place in the shared ring and
+// completions are read straight from the completion ring; the only system
+// call is io_uring_enter, made by Submit() and skipped entirely when there
+// is nothing to submit and nothing to wait for.
+class IoUring {
+public:
+  explicit IoUring(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd_ < 0)
+      throw std::system_error(errno, std::generic_category(),
+                              "io_uring_setup");
+
+    sqSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    singleMapping_ = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMapping_)
+      sqSize_ = cqSize_ = std::max(sqSize_, cqSize_);
+
+    sqRing_ = Map(sqSize_, IORING_OFF_SQ_RING);
+    cqRing_ = singleMapping_ ? sqRing_ : Map(cqSize_, IORING_OFF_CQ_RING);
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(Map(sqesSize_, IORING_OFF_SQES));
+
+    auto *sq = static_cast<std::byte *>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqEntries_ = params.sq_entries;
+
+    auto *cq = static_cast<std::byte *>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    tail_ = *sqTail_;
+    submitted_ = tail_;
+  }
+
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  ~IoUring() {
+    munmap(sqes_, sqesSize_);
+    if (!singleMapping_)
+      munmap(cqRing_, cqSize_);
+    munmap(sqRing_, sqSize_);
+    close(fd_);
+  }
+
+  // A zeroed submission entry, or nullptr if the submission ring is full;
+  // Submit() makes room.
+  io_uring_sqe *GetSqe() {
+    const unsigned head = std::atomic_ref{*sqHead_}.load(std::memory_order_acquire);
+    if (tail_ - head >= sqEntries_)
+      return nullptr;
+    const unsigned index = tail_ & sqMask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    ++tail_;
+    return sqe;
+  }
+
+  // Hands queued entries to the kernel and, if waitFor > 0, blocks until
+  // that many completions are available.
+  void Submit(unsigned waitFor = 0) {
+    const unsigned pending = tail_ - submitted_;
+    if (pending == 0 && waitFor == 0)
+      return;
+    std::atomic_ref{*sqTail_}.store(tail_, std::memory_order_release);
+    const long submitted =
+        syscall(__NR_io_uring_enter, fd_, pending, waitFor,
+                waitFor ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+    // EBUSY: the completion ring is backed up and the kernel takes no new
+    // entries until it has been drained.
+    if (submitted < 0) {
+      if (errno == EINTR || errno == EBUSY || errno == EAGAIN)
+        return;
+      throw std::system_error(errno, std::generic_category(),
+                              "io_uring_enter");
+    }
+    submitted_ += static_cast<unsigned>(submitted);
+  }
+
+  // Calls f(const io_uring_cqe &) for every available completion and
+  // returns their count. Never makes a system call. Each entry is copied and
+  // released before f sees it, so f may call ForEachCompletion again to
+  // drain the rest; the outer call then skips what the inner one took.
+  template <typename F> unsigned ForEachCompletion(F &&f) {
+    const unsigned tail =
+        std::atomic_ref{*cqTail_}.load(std::memory_order_acquire);
+    unsigned count = 0;
+    for (unsigned head = *cqHead_; static_cast<int>(tail - head) > 0;
+         head = *cqHead_) {
+      const io_uring_cqe cqe = cqes_[head & cqMask_];
+      std::atomic_ref{*cqHead_}.store(head + 1, std::memory_order_release);
+      f(cqe);
+      ++count;
+    }
+    return count;
+  }
+
+private:
+  int fd_;
+  bool singleMapping_;
+  std::size_t sqSize_, cqSize_, sqesSize_;
+  void *sqRing_, *cqRing_;
+  io_uring_sqe *sqes_;
+
+  unsigned *sqHead_, *sqTail_, *sqArray_;
+  unsigned sqMask_, sqEntries_;
+  unsigned *cqHead_, *cqTail_;
+  unsigned cqMask_;
+  io_uring_cqe *cqes_;
+
+  // Local submission tail and how much of it the kernel has consumed.
+  unsigned tail_, submitted_;
+
+  void *Map(std::size_t size, off_t offset) {
+    void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd_, offset);
+    if (mapping == MAP_FAILED)
+      throw std::system_error(errno, std::generic_category(), "mmap io_uring");
+    return mapping;
+  }
+};
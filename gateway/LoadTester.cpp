@@ -0,0 +1,192 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "../WireProtocol.h"
+#include "../bench/BenchUtil.h"
+
+// load_tester [port] [sessions] [messages/s] [seconds]
+// Opens sessions to a gateway on 127.0.0.1 and sends order entry messages
+// at a fixed total rate from one busy-polling thread: two thirds new orders
+// around a common price, so many trade, and one third cancels of earlier
+// orders of the same session. The gateway answers every message of a
+// session with exactly one Ack or Reject, in order, so each answer is
+// matched to the oldest unanswered send time of its session; that interval
+// is the wire-to-ack latency reported.
+using Clock = std::chrono::steady_clock;
+
+struct Session {
+  int fd_;
+  std::uint64_t nextOrder_{1};
+  std::vector<std::byte> output_;
+  std::vector<std::byte> input_;
+  std::deque<Clock::time_point> unanswered_;
+};
+
+static int Connect(std::uint16_t port) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  if (fd < 0 ||
+      connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    throw std::system_error(errno, std::generic_category(), "connect");
+  const int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+int main(int argc, char **argv) {
+  const auto port = static_cast<std::uint16_t>(argc > 1 ? std::stoul(argv[1])
+                                                        : 9000);
+  const std::size_t sessionCount = argc > 2 ? std::stoul(argv[2]) : 8;
+  const double rate = argc > 3 ? std::stod(argv[3]) : 200'000;
+  const double seconds = argc > 4 ? std::stod(argv[4]) : 5;
+
+  std::vector<Session> sessions(sessionCount);
+  for (std::size_t i = 0; i < sessionCount; ++i)
+    sessions[i].fd_ = Connect(port);
+
+  XorShift next;
+
+  std::vector<double> latencies;
+  latencies.reserve(static_cast<std::size_t>(rate * seconds));
+  std::uint64_t sent = 0, acks = 0, rejects = 0, trades = 0, cancels = 0;
+
+  auto queue = [&](Session &session, std::size_t index) {
+    const auto r = next();
+    const std::size_t at = session.output_.size();
+    if (r % 3 == 0 && session.nextOrder_ > 1) {
+      session.output_.resize(at + wire::CancelEncoder::Size);
+      // Order ids are unique per gateway, so the session is in the top bits.
+      wire::CancelEncoder{session.output_.data() + at}.SetOrderId(
+          index << 40 | (1 + (r >> 8) % (session.nextOrder_ - 1)));
+    } else {
+      const bool buy = (r >> 4) % 2 == 0;
+      const Price offset = static_cast<Price>((r >> 16) % 20) - 10;
+      session.output_.resize(at + wire::NewOrderEncoder::Size);
+      wire::NewOrderEncoder{session.output_.data() + at}
+          .SetOrderId(index << 40 | session.nextOrder_++)
+          .SetSide(buy ? Side::Buy : Side::Sell)
+          .SetOrderType(OrderType::GoodTillCancel)
+          .SetPrice(buy ? 1000 + offset : 1000 - offset)
+          .SetQuantity(static_cast<Quantity>(1 + (r >> 24) % 100))
+          .SetParticipantId(index);
+    }
+  };
+
+  auto receive = [&](Session &session) {
+    std::byte buffer[64 * 1024];
+    const ssize_t received = recv(session.fd_, buffer, sizeof(buffer),
+                                  MSG_DONTWAIT);
+    if (received <= 0)
+      return;
+    const auto now = Clock::now();
+    session.input_.insert(session.input_.end(), buffer, buffer + received);
+    std::size_t at = 0;
+    while (const std::size_t used =
+               wire::Decode(session.input_.data() + at,
+                            session.input_.size() - at, [&](const auto &m) {
+                              using Message = std::decay_t<decltype(m)>;
+                              if constexpr (std::is_same_v<Message,
+                                                           wire::AckDecoder>) {
+                                ++acks;
+                              } else if constexpr (std::is_same_v<
+                                                       Message,
+                                                       wire::RejectDecoder>) {
+                                ++rejects;
+                              } else {
+                                if constexpr (std::is_same_v<
+                                                  Message, wire::TradeDecoder>)
+                                  ++trades;
+                                if constexpr (std::is_same_v<
+                                                  Message, wire::CancelDecoder>)
+                                  ++cancels;
+                                return;
+                              }
+                              latencies.push_back(
+                                  std::chrono::duration<double, std::micro>(
+                                      now - session.unanswered_.front())
+                                      .count());
+                              session.unanswered_.pop_front();
+                            }))
+      at += used;
+    session.input_.erase(session.input_.begin(), session.input_.begin() + at);
+  };
+
+  const auto start = Clock::now();
+  const auto end = start + std::chrono::duration<double>(seconds);
+  std::size_t turn = 0;
+  for (auto now = start; now < end; now = Clock::now()) {
+    // Everything due by now, spread round robin over the sessions.
+    const auto due = static_cast<std::uint64_t>(
+        rate * std::chrono::duration<double>(now - start).count());
+    for (; sent < due; ++sent, ++turn) {
+      auto &session = sessions[turn % sessionCount];
+      queue(session, turn % sessionCount);
+      session.unanswered_.push_back(now);
+    }
+    for (auto &session : sessions) {
+      if (!session.output_.empty()) {
+        std::size_t written = 0;
+        while (written < session.output_.size()) {
+          const ssize_t n = send(session.fd_, session.output_.data() + written,
+                                 session.output_.size() - written,
+                                 MSG_NOSIGNAL);
+          if (n < 0)
+            throw std::system_error(errno, std::generic_category(), "send");
+          written += static_cast<std::size_t>(n);
+        }
+        session.output_.clear();
+      }
+      receive(session);
+    }
+  }
+  const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  // Collect the answers still in flight.
+  const auto deadline = Clock::now() + std::chrono::seconds{5};
+  auto outstanding = [&] {
+    std::size_t count = 0;
+    for (const auto &session : sessions)
+      count += session.unanswered_.size();
+    return count;
+  };
+  while (outstanding() != 0 && Clock::now() < deadline)
+    for (auto &session : sessions)
+      receive(session);
+  for (const auto &session : sessions)
+    close(session.fd_);
+
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies](double p) {
+    return latencies.empty()
+               ? 0.0
+               : latencies[std::min(latencies.size() - 1,
+                                    static_cast<std::size_t>(p *
+                                                             latencies.size()))];
+  };
+  std::cout << sent << " messages in " << elapsed << " s (" << sent / elapsed
+            << " msgs/s): " << acks << " acks, " << rejects << " rejects, "
+            << trades << " trade reports, " << cancels
+            << " unsolicited cancels, " << outstanding()
+            << " unanswered\n";
+  std::cout << "wire-to-ack us: p50 " << percentile(0.50) << ", p90 "
+            << percentile(0.90) << ", p99 " << percentile(0.99) << ", p99.9 "
+            << percentile(0.999) << ", max "
+            << (latencies.empty() ? 0.0 : latencies.back()) << "\n";
+  return outstanding() == 0 ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+
+#include "../WorkStealingPool.h"
+#include "Itch.h"
+
+// backtest <threads> <path>...
+// Replays every ITCH 5.0 file under the given files and directories (one
+// per symbol and day, e.g. 2019-01-30/AAPL.itch) on a work-stealing pool,
+// each into its own books, and adds up the executions per symbol over all
+// days. 0 threads means one per core.
+//
+// Files are submitted largest first, so the long replays start early and
+// the short ones fill in around them. Each worker keeps one OrderPool and
+// one pool resource for the books of every file it replays: a finished
+// file's books hand their nodes back to the worker's pool and the next
+// file's books reuse them, so after the first file or two a worker no
+// longer allocates from the system at all.
+namespace fs = std::filesystem;
+
+// CPU time of the calling thread, which unlike wall time does not grow
+// while the thread waits for a core.
+static double ThreadSeconds() {
+  timespec now;
+  ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+struct Worker {
+  std::pmr::unsynchronized_pool_resource memory_{
+      std::pmr::pool_options{0, std::size_t{1} << 22}};
+  OrderPool orderPool_{&memory_};
+};
+
+struct FileResult {
+  std::string symbol_;
+  ItchReplayer::Statistics statistics_;
+  double seconds_{0};
+};
+
+struct SymbolTotals {
+  std::uint64_t files_{0};
+  std::uint64_t messages_{0};
+  std::uint64_t executions_{0};
+  std::uint64_t shares_{0};
+  std::uint64_t notional_{0};
+  std::uint64_t unknownOrders_{0};
+  std::uint64_t crossingTrades_{0};
+};
+
+static std::vector<fs::path> CollectFiles(int argc, char **argv) {
+  std::vector<fs::path> files;
+  for (int i = 2; i < argc; ++i) {
+    if (fs::is_directory(argv[i])) {
+      for (const auto &entry : fs::recursive_directory_iterator(argv[i]))
+        if (entry.is_regular_file())
+          files.push_back(entry.path());
+    } else {
+      files.emplace_back(argv[i]);
+    }
+  }
+  std::sort(files.begin(), files.end(), [](const auto &l, const auto &r) {
+    return fs::file_size(l) > fs::file_size(r);
+  });
+  return files;
+}
+
+// The stock's symbol if the file holds a single book, else the file name.
+static std::string SymbolOf(const ItchReplayer &replayer, const fs::path &file) {
+  std::string_view symbol;
+  std::size_t books = 0;
+  for (std::size_t locate = 0; locate < (1 << 16); ++locate) {
+    if (replayer.GetBook(static_cast<std::uint16_t>(locate))) {
+      ++books;
+      symbol = replayer.GetSymbol(static_cast<std::uint16_t>(locate));
+    }
+  }
+  return books == 1 && !symbol.empty() ? std::string{symbol}
+                                       : file.stem().string();
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cerr << "usage: backtest <threads> <file or directory>...\n";
+    return 2;
+  }
+  std::size_t threads = std::stoul(argv[1]);
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  const auto files = CollectFiles(argc, argv);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  for (std::size_t i = 0; i < threads; ++i)
+    workers.push_back(std::make_unique<Worker>());
+  // One slot per file, each written by exactly one task.
+  std::vector<FileResult> results(files.size());
+  std::uint64_t bytes = 0;
+
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  std::uint64_t steals = 0;
+  {
+    WorkStealingPool pool{threads};
+    for (std::size_t i = 0; i < files.size(); ++i) {
+      bytes += fs::file_size(files[i]);
+      pool.Submit([&, i](std::size_t worker) {
+        const double begin = ThreadSeconds();
+        Worker &context = *workers[worker];
+        const MappedFile file{files[i].string()};
+        auto replayer = std::make_unique<ItchReplayer>(
+            std::string{}, &context.orderPool_, &context.memory_);
+        itch::ForEachMessage(file.GetData(), file.GetSize(),
+                             [&](const auto &message) {
+                               replayer->Apply(message);
+                             });
+        results[i].symbol_ = SymbolOf(*replayer, files[i]);
+        results[i].statistics_ = replayer->GetStatistics();
+        replayer.reset();
+        results[i].seconds_ = ThreadSeconds() - begin;
+      });
+    }
+    pool.Wait();
+    steals = pool.GetSteals();
+  }
+  const double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::map<std::string, SymbolTotals> totals;
+  SymbolTotals all;
+  double busy = 0;
+  for (const auto &result : results) {
+    const auto &statistics = result.statistics_;
+    for (SymbolTotals *sum : {&totals[result.symbol_], &all}) {
+      ++sum->files_;
+      sum->messages_ += statistics.messages_;
+      sum->executions_ += statistics.executions_;
+      sum->shares_ += statistics.executedShares_;
+      sum->notional_ += statistics.executedNotional_;
+      sum->unknownOrders_ += statistics.unknownOrders_;
+      sum->crossingTrades_ += statistics.crossingTrades_;
+    }
+    busy += result.seconds_;
+  }
+
+  std::vector<std::pair<std::string, SymbolTotals>> bySize(totals.begin(),
+                                                           totals.end());
+  std::sort(bySize.begin(), bySize.end(), [](const auto &l, const auto &r) {
+    return l.second.shares_ > r.second.shares_;
+  });
+  std::cout << std::fixed << std::setprecision(4);
+  for (std::size_t i = 0; i < std::min<std::size_t>(bySize.size(), 20); ++i) {
+    const auto &[symbol, sum] = bySize[i];
+    std::cout << std::left << std::setw(8) << symbol << std::right << " "
+              << sum.files_ << " days, " << sum.executions_ << " executions, "
+              << sum.shares_ << " shares, VWAP "
+              << (sum.shares_ ? static_cast<double>(sum.notional_) /
+                                    sum.shares_ / 1e4
+                              : 0.0)
+              << "\n";
+  }
+  std::cout << std::setprecision(2) << files.size() << " files, "
+            << totals.size() << " symbols, " << all.messages_
+            << " messages, " << all.executions_ << " executions, "
+            << all.unknownOrders_ << " unknown references, "
+            << all.crossingTrades_ << " trades from crossed books\n"
+            << threads << " threads: " << elapsed << " s wall, "
+            << all.messages_ / elapsed << " msgs/s, " << bytes / elapsed / 1e6
+            << " MB/s, " << busy << " s of replay CPU time ("
+            << 100 * busy / (elapsed * threads)
+            << "% of the threads' wall time), " << steals << " steals\n";
+  return 0;
+}
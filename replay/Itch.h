@@ -0,0 +1,461 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+
+#include "../BookMemory.h"
+
+// NASDAQ TotalView-ITCH 5.0, as found in the exchange's historical files: a
+// stream of messages, each preceded by its 2-byte big-endian length. Every
+// message starts with a type character, the stock locate code (the
+// instrument), a tracking number and a 6-byte timestamp in nanoseconds since
+// midnight; the views below read the rest of the fields in place, the same
+// way the wire protocol's decoders do, only big-endian. Prices are unsigned
+// with four implied decimals.
+namespace itch {
+
+template <typename T> T LoadBig(const std::byte *at) {
+  T value;
+  std::memcpy(&value, at, sizeof(T));
+  if constexpr (sizeof(T) == 2)
+    return static_cast<T>(__builtin_bswap16(value));
+  else if constexpr (sizeof(T) == 4)
+    return static_cast<T>(__builtin_bswap32(value));
+  else
+    return static_cast<T>(__builtin_bswap64(value));
+}
+
+// Fields every message has.
+class Message {
+public:
+  explicit Message(const std::byte *message) : message_{message} {}
+
+  char GetType() const { return static_cast<char>(message_[0]); }
+  std::uint16_t GetStockLocate() const {
+    return LoadBig<std::uint16_t>(message_ + 1);
+  }
+  Timestamp GetTimestamp() const {
+    return LoadBig<std::uint64_t>(message_ + 3) & 0xFFFF'FFFF'FFFFull;
+  }
+
+protected:
+  const std::byte *message_;
+
+  OrderId GetReference(std::size_t offset) const {
+    return LoadBig<std::uint64_t>(message_ + offset);
+  }
+  Quantity GetShares(std::size_t offset) const {
+    return LoadBig<std::uint32_t>(message_ + offset);
+  }
+  Price GetPriceAt(std::size_t offset) const {
+    return LoadBig<std::uint32_t>(message_ + offset);
+  }
+  // Alpha fields are left-justified and padded with spaces.
+  std::string_view GetAlpha(std::size_t offset, std::size_t length) const {
+    std::string_view field{reinterpret_cast<const char *>(message_ + offset),
+                           length};
+    return field.substr(0, field.find_last_not_of(' ') + 1);
+  }
+};
+
+// 'R': 11 stock (8)
+class StockDirectory : public Message {
+public:
+  static constexpr char Type = 'R';
+  static constexpr std::size_t Length = 39;
+  using Message::Message;
+
+  std::string_view GetStock() const { return GetAlpha(11, 8); }
+};
+
+// 'A': 11 reference, 19 side ('B'/'S'), 20 shares, 24 stock (8), 32 price.
+// 'F' is the same with a 4-byte attribution appended.
+class AddOrder : public Message {
+public:
+  static constexpr char Type = 'A';
+  static constexpr char AttributedType = 'F';
+  static constexpr std::size_t Length = 36;
+  using Message::Message;
+
+  OrderId GetReference() const { return Message::GetReference(11); }
+  Side GetSide() const {
+    return static_cast<char>(message_[19]) == 'B' ? Side::Buy : Side::Sell;
+  }
+  Quantity GetShares() const { return Message::GetShares(20); }
+  Price GetPrice() const { return GetPriceAt(32); }
+};
+
+// 'E': 11 reference, 19 executed shares, 23 match number
+class OrderExecuted : public Message {
+public:
+  static constexpr char Type = 'E';
+  static constexpr std::size_t Length = 31;
+  using Message::Message;
+
+  OrderId GetReference() const { return Message::GetReference(11); }
+  Quantity GetExecutedShares() const { return Message::GetShares(19); }
+};
+
+// 'C': 'E' plus 31 printable, 32 execution price (when the order traded at
+// a price other than its own, e.g. in a cross)
+class OrderExecutedWithPrice : public OrderExecuted {
+public:
+  static constexpr char Type = 'C';
+  static constexpr std::size_t Length = 36;
+  using OrderExecuted::OrderExecuted;
+
+  Price GetExecutionPrice() const { return GetPriceAt(32); }
+};
+
+// 'X': 11 reference, 19 cancelled shares
+class OrderCancel : public Message {
+public:
+  static constexpr char Type = 'X';
+  static constexpr std::size_t Length = 23;
+  using Message::Message;
+
+  OrderId GetReference() const { return Message::GetReference(11); }
+  Quantity GetCancelledShares() const { return Message::GetShares(19); }
+};
+
+// 'D': 11 reference
+class OrderDelete : public Message {
+public:
+  static constexpr char Type = 'D';
+  static constexpr std::size_t Length = 19;
+  using Message::Message;
+
+  OrderId GetReference() const { return Message::GetReference(11); }
+};
+
+// 'U': 11 original reference, 19 new reference, 27 shares, 31 price
+class OrderReplace : public Message {
+public:
+  static constexpr char Type = 'U';
+  static constexpr std::size_t Length = 35;
+  using Message::Message;
+
+  OrderId GetOriginalReference() const { return Message::GetReference(11); }
+  OrderId GetNewReference() const { return Message::GetReference(19); }
+  Quantity GetShares() const { return Message::GetShares(27); }
+  Price GetPrice() const { return GetPriceAt(31); }
+};
+
+// Calls handler with the view of every message of [data, data + size) that
+// one of the classes above covers, and handler(Message) for all others.
+// Returns the bytes consumed, which fall short of size only if the data ends
+// inside a message. Messages shorter than their type's layout are passed as
+// plain Messages rather than read past their end.
+template <typename Handler>
+std::size_t ForEachMessage(const std::byte *data, std::size_t size,
+                           Handler &&handler) {
+  std::size_t at = 0;
+  while (at + 2 <= size) {
+    const std::size_t length = LoadBig<std::uint16_t>(data + at);
+    if (length == 0 || at + 2 + length > size)
+      break;
+    const std::byte *message = data + at + 2;
+    auto dispatch = [&]<typename View>() {
+      if (length >= View::Length)
+        handler(View{message});
+      else
+        handler(Message{message});
+    };
+    switch (static_cast<char>(message[0])) {
+    case AddOrder::Type:
+    case AddOrder::AttributedType:
+      dispatch.template operator()<AddOrder>();
+      break;
+    case OrderExecuted::Type:
+      dispatch.template operator()<OrderExecuted>();
+      break;
+    case OrderExecutedWithPrice::Type:
+      dispatch.template operator()<OrderExecutedWithPrice>();
+      break;
+    case OrderCancel::Type:
+      dispatch.template operator()<OrderCancel>();
+      break;
+    case OrderDelete::Type:
+      dispatch.template operator()<OrderDelete>();
+      break;
+    case OrderReplace::Type:
+      dispatch.template operator()<OrderReplace>();
+      break;
+    case StockDirectory::Type:
+      dispatch.template operator()<StockDirectory>();
+      break;
+    default:
+      handler(Message{message});
+    }
+    at += 2 + length;
+  }
+  return at;
+}
+
+} // namespace itch
+
+// A whole file mapped read-only and advised for sequential reading, so the
+// kernel reads ahead of the replay and nothing is copied through read().
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::system_error(errno, std::generic_category(),
+                              std::format("open {}", path));
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+      const std::system_error error(errno, std::generic_category(),
+                                    std::format("fstat {}", path));
+      close(fd);
+      throw error;
+    }
+    size_ = static_cast<std::size_t>(status.st_size);
+    if (size_ != 0) {
+      void *mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping == MAP_FAILED) {
+        const std::system_error error(errno, std::generic_category(),
+                                      std::format("mmap {}", path));
+        close(fd);
+        throw error;
+      }
+      madvise(mapping, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const std::byte *>(mapping);
+    }
+    close(fd);
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile() {
+    if (data_)
+      munmap(const_cast<std::byte *>(data_), size_);
+  }
+
+  const std::byte *GetData() const { return data_; }
+  std::size_t GetSize() const { return size_; }
+
+private:
+  const std::byte *data_{nullptr};
+  std::size_t size_{0};
+};
+
+// Replays ITCH order messages into one OrderBook per stock locate, or only
+// into the book of one symbol. An exchange feed reports what its own
+// matching did, so adds go in as resting GoodTillCancel orders;
+// executions and partial cancels become OrderModify calls for the reduced
+// quantity (which, unlike the exchange, sends the order to the back of its
+// level), or cancels when nothing is left; replaces cancel the original and
+// add the new reference on the same side. Trades the book produces itself
+// mean the replayed book crossed, and are only counted.
+class ItchReplayer {
+public:
+  struct Statistics {
+    std::uint64_t messages_{0};
+    std::uint64_t adds_{0};
+    std::uint64_t executions_{0};
+    std::uint64_t cancels_{0};
+    std::uint64_t deletes_{0};
+    std::uint64_t replaces_{0};
+    // Order messages of a replayed stock for references its book lacks.
+    std::uint64_t unknownOrders_{0};
+    std::uint64_t crossingTrades_{0};
+    std::uint64_t executedShares_{0};
+    // Sum of shares times price, in price units.
+    std::uint64_t executedNotional_{0};
+  };
+
+  // An empty symbol replays every stock. Orders come from orderPool (or a
+  // pool of the replayer's own) and the books' memory from upstream, so a
+  // thread replaying one file after another can hand every replayer the
+  // same, already warm, pools.
+  explicit ItchReplayer(
+      std::string symbol = {}, OrderPool *orderPool = nullptr,
+      std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+      : symbol_{std::move(symbol)},
+        orderPool_{orderPool ? orderPool : &ownPool_}, upstream_{upstream} {}
+
+  // Applies one message. Returns true if it changed a book.
+  bool Apply(const itch::Message &) {
+    ++statistics_.messages_;
+    return false;
+  }
+
+  bool Apply(const itch::StockDirectory &message) {
+    ++statistics_.messages_;
+    symbols_[message.GetStockLocate()] = message.GetStock();
+    if (symbol_.empty() || message.GetStock() == symbol_)
+      Book(message.GetStockLocate());
+    return false;
+  }
+
+  bool Apply(const itch::AddOrder &message) {
+    ++statistics_.messages_;
+    OrderBook *book = Find(message.GetStockLocate());
+    if (!book)
+      return false;
+    ++statistics_.adds_;
+    statistics_.crossingTrades_ +=
+        book->AddOrder(orderPool_->Acquire(OrderType::GoodTillCancel,
+                                           message.GetReference(),
+                                           message.GetSide(), message.GetPrice(),
+                                           message.GetShares()))
+            .size();
+    return true;
+  }
+
+  bool Apply(const itch::OrderExecuted &message) {
+    return Execute(message, std::nullopt);
+  }
+
+  bool Apply(const itch::OrderExecutedWithPrice &message) {
+    return Execute(message, message.GetExecutionPrice());
+  }
+
+  bool Apply(const itch::OrderCancel &message) {
+    ++statistics_.messages_;
+    OrderBook *book = Find(message.GetStockLocate());
+    if (!book)
+      return false;
+    ++statistics_.cancels_;
+    return Reduce(*book, message.GetReference(), message.GetCancelledShares());
+  }
+
+  bool Apply(const itch::OrderDelete &message) {
+    ++statistics_.messages_;
+    OrderBook *book = Find(message.GetStockLocate());
+    if (!book)
+      return false;
+    ++statistics_.deletes_;
+    if (!book->Contains(message.GetReference()))
+      return Unknown();
+    book->CancelOrder(message.GetReference());
+    return true;
+  }
+
+  bool Apply(const itch::OrderReplace &message) {
+    ++statistics_.messages_;
+    OrderBook *book = Find(message.GetStockLocate());
+    if (!book)
+      return false;
+    ++statistics_.replaces_;
+    const Order *order = book->FindOrder(message.GetOriginalReference());
+    if (!order)
+      return Unknown();
+    const Side side = order->GetSide();
+    book->CancelOrder(message.GetOriginalReference());
+    statistics_.crossingTrades_ +=
+        book->AddOrder(orderPool_->Acquire(OrderType::GoodTillCancel,
+                                           message.GetNewReference(), side,
+                                           message.GetPrice(),
+                                           message.GetShares()))
+            .size();
+    return true;
+  }
+
+  const Statistics &GetStatistics() const { return statistics_; }
+
+  // The book of a stock locate, or nullptr if it is not replayed.
+  const OrderBook *GetBook(std::uint16_t locate) const {
+    return books_[locate].get();
+  }
+
+  // The symbol the stock directory gave a locate, empty if none did.
+  std::string_view GetSymbol(std::uint16_t locate) const {
+    const auto it = symbols_.find(locate);
+    return it == symbols_.end() ? std::string_view{} : it->second;
+  }
+
+  std::size_t GetBookCount() const {
+    std::size_t count = 0;
+    for (const auto &book : books_)
+      count += book != nullptr;
+    return count;
+  }
+
+private:
+  std::string symbol_;
+  OrderPool ownPool_;
+  OrderPool *orderPool_;
+  std::pmr::memory_resource *upstream_;
+  std::array<std::unique_ptr<OrderBook>, 1 << 16> books_;
+  std::unordered_map<std::uint16_t, std::string> symbols_;
+  Statistics statistics_;
+
+  // ITCH prices have four decimals and a tick of 0.0001.
+  OrderBook &Book(std::uint16_t locate) {
+    auto &book = books_[locate];
+    if (!book)
+      book = std::make_unique<OrderBook>(Instrument{4}, upstream_);
+    return *book;
+  }
+
+  // Without a symbol filter every locate gets a book on first use, so files
+  // that start mid-day (no directory messages) still replay.
+  OrderBook *Find(std::uint16_t locate) {
+    if (symbol_.empty())
+      return &Book(locate);
+    return books_[locate].get();
+  }
+
+  bool Unknown() {
+    ++statistics_.unknownOrders_;
+    return false;
+  }
+
+  bool Execute(const itch::OrderExecuted &message,
+               std::optional<Price> executionPrice) {
+    ++statistics_.messages_;
+    OrderBook *book = Find(message.GetStockLocate());
+    if (!book)
+      return false;
+    ++statistics_.executions_;
+    const Order *order = book->FindOrder(message.GetReference());
+    if (!order)
+      return Unknown();
+    const Quantity shares = message.GetExecutedShares();
+    statistics_.executedShares_ += shares;
+    statistics_.executedNotional_ +=
+        static_cast<std::uint64_t>(executionPrice.value_or(order->GetPrice())) *
+        shares;
+    return Reduce(*book, *order, shares);
+  }
+
+  bool Reduce(OrderBook &book, OrderId reference, Quantity shares) {
+    const Order *order = book.FindOrder(reference);
+    if (!order)
+      return Unknown();
+    return Reduce(book, *order, shares);
+  }
+
+  bool Reduce(OrderBook &book, const Order &order, Quantity shares) {
+    const OrderId reference = order.GetOrderId();
+    if (shares >= order.GetRemainingQuantity()) {
+      book.CancelOrder(reference);
+    } else {
+      statistics_.crossingTrades_ +=
+          book.MatchOrders(OrderModify{reference, order.GetSide(),
+                                        order.GetPrice(),
+                                        order.GetRemainingQuantity() - shares})
+              .size();
+    }
+    return true;
+  }
+};
@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "Itch.h"
+
+// itch_replay <file> [symbol] [latency]
+// Replays a NASDAQ ITCH 5.0 file (e.g. one of the daily samples published
+// on emi.nasdaq.com/ITCH) into one book per stock, or only the book of
+// symbol ("" or "*" for all), and reports the replay rate. With "latency",
+// every message that changes a book is timed on its own and the
+// distribution is printed as well; the clock reads slow the replay down, so
+// the rate of such a run is not the one to quote.
+
+// Nanosecond buckets up to 100 us, everything slower in the last one.
+class Histogram {
+public:
+  void Add(std::uint64_t nanoseconds) {
+    ++buckets_[std::min<std::uint64_t>(nanoseconds, buckets_.size() - 1)];
+    ++count_;
+    max_ = std::max(max_, nanoseconds);
+  }
+
+  std::uint64_t Percentile(double p) const {
+    const auto rank = static_cast<std::uint64_t>(p * count_);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < buckets_.size(); ++i)
+      if ((seen += buckets_[i]) > rank)
+        return i;
+    return max_;
+  }
+
+  std::uint64_t GetCount() const { return count_; }
+  std::uint64_t GetMax() const { return max_; }
+
+private:
+  std::array<std::uint64_t, 100'000> buckets_{};
+  std::uint64_t count_{0};
+  std::uint64_t max_{0};
+};
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "usage: itch_replay <file> [symbol] [latency]\n";
+    return 2;
+  }
+  std::string symbol = argc > 2 ? argv[2] : "";
+  if (symbol == "*")
+    symbol.clear();
+  const bool timed = argc > 3 && std::string{argv[3]} == "latency";
+
+  const MappedFile file{argv[1]};
+  OrderPool orderPool;
+  orderPool.Reserve(1 << 20);
+  auto replayer = std::make_unique<ItchReplayer>(symbol, &orderPool);
+  auto histogram = std::make_unique<Histogram>();
+
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  const std::size_t consumed = itch::ForEachMessage(
+      file.GetData(), file.GetSize(), [&](const auto &message) {
+        if (!timed) {
+          replayer->Apply(message);
+          return;
+        }
+        const auto before = Clock::now();
+        if (replayer->Apply(message))
+          histogram->Add(static_cast<std::uint64_t>(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  Clock::now() - before)
+                  .count()));
+      });
+  const double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  const auto &statistics = replayer->GetStatistics();
+  std::cout << statistics.messages_ << " messages (" << file.GetSize() / 1e6
+            << " MB) in " << elapsed << " s: " << statistics.messages_ / elapsed
+            << " msgs/s, " << file.GetSize() / elapsed / 1e6 << " MB/s\n"
+            << replayer->GetBookCount() << " books: " << statistics.adds_
+            << " adds, " << statistics.executions_ << " executions ("
+            << statistics.executedShares_ << " shares), " << statistics.cancels_
+            << " partial cancels, " << statistics.deletes_ << " deletes, "
+            << statistics.replaces_ << " replaces\n"
+            << statistics.unknownOrders_ << " unknown references, "
+            << statistics.crossingTrades_ << " trades from crossed books\n";
+  if (consumed != file.GetSize())
+    std::cout << file.GetSize() - consumed
+              << " bytes at the end do not form a whole message\n";
+  if (timed && histogram->GetCount() != 0)
+    std::cout << "ns per book message: p50 " << histogram->Percentile(0.5)
+              << ", p90 " << histogram->Percentile(0.9) << ", p99 "
+              << histogram->Percentile(0.99) << ", p99.9 "
+              << histogram->Percentile(0.999) << ", max "
+              << histogram->GetMax() << "\n";
+  return 0;
+}
@@ -0,0 +1,153 @@
+#include <grpcpp/grpcpp.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../bench/BenchUtil.h"
+#include "orderbook.grpc.pb.h"
+
+// Drives an OrderEntry server with several client threads, each keeping a
+// fixed number of calls in flight on its own completion queue, and reports
+// end-to-end latency (call start to reply) percentiles. Two thirds of the
+// calls add orders around a common price, so many of them trade; the rest
+// cancel an order the same thread added earlier.
+using Clock = std::chrono::steady_clock;
+
+struct Call {
+  Clock::time_point start_;
+  grpc::ClientContext context_;
+  grpc::Status status_;
+  orderbook::AddOrderResponse addResponse_;
+  orderbook::CancelOrderResponse cancelResponse_;
+  std::unique_ptr<grpc::ClientAsyncResponseReader<orderbook::AddOrderResponse>>
+      add_;
+  std::unique_ptr<
+      grpc::ClientAsyncResponseReader<orderbook::CancelOrderResponse>>
+      cancel_;
+};
+
+struct Result {
+  std::vector<double> latencies_;
+  std::size_t trades_{0};
+  std::size_t rejected_{0};
+  std::size_t failures_{0};
+};
+
+static Result Run(const std::shared_ptr<grpc::Channel> &channel,
+                  std::uint64_t firstOrderId, std::size_t count,
+                  std::size_t window) {
+  auto stub = orderbook::OrderEntry::NewStub(channel);
+  grpc::CompletionQueue completionQueue;
+  Result result;
+  result.latencies_.reserve(count);
+
+  XorShift next{0x853C49E6748FEA9Bull ^ firstOrderId};
+
+  std::uint64_t orderId = firstOrderId;
+  auto start = [&] {
+    auto *call = new Call;
+    const auto r = next();
+    call->start_ = Clock::now();
+    if (r % 3 == 0 && orderId > firstOrderId) {
+      orderbook::CancelOrderRequest request;
+      request.set_order_id(firstOrderId + (r >> 8) % (orderId - firstOrderId));
+      call->cancel_ =
+          stub->AsyncCancelOrder(&call->context_, request, &completionQueue);
+      call->cancel_->Finish(&call->cancelResponse_, &call->status_, call);
+      return;
+    }
+    orderbook::AddOrderRequest request;
+    const bool buy = (r >> 4) % 2 == 0;
+    const std::int64_t offset = static_cast<std::int64_t>((r >> 16) % 20) - 10;
+    request.set_order_id(orderId++);
+    request.set_type(orderbook::GOOD_TILL_CANCEL);
+    request.set_side(buy ? orderbook::BUY : orderbook::SELL);
+    request.set_price(buy ? 1000 + offset : 1000 - offset);
+    request.set_quantity(static_cast<std::uint32_t>(1 + (r >> 24) % 100));
+    call->add_ = stub->AsyncAddOrder(&call->context_, request, &completionQueue);
+    call->add_->Finish(&call->addResponse_, &call->status_, call);
+  };
+
+  std::size_t started = 0;
+  for (; started < std::min(window, count); ++started)
+    start();
+
+  void *tag;
+  bool ok;
+  for (std::size_t done = 0; done < count; ++done) {
+    completionQueue.Next(&tag, &ok);
+    std::unique_ptr<Call> call{static_cast<Call *>(tag)};
+    result.latencies_.push_back(std::chrono::duration<double, std::micro>(
+                                    Clock::now() - call->start_)
+                                    .count());
+    if (!ok || !call->status_.ok())
+      ++result.failures_;
+    result.trades_ += call->addResponse_.trades_size();
+    if (call->add_ && call->status_.ok() && !call->addResponse_.accepted())
+      ++result.rejected_;
+    if (started < count) {
+      start();
+      ++started;
+    }
+  }
+  completionQueue.Shutdown();
+  while (completionQueue.Next(&tag, &ok)) {
+  }
+  return result;
+}
+
+int main(int argc, char **argv) {
+  const std::string target = argc > 1 ? argv[1] : "127.0.0.1:50051";
+  const std::size_t threads = argc > 2 ? std::stoul(argv[2]) : 4;
+  const std::size_t window = argc > 3 ? std::stoul(argv[3]) : 32;
+  const std::size_t count = argc > 4 ? std::stoul(argv[4]) : 100'000;
+
+  // One channel per thread; gRPC would otherwise multiplex every call onto a
+  // single HTTP/2 connection.
+  std::vector<Result> results(threads);
+  std::vector<std::thread> workers;
+  const auto begin = Clock::now();
+  for (std::size_t i = 0; i < threads; ++i) {
+    grpc::ChannelArguments arguments;
+    arguments.SetInt("channel_id", static_cast<int>(i));
+    auto channel = grpc::CreateCustomChannel(
+        target, grpc::InsecureChannelCredentials(), arguments);
+    workers.emplace_back([&, i, channel] {
+      results[i] = Run(channel, 1 + i * count, count, window);
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+  const auto elapsed =
+      std::chrono::duration<double>(Clock::now() - begin).count();
+
+  std::vector<double> latencies;
+  std::size_t trades = 0, rejected = 0, failures = 0;
+  for (const auto &result : results) {
+    latencies.insert(latencies.end(), result.latencies_.begin(),
+                     result.latencies_.end());
+    trades += result.trades_;
+    rejected += result.rejected_;
+    failures += result.failures_;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies](double p) {
+    return latencies[std::min(latencies.size() - 1,
+                              static_cast<std::size_t>(p * latencies.size()))];
+  };
+
+  std::cout << latencies.size() << " calls in " << elapsed << " s ("
+            << latencies.size() / elapsed << " calls/s), " << trades
+            << " trades, " << rejected << " orders rejected, " << failures
+            << " failed\n";
+  std::cout << "latency us: p50 " << percentile(0.50) << ", p90 "
+            << percentile(0.90) << ", p99 " << percentile(0.99) << ", p99.9 "
+            << percentile(0.999) << ", max " << latencies.back() << "\n";
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+#include <grpcpp/grpcpp.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "orderbook.grpc.pb.h"
+
+// Subscribes to market data and prints the book as it changes. A delay per
+// update makes it a deliberately slow reader, to watch the server conflate:
+// sequence numbers then jump while the trade totals still add up.
+int main(int argc, char **argv) {
+  const std::string target = argc > 1 ? argv[1] : "127.0.0.1:50051";
+  const std::uint32_t depth = argc > 2 ? std::stoul(argv[2]) : 5;
+  const std::chrono::milliseconds delay{argc > 3 ? std::stoul(argv[3]) : 0};
+  const bool quiet = argc > 4 && std::string{argv[4]} == "quiet";
+
+  auto stub = orderbook::OrderEntry::NewStub(
+      grpc::CreateChannel(target, grpc::InsecureChannelCredentials()));
+  grpc::ClientContext context;
+  orderbook::SubscribeMarketDataRequest request;
+  request.set_depth(depth);
+  auto reader = stub->SubscribeMarketData(&context, request);
+
+  std::uint64_t updates = 0, conflated = 0, trades = 0, volume = 0;
+  std::uint64_t sequence = 0;
+  orderbook::MarketDataUpdate update;
+  while (reader->Read(&update)) {
+    ++updates;
+    if (sequence != 0)
+      conflated += update.sequence() - sequence - 1;
+    sequence = update.sequence();
+    trades += update.trade_count();
+    volume += update.traded_volume();
+
+    if (!quiet) {
+      std::cout << "#" << update.sequence() << " last "
+                << update.last_trade_price() << " trades +"
+                << update.trade_count() << " volume +"
+                << update.traded_volume() << " |";
+      for (int i = update.bids_size() - 1; i >= 0; --i)
+        std::cout << " " << update.bids(i).quantity() << "@"
+                  << update.bids(i).price();
+      std::cout << " |";
+      for (const auto &level : update.asks())
+        std::cout << " " << level.quantity() << "@" << level.price();
+      std::cout << "\n";
+    }
+    std::this_thread::sleep_for(delay);
+  }
+  const auto status = reader->Finish();
+
+  std::cout << updates << " updates, " << conflated << " states conflated, "
+            << trades << " trades, volume " << volume << " ("
+            << (status.ok() ? "ended" : status.error_message()) << ")"
+            << std::endl;
+  return status.ok() ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../Orderbook.h"
+
+// Levels per side carried by the market-data stream.
+inline constexpr std::size_t MarketDataDepth = 10;
+
+// The book as subscribers see it. Trade figures are running totals, so a
+// subscriber that skipped any number of states still gets the exact volume
+// traded since the last one it was sent, by difference.
+struct MarketDataState {
+  std::uint64_t sequence_{0};
+  std::uint64_t tradeCount_{0};
+  std::uint64_t tradedVolume_{0};
+  Price lastTradePrice_{0};
+  DepthSnapshot<MarketDataDepth> depth_;
+};
+
+// Latest market-data state, written by the matching thread after each batch
+// and read by the stream fan-out at its own pace. Being a Seqlock, a slow
+// reader costs the writer nothing and there is never more than one state to
+// hold, however far behind any subscriber is. Unlike a DepthFeed, the value
+// carries the trade totals along with the depth, so a reader never pairs
+// the depth of one batch with the totals of another.
+class MarketDataHub {
+public:
+  // Matching thread only; a MatchingEngine::BatchListener.
+  void Publish(const OrderBook &orderBook, const Trades &trades) {
+    const auto depth = orderBook.GetDepth<MarketDataDepth>();
+    if (trades.empty() && depth == state_.depth_)
+      return;
+
+    for (const auto &trade : trades) {
+      ++state_.tradeCount_;
+      state_.tradedVolume_ += trade.GetBidTrade().quantity_;
+    }
+    if (const auto &lastTradePrice = orderBook.GetLastTradePrice())
+      state_.lastTradePrice_ = *lastTradePrice;
+    state_.depth_ = depth;
+    ++state_.sequence_;
+    feed_.Store(state_);
+  }
+
+  // Any thread.
+  MarketDataState Load() const { return feed_.Load(); }
+
+private:
+  MarketDataState state_;
+  Seqlock<MarketDataState> feed_;
+};
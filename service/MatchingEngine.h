@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../BookMemory.h"
+
+// A request for the matching thread. Execute runs against the book and
+// appends any trades it caused to batchTrades; Complete runs once the whole
+// batch the command arrived in has been executed, so replies never hold up
+// matching of the commands queued behind them.
+class EngineCommand {
+public:
+  virtual void Execute(OrderBook &orderBook, OrderPool &orderPool,
+                       Trades &batchTrades) = 0;
+  virtual void Complete() = 0;
+
+protected:
+  ~EngineCommand() = default;
+};
+
+// Owns an OrderBook and the only thread that ever touches it. Any thread may
+// Submit() commands; they queue up while the matching thread is busy, and it
+// takes everything queued in one swap. Under load a single lock round trip
+// is therefore shared by a whole batch, and an idle engine sleeps instead of
+// spinning.
+class MatchingEngine {
+public:
+  // Called on the matching thread after every batch, before any of its
+  // commands complete, with the book and the trades of the whole batch.
+  using BatchListener = std::function<void(const OrderBook &, const Trades &)>;
+
+  explicit MatchingEngine(BatchListener onBatch = {},
+                          const Instrument &instrument = Instrument{})
+      : orderBook_{instrument}, onBatch_{std::move(onBatch)} {
+    thread_ = std::thread{[this] { Run(); }};
+  }
+
+  MatchingEngine(const MatchingEngine &) = delete;
+  MatchingEngine &operator=(const MatchingEngine &) = delete;
+
+  ~MatchingEngine() { Stop(); }
+
+  // The command must stay alive until its Complete() has been called.
+  void Submit(EngineCommand &command) {
+    {
+      std::lock_guard lock{mutex_};
+      pending_.push_back(&command);
+    }
+    wakeUp_.notify_one();
+  }
+
+  // Executes whatever is still queued, then joins the matching thread.
+  void Stop() {
+    {
+      std::lock_guard lock{mutex_};
+      stopping_ = true;
+    }
+    wakeUp_.notify_one();
+    if (thread_.joinable())
+      thread_.join();
+  }
+
+  std::uint64_t GetBatches() const {
+    return batches_.load(std::memory_order_relaxed);
+  }
+  std::uint64_t GetCommands() const {
+    return commands_.load(std::memory_order_relaxed);
+  }
+
+private:
+  OrderPool orderPool_;
+  OrderBook orderBook_;
+  BatchListener onBatch_;
+
+  std::mutex mutex_;
+  std::condition_variable wakeUp_;
+  std::vector<EngineCommand *> pending_;
+  bool stopping_{false};
+
+  std::atomic<std::uint64_t> batches_{0};
+  std::atomic<std::uint64_t> commands_{0};
+  std::thread thread_;
+
+  void Run() {
+    // Swapped with pending_, so both buffers keep their capacity.
+    std::vector<EngineCommand *> batch;
+    Trades trades;
+    for (;;) {
+      {
+        std::unique_lock lock{mutex_};
+        wakeUp_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        if (pending_.empty())
+          return;
+        batch.swap(pending_);
+      }
+      for (auto *command : batch)
+        command->Execute(orderBook_, orderPool_, trades);
+      if (onBatch_)
+        onBatch_(orderBook_, trades);
+      commands_.fetch_add(batch.size(), std::memory_order_relaxed);
+      batches_.fetch_add(1, std::memory_order_relaxed);
+      for (auto *command : batch)
+        command->Complete();
+      batch.clear();
+      trades.clear();
+    }
+  }
+};
@@ -0,0 +1,503 @@
+#pragma once
+
+#include <grpcpp/grpcpp.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MarketDataHub.h"
+#include "MatchingEngine.h"
+#include "orderbook.grpc.pb.h"
+
+namespace order_entry {
+
+using Service = orderbook::OrderEntry::AsyncService;
+
+inline std::optional<Side> FromProto(orderbook::Side side) {
+  switch (side) {
+  case orderbook::BUY:
+    return Side::Buy;
+  case orderbook::SELL:
+    return Side::Sell;
+  default:
+    return std::nullopt;
+  }
+}
+
+inline std::optional<OrderType> FromProto(orderbook::OrderType orderType) {
+  switch (orderType) {
+  case orderbook::GOOD_TILL_CANCEL:
+    return OrderType::GoodTillCancel;
+  case orderbook::FILL_OR_KILL:
+    return OrderType::FillOrkill;
+  case orderbook::MARKET:
+    return OrderType::Market;
+  case orderbook::GOOD_TILL_DATE:
+    return OrderType::GoodTillDate;
+  case orderbook::DAY:
+    return OrderType::Day;
+  default:
+    return std::nullopt;
+  }
+}
+
+inline void ToProto(const TradeInfo &info, orderbook::TradeInfo &out) {
+  out.set_order_id(info.orderId_);
+  out.set_price(info.price_);
+  out.set_quantity(info.quantity_);
+}
+
+inline void ToProto(const Trades &trades,
+                    google::protobuf::RepeatedPtrField<orderbook::Trade> &out) {
+  out.Reserve(static_cast<int>(trades.size()));
+  for (const auto &trade : trades) {
+    auto &message = *out.Add();
+    ToProto(trade.GetBidTrade(), *message.mutable_bid());
+    ToProto(trade.GetAskTrade(), *message.mutable_ask());
+    message.set_aggressor(trade.GetAggressorSide() == Side::Buy
+                              ? orderbook::BUY
+                              : orderbook::SELL);
+  }
+}
+
+// Levels to send when depth were asked for and available exist; 0 asks for
+// all of them.
+inline std::size_t Limit(std::size_t depth, std::size_t available) {
+  return depth == 0 ? available : std::min(depth, available);
+}
+
+// The first count entries of a LevelInfos or of a DepthSnapshot side.
+template <typename Levels>
+void ToProto(const Levels &levels, std::size_t count,
+             google::protobuf::RepeatedPtrField<orderbook::Level> &out) {
+  out.Reserve(static_cast<int>(count));
+  for (std::size_t i = 0; i < count; ++i) {
+    auto &level = *out.Add();
+    level.set_price(levels[i].price_);
+    level.set_quantity(levels[i].quantity_);
+  }
+}
+
+inline grpc::Status InvalidArgument(const std::string &message) {
+  return grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, message};
+}
+
+// One struct per RPC: its messages, the AsyncService method that accepts the
+// next call, and what the matching thread does with a request. Execute runs
+// on the matching thread and is the only place the book is touched.
+struct AddOrderRpc {
+  using Request = orderbook::AddOrderRequest;
+  using Response = orderbook::AddOrderResponse;
+  static constexpr auto Accept = &Service::RequestAddOrder;
+
+  static grpc::Status Execute(OrderBook &orderBook, OrderPool &orderPool,
+                              Trades &batchTrades, const Request &request,
+                              Response &response) {
+    const auto orderType = FromProto(request.type());
+    const auto side = FromProto(request.side());
+    if (!orderType || !side)
+      return InvalidArgument("unknown order type or side");
+    if (request.quantity() == 0)
+      return InvalidArgument("quantity must be positive");
+    // The book ignores a duplicate id, and afterwards the id would be found
+    // resting, so it has to be caught first.
+    if (orderBook.Contains(request.order_id())) {
+      response.set_accepted(false);
+      return grpc::Status::OK;
+    }
+
+    auto order = orderPool.Acquire(*orderType, request.order_id(), *side,
+                                   request.price(), request.quantity(),
+                                   request.participant_id());
+    if (*orderType == OrderType::GoodTillDate)
+      order->SetExpiry(request.expiry());
+    const auto trades = orderBook.AddOrder(std::move(order));
+    // Every other rejection leaves the order neither traded nor resting.
+    const Order *resting = orderBook.FindOrder(request.order_id());
+    response.set_accepted(!trades.empty() || resting);
+    response.set_resting_quantity(resting ? resting->GetRemainingQuantity()
+                                          : 0);
+    ToProto(trades, *response.mutable_trades());
+    batchTrades.insert(batchTrades.end(), trades.begin(), trades.end());
+    return grpc::Status::OK;
+  }
+};
+
+struct CancelOrderRpc {
+  using Request = orderbook::CancelOrderRequest;
+  using Response = orderbook::CancelOrderResponse;
+  static constexpr auto Accept = &Service::RequestCancelOrder;
+
+  static grpc::Status Execute(OrderBook &orderBook, OrderPool &, Trades &,
+                              const Request &request, Response &response) {
+    const auto size = orderBook.Size();
+    orderBook.CancelOrder(request.order_id());
+    response.set_cancelled(orderBook.Size() != size);
+    return grpc::Status::OK;
+  }
+};
+
+struct ModifyOrderRpc {
+  using Request = orderbook::ModifyOrderRequest;
+  using Response = orderbook::ModifyOrderResponse;
+  static constexpr auto Accept = &Service::RequestModifyOrder;
+
+  static grpc::Status Execute(OrderBook &orderBook, OrderPool &,
+                              Trades &batchTrades, const Request &request,
+                              Response &response) {
+    const auto side = FromProto(request.side());
+    if (!side)
+      return InvalidArgument("unknown side");
+    if (request.quantity() == 0)
+      return InvalidArgument("quantity must be positive");
+
+    const auto trades = orderBook.MatchOrders(OrderModify{
+        request.order_id(), *side, request.price(), request.quantity()});
+    ToProto(trades, *response.mutable_trades());
+    batchTrades.insert(batchTrades.end(), trades.begin(), trades.end());
+    return grpc::Status::OK;
+  }
+};
+
+struct GetDepthRpc {
+  using Request = orderbook::GetDepthRequest;
+  using Response = orderbook::GetDepthResponse;
+  static constexpr auto Accept = &Service::RequestGetDepth;
+
+  static grpc::Status Execute(OrderBook &orderBook, OrderPool &, Trades &,
+                              const Request &request, Response &response) {
+    const auto levels = orderBook.GetLevelInfos();
+    const auto &bids = levels.GetBids();
+    const auto &asks = levels.GetAsks();
+    ToProto(bids, Limit(request.depth(), bids.size()),
+            *response.mutable_bids());
+    ToProto(asks, Limit(request.depth(), asks.size()),
+            *response.mutable_asks());
+    return grpc::Status::OK;
+  }
+};
+
+// Completion queue tag; every event is routed back to the object it was
+// registered with.
+class CallTag {
+public:
+  virtual void Proceed(bool ok) = 0;
+
+protected:
+  ~CallTag() = default;
+};
+
+// State machine of one unary call. It first waits to be handed a request;
+// when one arrives it arms its replacement and goes to the matching engine,
+// whose thread sends the reply. The completion of that reply deletes it.
+template <typename Rpc>
+class UnaryCall final : public CallTag, public EngineCommand {
+public:
+  UnaryCall(Service &service, grpc::ServerCompletionQueue &completionQueue,
+            MatchingEngine &engine)
+      : service_{service}, completionQueue_{completionQueue}, engine_{engine},
+        responder_{&context_} {
+    (service_.*Rpc::Accept)(&context_, &request_, &responder_,
+                            &completionQueue_, &completionQueue_, this);
+  }
+
+  void Proceed(bool ok) override {
+    // Not ok while accepting means the server is shutting down.
+    if (replying_ || !ok) {
+      delete this;
+      return;
+    }
+    new UnaryCall{service_, completionQueue_, engine_};
+    replying_ = true;
+    engine_.Submit(*this);
+  }
+
+  void Execute(OrderBook &orderBook, OrderPool &orderPool,
+               Trades &batchTrades) override {
+    status_ =
+        Rpc::Execute(orderBook, orderPool, batchTrades, request_, response_);
+  }
+
+  void Complete() override { responder_.Finish(response_, status_, this); }
+
+private:
+  Service &service_;
+  grpc::ServerCompletionQueue &completionQueue_;
+  MatchingEngine &engine_;
+  grpc::ServerContext context_;
+  typename Rpc::Request request_;
+  typename Rpc::Response response_;
+  grpc::Status status_;
+  grpc::ServerAsyncResponseWriter<typename Rpc::Response> responder_;
+  bool replying_{false};
+};
+
+class SubscriptionCall;
+
+// The open market-data streams and the thread that feeds them. Every
+// interval it loads the hub's current state once and offers it to each
+// stream; a stream still writing its previous update simply declines, and
+// gets whatever is current at a later tick. Neither the matching thread nor
+// a fast subscriber ever waits for a slow one, and memory per subscriber is
+// one update.
+class MarketDataStreams {
+public:
+  MarketDataStreams(const MarketDataHub &hub,
+                    std::chrono::microseconds interval)
+      : hub_{hub}, interval_{interval} {
+    thread_ = std::thread{[this] { Run(); }};
+  }
+
+  MarketDataStreams(const MarketDataStreams &) = delete;
+  MarketDataStreams &operator=(const MarketDataStreams &) = delete;
+
+  ~MarketDataStreams() { Stop(); }
+
+  void Add(SubscriptionCall &call);
+  void Remove(SubscriptionCall &call);
+
+  // Stops feeding and ends every stream.
+  void Stop();
+
+private:
+  const MarketDataHub &hub_;
+  std::chrono::microseconds interval_;
+  std::mutex mutex_;
+  std::condition_variable wakeUp_;
+  std::vector<SubscriptionCall *> calls_;
+  bool stopping_{false};
+  std::thread thread_;
+
+  void Run();
+};
+
+// State machine of one market-data stream. At most one Write is outstanding
+// at a time, and each update is built when the stream is ready for it from
+// the state current at that moment, which is what conflates updates for a
+// slow reader. Offer and End come from other threads than the completion
+// queue, hence the mutex; MarketDataStreams' lock is always taken first.
+class SubscriptionCall final : public CallTag {
+public:
+  SubscriptionCall(Service &service,
+                   grpc::ServerCompletionQueue &completionQueue,
+                   MarketDataStreams &streams)
+      : service_{service}, completionQueue_{completionQueue},
+        streams_{streams}, writer_{&context_} {
+    service_.RequestSubscribeMarketData(&context_, &request_, &writer_,
+                                        &completionQueue_, &completionQueue_,
+                                        this);
+  }
+
+  void Proceed(bool ok) override {
+    std::unique_lock lock{mutex_};
+    switch (state_) {
+    case State::Accepting:
+      if (!ok) {
+        lock.unlock();
+        delete this;
+        return;
+      }
+      new SubscriptionCall{service_, completionQueue_, streams_};
+      state_ = State::Idle;
+      lock.unlock();
+      streams_.Add(*this);
+      return;
+    case State::Writing:
+      // Not ok means the subscriber went away.
+      if (ok && !ending_) {
+        state_ = State::Idle;
+        return;
+      }
+      Finish();
+      return;
+    case State::Idle:
+    case State::Finishing:
+      lock.unlock();
+      streams_.Remove(*this);
+      delete this;
+      return;
+    }
+  }
+
+  // Sends state unless a write is still outstanding or it was already sent.
+  void Offer(const MarketDataState &state) {
+    std::lock_guard lock{mutex_};
+    if (state_ != State::Idle || state.sequence_ == sequence_)
+      return;
+
+    update_.Clear();
+    update_.set_sequence(state.sequence_);
+    const auto &depth = state.depth_;
+    ToProto(depth.bids_, Limit(request_.depth(), depth.bidCount_),
+            *update_.mutable_bids());
+    ToProto(depth.asks_, Limit(request_.depth(), depth.askCount_),
+            *update_.mutable_asks());
+    update_.set_trade_count(state.tradeCount_ - tradeCount_);
+    update_.set_traded_volume(state.tradedVolume_ - tradedVolume_);
+    update_.set_last_trade_price(state.lastTradePrice_);
+    sequence_ = state.sequence_;
+    tradeCount_ = state.tradeCount_;
+    tradedVolume_ = state.tradedVolume_;
+
+    state_ = State::Writing;
+    writer_.Write(update_, this);
+  }
+
+  // Ends the stream once any outstanding write has completed.
+  void End() {
+    std::lock_guard lock{mutex_};
+    ending_ = true;
+    if (state_ == State::Idle)
+      Finish();
+  }
+
+private:
+  enum class State { Accepting, Idle, Writing, Finishing };
+
+  Service &service_;
+  grpc::ServerCompletionQueue &completionQueue_;
+  MarketDataStreams &streams_;
+  grpc::ServerContext context_;
+  orderbook::SubscribeMarketDataRequest request_;
+  orderbook::MarketDataUpdate update_;
+  grpc::ServerAsyncWriter<orderbook::MarketDataUpdate> writer_;
+
+  std::mutex mutex_;
+  State state_{State::Accepting};
+  bool ending_{false};
+  // What the subscriber has been sent so far.
+  std::uint64_t sequence_{0};
+  std::uint64_t tradeCount_{0};
+  std::uint64_t tradedVolume_{0};
+
+  void Finish() {
+    state_ = State::Finishing;
+    writer_.Finish(grpc::Status::OK, this);
+  }
+};
+
+inline void MarketDataStreams::Add(SubscriptionCall &call) {
+  std::unique_lock lock{mutex_};
+  if (stopping_) {
+    lock.unlock();
+    call.End();
+    return;
+  }
+  calls_.push_back(&call);
+}
+
+inline void MarketDataStreams::Remove(SubscriptionCall &call) {
+  std::lock_guard lock{mutex_};
+  std::erase(calls_, &call);
+}
+
+inline void MarketDataStreams::Stop() {
+  {
+    std::lock_guard lock{mutex_};
+    stopping_ = true;
+    for (auto *call : calls_)
+      call->End();
+  }
+  wakeUp_.notify_one();
+  if (thread_.joinable())
+    thread_.join();
+}
+
+inline void MarketDataStreams::Run() {
+  std::unique_lock lock{mutex_};
+  while (!wakeUp_.wait_for(lock, interval_, [this] { return stopping_; })) {
+    const auto state = hub_.Load();
+    for (auto *call : calls_)
+      call->Offer(state);
+  }
+}
+
+} // namespace order_entry
+
+// Asynchronous gRPC front end of a MatchingEngine. A few threads, each
+// draining its own completion queue, accept calls and hand them to the
+// engine; there is no thread per call and no RPC thread ever touches the
+// book. Calls that arrive while the engine is matching are executed as one
+// batch. Market-data streams are fed from the hub the engine publishes to,
+// at most once per interval.
+class OrderEntryServer {
+public:
+  OrderEntryServer(
+      MatchingEngine &engine, const MarketDataHub &hub,
+      const std::string &address, std::size_t threads = 2,
+      std::chrono::microseconds interval = std::chrono::milliseconds{1})
+      : streams_{hub, interval} {
+    grpc::ServerBuilder builder;
+    builder.AddListeningPort(address, grpc::InsecureServerCredentials());
+    builder.RegisterService(&service_);
+    for (std::size_t i = 0; i < threads; ++i)
+      completionQueues_.push_back(builder.AddCompletionQueue());
+    server_ = builder.BuildAndStart();
+    if (!server_) {
+      throw std::runtime_error(std::format("Cannot listen on {}", address));
+    }
+
+    for (auto &completionQueue : completionQueues_) {
+      for (std::size_t i = 0; i < CallsPerQueue; ++i) {
+        new order_entry::UnaryCall<order_entry::AddOrderRpc>{
+            service_, *completionQueue, engine};
+        new order_entry::UnaryCall<order_entry::CancelOrderRpc>{
+            service_, *completionQueue, engine};
+        new order_entry::UnaryCall<order_entry::ModifyOrderRpc>{
+            service_, *completionQueue, engine};
+        new order_entry::UnaryCall<order_entry::GetDepthRpc>{
+            service_, *completionQueue, engine};
+        new order_entry::SubscriptionCall{service_, *completionQueue,
+                                          streams_};
+      }
+      threads_.emplace_back([&queue = *completionQueue] { Drain(queue); });
+    }
+  }
+
+  OrderEntryServer(const OrderEntryServer &) = delete;
+  OrderEntryServer &operator=(const OrderEntryServer &) = delete;
+
+  ~OrderEntryServer() { Shutdown(); }
+
+  // Ends all market-data streams and waits for calls in flight to be
+  // answered, so the engine must still be running.
+  void Shutdown() {
+    if (threads_.empty())
+      return;
+    streams_.Stop();
+    server_->Shutdown();
+    for (auto &completionQueue : completionQueues_)
+      completionQueue->Shutdown();
+    for (auto &thread : threads_)
+      thread.join();
+    threads_.clear();
+  }
+
+private:
+  // Calls of each kind kept accepting per queue, so a burst of requests does
+  // not have to wait for calls to be re-armed one by one.
+  static constexpr std::size_t CallsPerQueue = 16;
+
+  order_entry::Service service_;
+  order_entry::MarketDataStreams streams_;
+  std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> completionQueues_;
+  std::unique_ptr<grpc::Server> server_;
+  std::vector<std::thread> threads_;
+
+  static void Drain(grpc::ServerCompletionQueue &completionQueue) {
+    void *tag;
+    bool ok;
+    while (completionQueue.Next(&tag, &ok))
+      static_cast<order_entry::CallTag *>(tag)->Proceed(ok);
+  }
+};
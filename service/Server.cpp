@@ -0,0 +1,42 @@
+#include <csignal>
+#include <iostream>
+#include <string>
+
+#include "OrderEntryServer.h"
+
+// Serves one book until SIGINT or SIGTERM.
+int main(int argc, char **argv) {
+  const std::string address = argc > 1 ? argv[1] : "127.0.0.1:50051";
+  const std::size_t threads = argc > 2 ? std::stoul(argv[2]) : 2;
+
+  // Blocked before any thread starts, so every thread inherits the mask and
+  // only sigwait below sees the signals.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  MarketDataHub hub;
+  MatchingEngine engine{[&hub](const OrderBook &orderBook,
+                               const Trades &trades) {
+    hub.Publish(orderBook, trades);
+  }};
+  {
+    OrderEntryServer server{engine, hub, address, threads};
+    std::cout << "Listening on " << address << std::endl;
+    int signal = 0;
+    sigwait(&signals, &signal);
+  }
+  engine.Stop();
+
+  const auto batches = engine.GetBatches();
+  std::cout << engine.GetCommands() << " commands in " << batches
+            << " batches";
+  if (batches != 0)
+    std::cout << ", "
+              << static_cast<double>(engine.GetCommands()) / batches
+              << " per batch";
+  std::cout << std::endl;
+  return 0;
+}
@@ -0,0 +1,570 @@
+#pragma once
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../BookMemory.h"
+#include "../TimerWheel.h"
+#include "../TradeStatistics.h"
+
+// Discrete-event simulation of strategies trading against an OrderBook over
+// links with latency, on one thread. Each strategy (or flow of background
+// orders) is a coroutine that sends requests through its Session and
+// co_awaits the exchange's answers, its fills or a simulated delay; while it
+// is suspended the simulator runs whatever is due next. Time is the book's
+// Timestamp (nanoseconds) and only moves from one event to the next, so a
+// run is exactly reproducible and takes as long as its events, not as long
+// as the simulated day.
+namespace sim {
+
+class Simulator;
+
+// A simulated process: a coroutine returning Process, handed to
+// Simulator::Spawn, which starts it at the current simulated time and frees
+// it once it returns. An exception escaping a process ends Simulator::Run.
+class Process {
+public:
+  struct promise_type;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  // Lets the simulator know when the coroutine has finished, from inside
+  // its final suspension, where it may be destroyed.
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    void await_suspend(Handle handle) noexcept;
+    void await_resume() noexcept {}
+  };
+
+  struct promise_type {
+    Simulator *simulator_{nullptr};
+    std::exception_ptr exception_;
+
+    Process get_return_object() { return Process{Handle::from_promise(*this)}; }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { exception_ = std::current_exception(); }
+  };
+
+  Process(Process &&other) noexcept
+      : handle_{std::exchange(other.handle_, {})} {}
+  Process(const Process &) = delete;
+  Process &operator=(const Process &) = delete;
+  ~Process() {
+    if (handle_)
+      handle_.destroy();
+  }
+
+private:
+  friend class Simulator;
+  explicit Process(Handle handle) : handle_{handle} {}
+  Handle Release() { return std::exchange(handle_, {}); }
+
+  Handle handle_;
+};
+
+class Simulator {
+public:
+  Simulator() = default;
+  Simulator(const Simulator &) = delete;
+  Simulator &operator=(const Simulator &) = delete;
+
+  ~Simulator() {
+    for (auto handle : processes_)
+      handle.destroy();
+  }
+
+  Timestamp Now() const { return now_; }
+  std::uint64_t GetEventCount() const { return events_; }
+  std::size_t GetProcessCount() const { return processes_.size(); }
+
+  // Something due at a simulated time: fire(target). Events due at the same
+  // time fire in the order they were scheduled.
+  struct Event {
+    void (*fire_)(void *target);
+    void *target_;
+  };
+
+  void Schedule(Timestamp at, Event event) {
+    wheel_.Schedule(std::max(at, now_), event);
+  }
+
+  void Schedule(Timestamp at, std::coroutine_handle<> handle) {
+    Schedule(at, Event{[](void *address) {
+                         std::coroutine_handle<>::from_address(address).resume();
+                       },
+                       handle.address()});
+  }
+
+  void Spawn(Process process) {
+    auto handle = process.Release();
+    handle.promise().simulator_ = this;
+    processes_.push_back(handle);
+    Schedule(now_, handle);
+  }
+
+  // Fires events in time order until none are due by until, then leaves the
+  // clock at until (or at the last event, if until is left open).
+  void Run(Timestamp until = std::numeric_limits<Timestamp>::max()) {
+    wheel_.Advance(until, [this](Event &event) {
+      now_ = wheel_.GetCurrentTick();
+      ++events_;
+      event.fire_(event.target_);
+      if (failure_)
+        std::rethrow_exception(std::exchange(failure_, nullptr));
+    });
+    if (until != std::numeric_limits<Timestamp>::max())
+      now_ = std::max(now_, until);
+  }
+
+  struct SleepAwaiter {
+    Simulator &simulator_;
+    Timestamp at_;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      simulator_.Schedule(at_, handle);
+    }
+    void await_resume() const noexcept {}
+  };
+
+  // co_await simulator.Sleep(duration) resumes the caller duration later.
+  SleepAwaiter Sleep(Timestamp duration) { return {*this, now_ + duration}; }
+  SleepAwaiter SleepUntil(Timestamp at) { return {*this, at}; }
+
+private:
+  friend struct Process::FinalAwaiter;
+
+  TimerWheel<Event> wheel_;
+  Timestamp now_{0};
+  std::uint64_t events_{0};
+  std::vector<Process::Handle> processes_;
+  std::exception_ptr failure_;
+
+  void Finished(Process::Handle handle) {
+    if (handle.promise().exception_ && !failure_)
+      failure_ = handle.promise().exception_;
+    processes_.erase(std::find(processes_.begin(), processes_.end(), handle));
+    handle.destroy();
+  }
+};
+
+inline void Process::FinalAwaiter::await_suspend(Handle handle) noexcept {
+  handle.promise().simulator_->Finished(handle);
+}
+
+// One-way delay of a link, plus up to jitter more, drawn uniformly per
+// message. Messages on a link still arrive in the order they were sent, as
+// they would over TCP: a message is never delivered before its predecessor.
+struct Latency {
+  Timestamp toExchange_{0};
+  Timestamp fromExchange_{0};
+  Timestamp jitter_{0};
+};
+
+enum class RequestType { New, Cancel, Modify };
+
+struct Request {
+  RequestType type_;
+  std::uint64_t sequence_;
+  OrderId orderId_;
+  OrderType orderType_;
+  Side side_;
+  Price price_;
+  Quantity quantity_;
+};
+
+// Accepted, Rejected and Cancelled answer a request and carry its sequence
+// number. An order the book neither filled at all nor kept is Rejected.
+// Filled, the Cancelled that ends an order the book did not keep (a market
+// order's unfilled remainder, an expiry) and TopOfBook arrive on their own,
+// with sequence 0.
+enum class ReportType { Accepted, Rejected, Filled, Cancelled, TopOfBook };
+
+struct Report {
+  ReportType type_{ReportType::Rejected};
+  std::uint64_t sequence_{0};
+  OrderId orderId_{0};
+  // Fill price and quantity; the quantity left for Accepted and Cancelled.
+  Price price_{0};
+  Quantity quantity_{0};
+  // When the exchange produced the report; the session sees it later.
+  Timestamp exchangeTime_{0};
+  TopOfBook topOfBook_{};
+  // Which side of the trade a Filled order was on.
+  Side side_{Side::Buy};
+};
+
+class Exchange;
+
+// Messages in flight in one direction, delivered in order to
+// receiver.Deliver(message) once their latency has passed.
+template <typename Message, typename Receiver> class Link {
+public:
+  Link(Simulator &simulator, Receiver &receiver, Timestamp delay,
+       Timestamp jitter, std::uint64_t seed)
+      : simulator_{simulator}, receiver_{receiver}, delay_{delay},
+        jitter_{jitter}, random_{seed} {}
+
+  Link(const Link &) = delete;
+  Link &operator=(const Link &) = delete;
+
+  void Send(Message message) {
+    Timestamp at = simulator_.Now() + delay_;
+    if (jitter_ != 0)
+      at += random_() % (jitter_ + 1);
+    last_ = std::max(last_, at);
+    inFlight_.push_back(std::move(message));
+    simulator_.Schedule(last_, {&Link::DeliverNext, this});
+  }
+
+  std::size_t GetInFlight() const { return inFlight_.size(); }
+
+private:
+  Simulator &simulator_;
+  Receiver &receiver_;
+  Timestamp delay_;
+  Timestamp jitter_;
+  std::minstd_rand random_;
+  Timestamp last_{0};
+  std::deque<Message> inFlight_;
+
+  static void DeliverNext(void *target) {
+    auto &link = *static_cast<Link *>(target);
+    Message message = std::move(link.inFlight_.front());
+    link.inFlight_.pop_front();
+    link.receiver_.Deliver(std::move(message));
+  }
+};
+
+// A strategy's connection to the exchange. Send*() put a request on the
+// wire and return at once; Submit(), Cancel() and Modify() send and suspend
+// the caller until the exchange's answer is back. Fills, unsolicited cancels
+// and (after Subscribe()) top of book changes queue up until Receive() or
+// TryReceive() takes them, including those that arrive while the caller
+// waits for an answer. One coroutine at a time may wait on a session.
+class Session {
+public:
+  Session(Simulator &simulator, Exchange &exchange, ParticipantId id,
+          const Latency &latency)
+      : simulator_{simulator}, exchange_{exchange}, id_{id},
+        toExchange_{simulator, *this, latency.toExchange_, latency.jitter_,
+                    id * 2 + 1},
+        fromExchange_{simulator, *this, latency.fromExchange_, latency.jitter_,
+                      id * 2 + 2} {}
+
+  Session(const Session &) = delete;
+  Session &operator=(const Session &) = delete;
+
+  ParticipantId GetId() const { return id_; }
+  Simulator &GetSimulator() const { return simulator_; }
+
+  // Returns the id the new order will have in the book.
+  OrderId SendNew(OrderType orderType, Side side, Price price,
+                  Quantity quantity);
+  void SendCancel(OrderId orderId) {
+    Send({RequestType::Cancel, ++sequence_, orderId, {}, {}, 0, 0});
+  }
+  void SendModify(OrderId orderId, Side side, Price price, Quantity quantity) {
+    Send({RequestType::Modify, ++sequence_, orderId, {}, side, price,
+          quantity});
+  }
+
+  // co_await session.Submit(...) returns the Accepted or Rejected report;
+  // its orderId_ is the new order's.
+  auto Submit(OrderType orderType, Side side, Price price, Quantity quantity) {
+    SendNew(orderType, side, price, quantity);
+    return Awaiter{*this, sequence_};
+  }
+  auto Cancel(OrderId orderId) {
+    SendCancel(orderId);
+    return Awaiter{*this, sequence_};
+  }
+  auto Modify(OrderId orderId, Side side, Price price, Quantity quantity) {
+    SendModify(orderId, side, price, quantity);
+    return Awaiter{*this, sequence_};
+  }
+
+  // co_await session.Receive() returns the oldest report not yet taken,
+  // waiting for one if there is none.
+  auto Receive() { return Awaiter{*this, 0}; }
+
+  bool TryReceive(Report &report) {
+    if (inbox_.empty())
+      return false;
+    report = inbox_.front();
+    inbox_.pop_front();
+    return true;
+  }
+
+  // Top of book changes are sent to the session from now on.
+  void Subscribe() { subscribed_ = true; }
+  bool IsSubscribed() const { return subscribed_; }
+
+  // The latest top of book that has reached the session.
+  const TopOfBook &GetTopOfBook() const { return topOfBook_; }
+
+private:
+  friend class Exchange;
+  template <typename, typename> friend class Link;
+
+  struct Awaiter {
+    Session &session_;
+    std::uint64_t sequence_;
+
+    bool await_ready() const noexcept {
+      return sequence_ == 0 && !session_.inbox_.empty();
+    }
+    void await_suspend(std::coroutine_handle<> handle) {
+      session_.waiter_ = handle;
+      session_.waitingFor_ = sequence_;
+    }
+    Report await_resume() {
+      if (sequence_ != 0)
+        return session_.answer_;
+      Report report = session_.inbox_.front();
+      session_.inbox_.pop_front();
+      return report;
+    }
+  };
+
+  Simulator &simulator_;
+  Exchange &exchange_;
+  ParticipantId id_;
+  Link<Request, Session> toExchange_;
+  Link<Report, Session> fromExchange_;
+  std::uint64_t sequence_{0};
+  bool subscribed_{false};
+  TopOfBook topOfBook_;
+
+  std::deque<Report> inbox_;
+  std::coroutine_handle<> waiter_;
+  std::uint64_t waitingFor_{0};
+  Report answer_{};
+
+  void Send(const Request &request) { toExchange_.Send(request); }
+
+  // At the exchange end of the link.
+  void Deliver(Request request);
+
+  // At the strategy end.
+  void Deliver(Report report) {
+    if (report.type_ == ReportType::TopOfBook)
+      topOfBook_ = report.topOfBook_;
+    if (waiter_ && waitingFor_ != 0 && report.sequence_ == waitingFor_) {
+      answer_ = report;
+      std::exchange(waiter_, {}).resume();
+      return;
+    }
+    inbox_.push_back(report);
+    if (waiter_ && waitingFor_ == 0)
+      std::exchange(waiter_, {}).resume();
+  }
+};
+
+// The exchange end of every session: executes requests on the book as they
+// arrive and sends each order's owner its answers and fills.
+class Exchange {
+public:
+  // Trade statistics close a bar every barInterval and every barVolume.
+  explicit Exchange(Simulator &simulator,
+                    const Instrument &instrument = Instrument{},
+                    Timestamp barInterval = 1'000'000'000,
+                    std::uint64_t barVolume = 10'000)
+      : simulator_{simulator}, orderBook_{instrument},
+        statistics_{barInterval, barVolume} {}
+
+  Exchange(const Exchange &) = delete;
+  Exchange &operator=(const Exchange &) = delete;
+
+  Session &Connect(const Latency &latency) {
+    sessions_.push_back(std::make_unique<Session>(
+        simulator_, *this, static_cast<ParticipantId>(sessions_.size() + 1),
+        latency));
+    return *sessions_.back();
+  }
+
+  const OrderBook &GetBook() const { return orderBook_; }
+  std::uint64_t GetRequestCount() const { return requests_; }
+  std::uint64_t GetTradeCount() const { return statistics_.GetTradeCount(); }
+  const TradeStatistics &GetStatistics() const { return statistics_; }
+
+private:
+  friend class Session;
+
+  Simulator &simulator_;
+  OrderPool orderPool_;
+  OrderBook orderBook_;
+  std::vector<std::unique_ptr<Session>> sessions_;
+  // Which session entered each order still in the book.
+  std::unordered_map<OrderId, Session *> owners_;
+  OrderId nextOrderId_{1};
+  TopOfBook topOfBook_;
+  std::uint64_t requests_{0};
+  TradeStatistics statistics_;
+
+  OrderId NextOrderId() { return nextOrderId_++; }
+
+  Report MakeReport(ReportType type, std::uint64_t sequence, OrderId orderId,
+                    Price price, Quantity quantity) const {
+    return {type, sequence, orderId, price, quantity, simulator_.Now(), {}};
+  }
+
+  Quantity Remaining(OrderId orderId) const {
+    const Order *order = orderBook_.FindOrder(orderId);
+    return order ? order->GetRemainingQuantity() : 0;
+  }
+
+  void Execute(Session &session, const Request &request) {
+    ++requests_;
+    Expire();
+    switch (request.type_) {
+    case RequestType::New:
+      New(session, request);
+      break;
+    case RequestType::Cancel:
+      Cancel(session, request);
+      break;
+    case RequestType::Modify:
+      Modify(session, request);
+      break;
+    }
+    PublishTopOfBook();
+  }
+
+  void New(Session &session, const Request &request) {
+    const auto reject = MakeReport(ReportType::Rejected, request.sequence_,
+                                   request.orderId_, request.price_, 0);
+    if (request.quantity_ == 0 || orderBook_.Contains(request.orderId_))
+      return session.fromExchange_.Send(reject);
+
+    owners_[request.orderId_] = &session;
+    const auto trades = orderBook_.AddOrder(orderPool_.Acquire(
+        request.orderType_, request.orderId_, request.side_, request.price_,
+        request.quantity_, session.id_));
+    const bool resting = orderBook_.Contains(request.orderId_);
+    if (trades.empty() && !resting) {
+      owners_.erase(request.orderId_);
+      return session.fromExchange_.Send(reject);
+    }
+    session.fromExchange_.Send(
+        MakeReport(ReportType::Accepted, request.sequence_, request.orderId_,
+                   request.price_, resting ? Remaining(request.orderId_) : 0));
+    const Quantity filled = ReportTrades(trades, request.orderId_);
+    if (resting)
+      return;
+    owners_.erase(request.orderId_);
+    if (filled < request.quantity_)
+      session.fromExchange_.Send(MakeReport(ReportType::Cancelled, 0,
+                                            request.orderId_, request.price_,
+                                            request.quantity_ - filled));
+  }
+
+  void Cancel(Session &session, const Request &request) {
+    if (!Owns(session, request.orderId_))
+      return session.fromExchange_.Send(MakeReport(
+          ReportType::Rejected, request.sequence_, request.orderId_, 0, 0));
+    const Order &order = *orderBook_.FindOrder(request.orderId_);
+    const auto report =
+        MakeReport(ReportType::Cancelled, request.sequence_, request.orderId_,
+                   order.GetPrice(), order.GetRemainingQuantity());
+    orderBook_.CancelOrder(request.orderId_);
+    owners_.erase(request.orderId_);
+    session.fromExchange_.Send(report);
+  }
+
+  void Modify(Session &session, const Request &request) {
+    if (request.quantity_ == 0 || !Owns(session, request.orderId_))
+      return session.fromExchange_.Send(
+          MakeReport(ReportType::Rejected, request.sequence_,
+                     request.orderId_, request.price_, 0));
+    const auto trades = orderBook_.MatchOrders(OrderModify{
+        request.orderId_, request.side_, request.price_, request.quantity_});
+    session.fromExchange_.Send(MakeReport(
+        ReportType::Accepted, request.sequence_, request.orderId_,
+        request.price_, Remaining(request.orderId_)));
+    ReportTrades(trades, request.orderId_);
+    if (!orderBook_.Contains(request.orderId_))
+      owners_.erase(request.orderId_);
+  }
+
+  bool Owns(const Session &session, OrderId orderId) const {
+    const auto owner = owners_.find(orderId);
+    return owner != owners_.end() && owner->second == &session &&
+           orderBook_.Contains(orderId);
+  }
+
+  // Sends both sides of every trade to their owners and forgets orders the
+  // trades finished. Returns the quantity order traded.
+  Quantity ReportTrades(const Trades &trades, OrderId order) {
+    Quantity filled = 0;
+    for (const auto &trade : trades) {
+      statistics_.Add(trade, simulator_.Now());
+      for (const Side side : {Side::Buy, Side::Sell}) {
+        const TradeInfo &info =
+            side == Side::Buy ? trade.GetBidTrade() : trade.GetAskTrade();
+        if (info.orderId_ == order)
+          filled += info.quantity_;
+        const auto owner = owners_.find(info.orderId_);
+        if (owner == owners_.end())
+          continue;
+        auto report = MakeReport(ReportType::Filled, 0, info.orderId_,
+                                 trade.GetPrice(), info.quantity_);
+        report.side_ = side;
+        owner->second->fromExchange_.Send(report);
+        if (info.orderId_ != order && !orderBook_.Contains(info.orderId_))
+          owners_.erase(owner);
+      }
+    }
+    return filled;
+  }
+
+  // GoodTillDate and Day orders run out on the book's clock, which follows
+  // the simulation's.
+  void Expire() {
+    for (const OrderId orderId : orderBook_.AdvanceTime(simulator_.Now())) {
+      const auto owner = owners_.find(orderId);
+      if (owner == owners_.end())
+        continue;
+      owner->second->fromExchange_.Send(
+          MakeReport(ReportType::Cancelled, 0, orderId, 0, 0));
+      owners_.erase(owner);
+    }
+  }
+
+  void PublishTopOfBook() {
+    const TopOfBook &topOfBook = orderBook_.GetTopOfBook();
+    if (topOfBook == topOfBook_)
+      return;
+    topOfBook_ = topOfBook;
+    auto report = MakeReport(ReportType::TopOfBook, 0, 0, 0, 0);
+    report.topOfBook_ = topOfBook;
+    for (const auto &session : sessions_)
+      if (session->subscribed_)
+        session->fromExchange_.Send(report);
+  }
+};
+
+inline OrderId Session::SendNew(OrderType orderType, Side side, Price price,
+                                Quantity quantity) {
+  const OrderId orderId = exchange_.NextOrderId();
+  Send({RequestType::New, ++sequence_, orderId, orderType, side, price,
+        quantity});
+  return orderId;
+}
+
+inline void Session::Deliver(Request request) {
+  exchange_.Execute(*this, request);
+}
+
+} // namespace sim
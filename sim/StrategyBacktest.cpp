@@ -0,0 +1,202 @@
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Simulation.h"
+
+// strategy_backtest [seconds] [traders]
+// Runs the same simulated market several times, each time with a market
+// maker at a different latency from the exchange, and compares how it fares.
+// traders noise traders (50 us away, with jitter) post limit orders around
+// a fair value that takes a random walk and send the odd market order; the
+// fair value itself is never sent to anybody, so the book only catches up
+// with it through their orders. The maker joins the best bid and ask it
+// last saw and moves its quotes whenever that changes. The slower it hears
+// about a move, the longer its quotes stand at stale prices for others to
+// trade against.
+namespace {
+
+constexpr Timestamp Microsecond = 1'000;
+constexpr Timestamp Second = 1'000'000'000;
+
+sim::Process RandomWalk(sim::Simulator &simulator, Price &fair,
+                        std::uint64_t seed) {
+  std::mt19937_64 random{seed};
+  for (;;) {
+    co_await simulator.Sleep(100 * Microsecond);
+    fair += static_cast<Price>(random() % 3) - 1;
+  }
+}
+
+sim::Process NoiseTrader(sim::Session &session, const Price &fair,
+                         std::uint64_t seed) {
+  auto &simulator = session.GetSimulator();
+  std::mt19937_64 random{seed};
+  std::exponential_distribution<double> pause{1.0 / (200 * Microsecond)};
+  std::deque<OrderId> resting;
+  for (;;) {
+    co_await simulator.Sleep(static_cast<Timestamp>(pause(random)) + 1);
+    // Reports only matter to the strategy under test.
+    sim::Report report;
+    while (session.TryReceive(report)) {
+    }
+
+    const Side side = random() % 2 ? Side::Buy : Side::Sell;
+    const auto quantity = static_cast<Quantity>(100 * (1 + random() % 5));
+    if (random() % 10 < 3) {
+      session.SendNew(OrderType::Market, side, 0, quantity);
+      continue;
+    }
+    const auto offset = static_cast<Price>(1 + random() % 5);
+    resting.push_back(session.SendNew(OrderType::GoodTillCancel, side,
+                                      side == Side::Buy ? fair - offset
+                                                        : fair + offset,
+                                      quantity));
+    if (resting.size() > 10) {
+      session.SendCancel(resting.front());
+      resting.pop_front();
+    }
+  }
+}
+
+struct MakerResult {
+  std::uint64_t fills_{0};
+  std::uint64_t volume_{0};
+  std::uint64_t requotes_{0};
+  std::int64_t position_{0};
+  std::int64_t cash_{0};
+};
+
+struct Quote {
+  Side side_;
+  OrderId orderId_{0};
+  Price price_{0};
+};
+
+// Moving a quote resets it to the full size; a quote that is gone by the
+// time the move arrives (filled, most likely) is entered anew. A side whose
+// fills would take the position past limit is pulled until it comes back.
+sim::Process Maker(sim::Session &session, Quantity size, std::int64_t limit,
+                   MakerResult &result) {
+  session.Subscribe();
+  Quote bid{Side::Buy}, ask{Side::Sell};
+  for (;;) {
+    // Everything that queued up while the maker was waiting on an answer is
+    // taken at once, and only the latest top of book is acted on.
+    sim::Report report = co_await session.Receive();
+    bool moved = false;
+    do {
+      if (report.type_ == sim::ReportType::TopOfBook) {
+        moved = true;
+      } else if (report.type_ == sim::ReportType::Filled) {
+        const auto signedQuantity =
+            static_cast<std::int64_t>(report.quantity_) *
+            (report.side_ == Side::Buy ? 1 : -1);
+        result.position_ += signedQuantity;
+        result.cash_ -= signedQuantity * report.price_;
+        result.volume_ += report.quantity_;
+        ++result.fills_;
+      }
+    } while (session.TryReceive(report));
+    if (!moved)
+      continue;
+
+    const TopOfBook &top = session.GetTopOfBook();
+    for (Quote *quote : {&bid, &ask}) {
+      const bool buy = quote->side_ == Side::Buy;
+      if ((buy ? result.position_ : -result.position_) + size > limit) {
+        if (quote->orderId_ != 0)
+          co_await session.Cancel(std::exchange(quote->orderId_, 0));
+        continue;
+      }
+      if ((buy ? top.bidQuantity_ : top.askQuantity_) == 0)
+        continue;
+      const Price target = buy ? top.bidPrice_ : top.askPrice_;
+      if (quote->orderId_ != 0 && quote->price_ == target)
+        continue;
+
+      ++result.requotes_;
+      sim::Report answer{sim::ReportType::Rejected};
+      if (quote->orderId_ != 0)
+        answer = co_await session.Modify(quote->orderId_, quote->side_,
+                                         target, size);
+      if (answer.type_ == sim::ReportType::Rejected)
+        answer = co_await session.Submit(OrderType::GoodTillCancel,
+                                         quote->side_, target, size);
+      const bool resting =
+          answer.type_ == sim::ReportType::Accepted && answer.quantity_ != 0;
+      *quote = {quote->side_, resting ? answer.orderId_ : 0, target};
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const double seconds = argc > 1 ? std::stod(argv[1]) : 60;
+  const std::size_t traders = argc > 2 ? std::stoul(argv[2]) : 20;
+  const auto end = static_cast<Timestamp>(seconds * Second);
+
+  std::cout << std::fixed << std::setprecision(2);
+  for (const Timestamp latency :
+       {1 * Microsecond, 10 * Microsecond, 100 * Microsecond,
+        1000 * Microsecond}) {
+    sim::Simulator simulator;
+    sim::Exchange exchange{simulator};
+    Price fair = 10'000;
+    MakerResult result;
+
+    // Connected and spawned in the same order every run, so the noise
+    // traders see the same random draws whatever the maker's latency.
+    simulator.Spawn(RandomWalk(simulator, fair, 1));
+    for (std::size_t i = 0; i < traders; ++i)
+      simulator.Spawn(NoiseTrader(
+          exchange.Connect({50 * Microsecond, 50 * Microsecond,
+                            20 * Microsecond}),
+          fair, i + 2));
+    simulator.Spawn(
+        Maker(exchange.Connect({latency, latency, 0}), 100, 1000, result));
+
+    const auto start = std::chrono::steady_clock::now();
+    simulator.Run(end);
+    const double elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+
+    const TopOfBook &top = exchange.GetBook().GetTopOfBook();
+    const Price mid = top.bidQuantity_ && top.askQuantity_
+                          ? (top.bidPrice_ + top.askPrice_) / 2
+                          : fair;
+    std::cout << "maker " << latency / Microsecond << " us away: "
+              << result.fills_ << " fills, " << result.volume_
+              << " shares, position " << result.position_ << ", P&L "
+              << result.cash_ + result.position_ * mid << " ticks, "
+              << result.requotes_ << " requotes\n"
+              << "  " << simulator.GetEventCount() << " events, "
+              << exchange.GetRequestCount() << " requests, "
+              << exchange.GetTradeCount() << " trades in " << elapsed
+              << " s: " << simulator.GetEventCount() / elapsed
+              << " events/s, " << seconds / elapsed << "x real time\n";
+    const auto &statistics = exchange.GetStatistics();
+    if (const auto session = statistics.GetSession()) {
+      const auto &bars = statistics.GetTimeBars();
+      std::cout << "  session: open " << session->open_ << ", high "
+                << session->high_ << ", low " << session->low_ << ", last "
+                << session->close_ << ", VWAP " << statistics.GetVwap()
+                << ", " << statistics.GetVolume() << " shares, "
+                << bars.Size() << " one-second bars";
+      if (!bars.Empty())
+        std::cout << " (last: " << bars[0].open_ << " " << bars[0].high_
+                  << " " << bars[0].low_ << " " << bars[0].close_ << ", "
+                  << bars[0].volume_ << " shares)";
+      std::cout << "\n";
+    }
+  }
+  return 0;
+}